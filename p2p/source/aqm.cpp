@@ -0,0 +1,124 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+
+#include "aqm.hpp"
+#include "sleep.hpp"
+
+namespace orc {
+
+// the protocol and addresses of an ipv4 packet, and the ports of tcp or udp; anything else is one flow
+static size_t Classify(const Beam &data) {
+    const auto bytes(data.data());
+    const auto size(data.size());
+    if (size < 20 || (bytes[0] >> 4) != 4)
+        return 0;
+
+    uint64_t hash(14695981039346656037u);
+    const auto mix([&](size_t offset, size_t count) {
+        for (auto i(offset); i != offset + count; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211u;
+    });
+
+    mix(9, 1);
+    mix(12, 8);
+    const size_t header((bytes[0] & 0xf) * 4);
+    if ((bytes[9] == 6 || bytes[9] == 17) && size >= header + 4)
+        mix(header, 4);
+    return hash;
+}
+
+task<void> Aqm::Drain() {
+    auto next(Clock_::now());
+
+    for (;;) {
+        const auto now(Clock_::now());
+        auto packet([&]() {
+            const auto locked(locked_());
+            auto packet(locked->queue_.Pop(now, [&](const Codel::Packet &packet) {
+                ++locked->stats_.dropped_;
+            }));
+            if (!packet)
+                locked->draining_ = false;
+            else {
+                auto &stats(locked->stats_);
+                const auto sojourn(now - packet->stamp_);
+                ++stats.packets_;
+                stats.sojourn_ += sojourn;
+                stats.worst_ = std::max(stats.worst_, sojourn);
+            }
+            return packet;
+        }());
+
+        if (!packet)
+            co_return;
+
+        if (orc_ignore({ co_await Inner()->Send(packet->data_); }))
+            ++locked_()->stats_.failed_;
+
+        if (rate_ == 0)
+            continue;
+
+        // sleeping is only good to a millisecond, so let that much slip before waiting
+        next = std::max(next, now) + std::chrono::duration_cast<Clock_::duration>(std::chrono::duration<double>(double(packet->data_.size()) / rate_));
+        const auto ahead(std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock_::now()));
+        if (ahead.count() > 1)
+            co_await Sleep(ahead);
+    }
+}
+
+Aqm::Aqm(BufferDrain *drain, uint64_t rate, unsigned flows, size_t limit, Clock_::duration target, Clock_::duration interval) :
+    Link<Buffer>(drain),
+    rate_(rate),
+    locked_(std::in_place, flows, limit, target, interval)
+{
+    type_ = typeid(*this).name();
+}
+
+task<void> Aqm::Shut() noexcept {
+    co_await nest_.Shut();
+    co_await Inner()->Shut();
+    co_await Link::Shut();
+}
+
+task<void> Aqm::Send(const Buffer &data) {
+    Beam beam(data);
+    const auto hash(Classify(beam));
+
+    {
+        const auto locked(locked_());
+        locked->queue_.Push(std::move(beam), hash, Clock_::now(), [&](const Codel::Packet &packet) {
+            ++locked->stats_.overflowed_;
+        });
+        if (locked->draining_)
+            co_return;
+        locked->draining_ = true;
+    }
+
+    // once shut, nothing will drain what was queued; so the next Send tries again
+    if (!nest_.Hatch([&]() noexcept { return [this]() -> task<void> {
+        co_return co_await Drain(); }; }))
+        locked_()->draining_ = false;
+}
+
+}
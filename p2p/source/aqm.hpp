@@ -0,0 +1,90 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_AQM_HPP
+#define ORCHID_AQM_HPP
+
+#include "codel.hpp"
+#include "link.hpp"
+#include "locked.hpp"
+#include "nest.hpp"
+
+namespace orc {
+
+// a queue that can go at any Sink boundary: Send returns once the packet is
+// queued, and fq-codel decides what the inner pump gets next (and what is
+// dropped); with a rate, it also paces to just under a link that has no
+// backpressure of its own, so the queue forms here and not somewhere dumber
+class Aqm :
+    public Link<Buffer>
+{
+  public:
+    typedef Codel::Clock_ Clock_;
+
+    struct Stats {
+        uint64_t packets_ = 0;
+        uint64_t dropped_ = 0;
+        uint64_t overflowed_ = 0;
+        // packets the inner pump failed to send
+        uint64_t failed_ = 0;
+        // time the packets that were sent spent queued
+        Clock_::duration sojourn_ = {};
+        Clock_::duration worst_ = {};
+    };
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+  private:
+    // bytes per second, or 0 to send as fast as the inner pump takes them
+    const uint64_t rate_;
+
+    struct Locked_ {
+        FqCodel queue_;
+        bool draining_ = false;
+        Stats stats_;
+
+        template <typename... Args_>
+        Locked_(Args_ &&...args) :
+            queue_(std::forward<Args_>(args)...)
+        {
+        }
+    }; Locked<Locked_> locked_;
+
+    Nest nest_;
+
+    task<void> Drain();
+
+  public:
+    Aqm(BufferDrain *drain, uint64_t rate = 0, unsigned flows = 1024, size_t limit = 10240, Clock_::duration target = std::chrono::milliseconds(5), Clock_::duration interval = std::chrono::milliseconds(100));
+
+    task<void> Shut() noexcept override;
+    task<void> Send(const Buffer &data) override;
+
+    Stats Measure() const {
+        return locked_()->stats_;
+    }
+};
+
+}
+
+#endif//ORCHID_AQM_HPP
@@ -44,6 +44,9 @@ class Bonded :
       private:
         Bonded *const bonded_;
 
+      public:
+        const bool control_;
+
       protected:
         virtual Pump<Buffer> *Inner() noexcept = 0;
 
@@ -57,8 +60,9 @@ class Bonded :
         }
 
       public:
-        Bonding(Bonded *bonded) :
-            bonded_(bonded)
+        Bonding(Bonded *bonded, bool control) :
+            bonded_(bonded),
+            control_(control)
         {
         }
 
@@ -97,22 +101,27 @@ class Bonded :
         type_ = typeid(*this).name();
     }
 
-    Sink<Bonding> *Bond() {
+    // a control bonding carries the (reliable) protocol messages of a session
+    Sink<Bonding> *Bond(bool control = false) {
         // XXX: this is non-obviously incorrect
         const auto locked(locked_());
-        auto bonding(std::make_unique<Sink<Bonding>>(this));
+        auto bonding(std::make_unique<Sink<Bonding>>(this, control));
         const auto backup(bonding.get());
         locked->bondings_.emplace(backup, std::move(bonding));
         return backup;
     }
 
-    Bonding *Find() {
+    Bonding *Find(bool control = false) {
         // XXX: this lock isn't sufficient
         const auto locked(locked_());
-        const auto bonding(locked->bondings_.begin());
-        if (bonding == locked->bondings_.end())
-            return nullptr;
-        return bonding->first;
+        Bonding *other(nullptr);
+        for (const auto &bonding : locked->bondings_)
+            if (bonding.first->control_ == control)
+                return bonding.first;
+            else if (other == nullptr)
+                other = bonding.first;
+        // without a control bonding, protocol messages share the data one
+        return control ? other : nullptr;
     }
 
     task<void> Shut() noexcept override {
@@ -127,8 +136,8 @@ class Bonded :
         co_await Valve::Shut();
     }
 
-    task<void> Send(const Buffer &data) {
-        if (const auto bonding = Find())
+    task<void> Send(const Buffer &data, bool control = false) {
+        if (const auto bonding = Find(control))
             co_await bonding->Send(data);
     }
 };
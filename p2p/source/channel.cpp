@@ -30,10 +30,13 @@
 #include <rtc_base/openssl_identity.h>
 #include <rtc_base/ssl_adapter.h>
 
+#include <usrsctp.h>
+
 #include "channel.hpp"
 #include "lwip.hpp"
 #include "memory.hpp"
 #include "pirate.hpp"
+#include "protocol.hpp"
 #include "socket.hpp"
 #include "trace.hpp"
 
@@ -65,6 +68,7 @@ struct SetupSSL {
 
 Peer::Peer(const S<Origin> &origin, Configuration configuration) :
     origin_(origin),
+    direct_(configuration.direct_),
     peer_([&]() {
         const auto &threads(Threads::Get());
 
@@ -102,15 +106,10 @@ Peer::Peer(const S<Origin> &origin, Configuration configuration) :
 struct Internal_ { typedef struct socket *(cricket::SctpTransport::*type); };
 template struct Pirate<Internal_, &cricket::SctpTransport::sock_>;
 
-task<struct socket *> Peer::Internal() {
-    auto sctp(co_await Post([&]() -> rtc::scoped_refptr<webrtc::SctpTransportInterface> {
+task<rtc::scoped_refptr<webrtc::SctpTransportInterface>> Peer::Transport() {
+    co_return co_await Post([&]() -> rtc::scoped_refptr<webrtc::SctpTransportInterface> {
         return peer_->GetSctpTransport();
-    }));
-
-    orc_assert(sctp != nullptr);
-
-    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-static-cast-downcast)
-    co_return static_cast<cricket::SctpTransport *>(static_cast<webrtc::SctpTransport *>(sctp.get())->internal())->*Loot<Internal_>::pointer;
+    });
 }
 
 task<cricket::Candidate> Peer::Candidate() {
@@ -133,6 +132,17 @@ task<cricket::Candidate> Peer::Candidate() {
     }, origin_->Thread());
 }
 
+void Peer::Trickle(const std::string &sdp) {
+    static const std::regex re("a=(candidate:[^\r\n]*)");
+    for (std::sregex_iterator match(sdp.begin(), sdp.end(), re), end; match != end; ++match) {
+        webrtc::SdpParseError error;
+        const U<webrtc::IceCandidateInterface> candidate(webrtc::CreateIceCandidate("0", 0, (*match)[1].str(), &error));
+        orc_assert_(candidate != nullptr, "invalid candidate: " << (*match)[1].str());
+        // duplicates of candidates from the early answer are ignored by the transport
+        orc_ignore({ orc_assert(peer_->AddIceCandidate(candidate.get())); });
+    }
+}
+
 void Peer::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState state) noexcept {
     switch (state) {
         case webrtc::PeerConnectionInterface::kIceConnectionNew:
@@ -260,12 +270,98 @@ _trace();
     }
 };
 
-task<Socket> Channel::Wire(Sunk<> *sunk, const S<Origin> &origin, Configuration configuration, const std::function<task<std::string> (std::string)> &respond) {
+task<void> Channel::Direct() {
+    const auto sctp(co_await peer_->Transport());
+    orc_assert(sctp != nullptr);
+
+    // serialized with OnStateChange, which clears this on close
+    co_await Post([&]() {
+        if (channel_->state() != webrtc::DataChannelInterface::kOpen)
+            return;
+        const auto stream(channel_->id());
+        orc_assert(stream >= 0);
+        const auto direct(direct_());
+        direct->sctp_ = sctp;
+        direct->stream_ = stream;
+    });
+}
+
+// the flag is only dropped once the ring looks empty, so a message pushed in
+// between is either seen here or schedules another Deliver of its own
+task<void> Channel::Deliver() {
+    do {
+        while (inbound_.Drain([&](const Beam &data) { Release(data.size()); Pump::Land(data); }, 64) == 64)
+            // let other sessions run between batches
+            co_await Schedule();
+        landing_ = false;
+    } while (!inbound_.Empty() && !landing_.exchange(true));
+}
+
+// runs on the signaling thread (from outbox_), with the same handshake as Deliver;
+// once direct, outbox_ is posted to the network thread instead, and as flushing_
+// is only dropped here, at most one of those threads is ever in this at a time
+void Channel::Flush() {
+    // DataChannel::Send would block the network thread on the signaling one
+    const auto network(peer_->origin_->Thread()->IsCurrent());
+    do {
+        const auto direct(*direct_());
+        outbound_.Drain([&](const rtc::CopyOnWriteBuffer &buffer) {
+            Release(buffer.size());
+            if (network)
+                Direct(direct, buffer);
+            else if (channel_->buffered_amount() == 0)
+                channel_->Send(webrtc::DataBuffer(buffer, true));
+        });
+        flushing_ = false;
+    } while (!outbound_.Empty() && !flushing_.exchange(true));
+}
+
+// this runs on the network thread: only there does the transport close its usrsctp
+// socket or let go of it, so the socket found here stays valid while it is used; a
+// message flushed after the channel stopped being direct is dropped, as it closes
+void Channel::Direct(const Direct_ &direct, const rtc::CopyOnWriteBuffer &buffer) {
+    if (direct.sctp_ == nullptr)
+        return;
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-static-cast-downcast)
+    const auto internal(static_cast<webrtc::SctpTransport *>(direct.sctp_.get())->internal());
+    if (internal == nullptr)
+        return;
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-static-cast-downcast)
+    const auto sctp(static_cast<cricket::SctpTransport *>(internal)->*Loot<Internal_>::pointer);
+    if (sctp == nullptr)
+        return;
+
+    struct sctp_sendv_spa spa = {};
+    spa.sendv_flags = SCTP_SEND_SNDINFO_VALID | SCTP_SEND_PRINFO_VALID;
+    spa.sendv_sndinfo.snd_sid = direct.stream_;
+    spa.sendv_sndinfo.snd_flags = SCTP_UNORDERED | SCTP_EOR;
+    // WebRTC Binary (RFC 8831)
+    spa.sendv_sndinfo.snd_ppid = boost::endian::native_to_big(uint32_t(53));
+    spa.sendv_prinfo.pr_policy = SCTP_PR_SCTP_RTX;
+    spa.sendv_prinfo.pr_value = 0;
+
+    // EWOULDBLOCK drops the packet, as the DataChannel path does when buffered
+    if (usrsctp_sendv(sctp, buffer.data(), buffer.size(), nullptr, 0, &spa, sizeof(spa), SCTP_SENDV_SPA, 0) < 0 && Verbose)
+        Log() << "usrsctp_sendv() = " << errno << std::endl;
+}
+
+task<Socket> Channel::Wire(Sunk<> *sunk, const S<Origin> &origin, Configuration configuration, const std::function<task<std::string> (std::string)> &respond, std::function<task<std::string> (std::string)> trickle, Sunk<> *control) {
     const auto client(Make<Actor>(origin, std::move(configuration)));
     const auto channel(sunk->Wire<Channel>(client));
+    const auto ordered(control == nullptr ? nullptr : control->Wire<Channel>(client, -1, Control_, std::string(), true));
     const auto answer(co_await respond(Strip(co_await client->Offer())));
     co_await client->Negotiate(answer);
+
+    // only an early answer (one without a=end-of-candidates) has any more candidates to fetch;
+    // connectivity checks against the early candidates proceed while this is outstanding
+    if (trickle != nullptr && answer.find("a=end-of-candidates") == std::string::npos)
+        Spawn([client, trickle = std::move(trickle), fragment = Fragment(answer)]() noexcept -> task<void> {
+            orc_ignore({ client->Trickle(co_await trickle(fragment)); });
+        });
+
     co_await channel->Open();
+    if (ordered != nullptr)
+        co_await ordered->Open();
     const auto candidate(co_await client->Candidate());
     const auto &socket(candidate.address());
     co_return Socket(socket.ipaddr().ipv4_address(), socket.port());
@@ -276,6 +372,13 @@ std::string Strip(const std::string &sdp) {
     return std::regex_replace(sdp, re, "");
 }
 
+std::string Fragment(const std::string &sdp) {
+    static const std::regex re("a=ice-ufrag:([^\r\n]*)");
+    std::smatch match;
+    orc_assert_(std::regex_search(sdp, match, re), "missing ice-ufrag:\n" << sdp);
+    return match[1].str();
+}
+
 rtc::scoped_refptr<rtc::RTCCertificate> Certify() {
     return rtc::RTCCertificate::Create(U<rtc::OpenSSLIdentity>(rtc::OpenSSLIdentity::GenerateWithExpiration(
         "WebRTC", rtc::KeyParams(rtc::KT_DEFAULT), 60*60*24
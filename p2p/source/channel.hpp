@@ -23,20 +23,24 @@
 #ifndef ORCHID_CHANNEL_HPP
 #define ORCHID_CHANNEL_HPP
 
+#include <atomic>
 #include <functional>
+#include <mutex>
 
 #include "api/peer_connection_interface.h"
+#include "api/sctp_transport_interface.h"
 
 #include "error.hpp"
 #include "event.hpp"
 #include "link.hpp"
+#include "locked.hpp"
+#include "nest.hpp"
 #include "origin.hpp"
+#include "ring.hpp"
 #include "task.hpp"
 #include "threads.hpp"
 #include "trace.hpp"
 
-struct socket;
-
 namespace orc {
 
 class Socket;
@@ -70,6 +74,8 @@ class Channel;
 struct Configuration final {
     rtc::scoped_refptr<rtc::RTCCertificate> tls_;
     std::vector<std::string> ice_;
+    // send straight to the usrsctp socket rather than via DataChannel::Send
+    bool direct_ = false;
 };
 
 class Peer :
@@ -81,11 +87,15 @@ class Peer :
 
   private:
     const S<Origin> origin_;
+    const bool direct_;
     const rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_;
 
     // XXX: do I need to lock this?
     std::set<Channel *> channels_;
+    // what those channels hold: their rings, and the messages queued in them
+    std::atomic<size_t> held_ = 0;
 
+    Event usable_;
     Event gathered_;
     std::vector<std::string> gathering_;
     std::vector<std::string> candidates_;
@@ -109,9 +119,13 @@ _trace();
         return peer_;
     }
 
-    task<struct socket *> Internal();
+    task<rtc::scoped_refptr<webrtc::SctpTransportInterface>> Transport();
     task<cricket::Candidate> Candidate();
 
+    size_t Held() const {
+        return held_.load(std::memory_order_relaxed);
+    }
+
 
     void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState state) noexcept override {
         _trace();
@@ -135,6 +149,7 @@ _trace();
 
             case webrtc::PeerConnectionInterface::kIceGatheringComplete:
                 orc_except({ candidates_ = gathering_; })
+                usable_();
                 gathered_();
             break;
         }
@@ -144,6 +159,9 @@ _trace();
         std::string sdp;
         candidate->ToString(&sdp);
         gathering_.push_back(sdp);
+        // a host candidate over udp is enough to start connectivity checks
+        if (candidate->candidate().protocol() == "udp")
+            usable_();
     }
 
     void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> interface) noexcept override;
@@ -155,9 +173,9 @@ _trace();
         co_await observer->Wait();
     }
 
-    task<std::string> Negotiation(webrtc::SessionDescriptionInterface *description) {
+    task<std::string> Negotiation(webrtc::SessionDescriptionInterface *description, bool early = false) {
         co_await Negotiate(description);
-        co_await gathered_.Wait();
+        co_await (early ? usable_ : gathered_).Wait();
         std::string sdp;
         peer_->local_description()->ToString(&sdp);
         co_return sdp;
@@ -183,7 +201,7 @@ _trace();
         co_await observer->Wait();
     }
 
-    task<std::string> Answer(const std::string &offer) {
+    task<std::string> Answer(const std::string &offer, bool early = false) {
         co_await Negotiate("offer", offer);
         co_return co_await Negotiation(co_await [&]() -> task<webrtc::SessionDescriptionInterface *> {
             const rtc::scoped_refptr<orc::CreateObserver> observer(new rtc::RefCountedObject<orc::CreateObserver>());
@@ -191,9 +209,21 @@ _trace();
             peer_->CreateAnswer(observer, options);
             co_await observer->Wait();
             co_return observer->description_;
-        }());
+        }(), early);
+    }
+
+    // an early answer only carries the candidates that existed when it was
+    // sent; the rest are handed over as a=candidate lines once gathered
+    task<std::string> Trickle() {
+        co_await gathered_.Wait();
+        std::string sdp;
+        for (const auto &candidate : candidates_)
+            sdp += "a=" + candidate + "\r\n";
+        co_return sdp;
     }
 
+    void Trickle(const std::string &sdp);
+
     task<void> Negotiate(const std::string &sdp) {
         co_return co_await Negotiate("answer", sdp);
     }
@@ -209,23 +239,82 @@ class Channel final :
 
     Event opened_;
 
+    // while set, outbound_ is flushed on the network thread, straight into the
+    // usrsctp socket of this transport (which only that thread closes or frees)
+    struct Direct_ {
+        rtc::scoped_refptr<webrtc::SctpTransportInterface> sctp_;
+        uint16_t stream_ = 0;
+    }; Locked<Direct_> direct_;
+
+    // messages from the network thread, landed in batches by a datapath task
+    Ring<Beam, 1024> inbound_;
+    std::atomic<bool> landing_ = false;
+    Nest nest_;
+
+    // messages for the signaling (or, if direct, network) thread, sent in batches by one posted message
+    class Outbox :
+        public rtc::MessageHandler
+    {
+      private:
+        Channel *const channel_;
+
+      protected:
+        void OnMessage(rtc::Message *message) override {
+            channel_->Flush();
+        }
+
+      public:
+        Outbox(Channel *channel) :
+            channel_(channel)
+        {
+        }
+    } outbox_;
+
+    // the ring has one producer, so senders take turns; once shutting_ (set under
+    // the same lock) nothing more is pushed to it, or posted for it to outbox_
+    std::mutex sending_;
+    Ring<rtc::CopyOnWriteBuffer, 1024> outbound_;
+    std::atomic<bool> flushing_ = false;
+    bool shutting_ = false;
+
+    // bytes queued in inbound_ and outbound_, also counted in peer_->held_
+    std::atomic<size_t> queued_ = 0;
+
+    void Hold(size_t size) {
+        queued_ += size;
+        peer_->held_ += size;
+    }
+
+    void Release(size_t size) {
+        queued_ -= size;
+        peer_->held_ -= size;
+    }
+
+    task<void> Direct();
+    void Direct(const Direct_ &direct, const rtc::CopyOnWriteBuffer &buffer);
+
+    task<void> Deliver();
+    void Flush();
+
   public:
-    static task<Socket> Wire(Sunk<> *sunk, const S<Origin> &origin, Configuration configuration, const std::function<task<std::string> (std::string)> &respond);
+    static task<Socket> Wire(Sunk<> *sunk, const S<Origin> &origin, Configuration configuration, const std::function<task<std::string> (std::string)> &respond, std::function<task<std::string> (std::string)> trickle = nullptr, Sunk<> *control = nullptr);
 
     Channel(BufferDrain *drain, const S<Peer> &peer, const rtc::scoped_refptr<webrtc::DataChannelInterface> &channel) :
         Pump<Buffer>(drain),
         peer_(peer),
-        channel_(channel)
+        channel_(channel),
+        outbox_(this)
     {
         type_ = typeid(*this).name();
         channel_->RegisterObserver(this);
         peer_->channels_.insert(this);
+        peer_->held_ += sizeof(inbound_) + sizeof(outbound_);
     }
 
-    Channel(BufferDrain *drain, const S<Peer> &peer, int id = -1, const std::string &label = std::string(), const std::string &protocol = std::string()) :
+    Channel(BufferDrain *drain, const S<Peer> &peer, int id = -1, const std::string &label = std::string(), const std::string &protocol = std::string(), bool ordered = false) :
         Channel(drain, peer, [&]() {
             webrtc::DataChannelInit init;
-            init.ordered = false;
+            init.ordered = ordered;
             init.protocol = protocol;
             if (id != -1) {
                 init.negotiated = true;
@@ -238,6 +327,12 @@ class Channel final :
 
     ~Channel() override {
 _trace();
+        if (Verbose)
+            Log() << "Channel " << this << " inbound " << inbound_.Peak() << "/" << inbound_.Dropped() << " outbound " << outbound_.Peak() << "/" << outbound_.Dropped() << " (peak/dropped)" << std::endl;
+        direct_()->sctp_ = nullptr;
+        Threads::Get().signals_->Clear(&outbox_);
+        peer_->origin_->Thread()->Clear(&outbox_);
+        peer_->held_ -= sizeof(inbound_) + sizeof(outbound_) + queued_;
         peer_->channels_.erase(this);
         channel_->UnregisterObserver();
     }
@@ -246,6 +341,14 @@ _trace();
         return peer_;
     }
 
+    const Ring<Beam, 1024> &Inbound() const {
+        return inbound_;
+    }
+
+    const Ring<rtc::CopyOnWriteBuffer, 1024> &Outbound() const {
+        return outbound_;
+    }
+
     void OnStateChange() noexcept override {
         switch (channel_->state()) {
             case webrtc::DataChannelInterface::kConnecting:
@@ -260,10 +363,12 @@ _trace();
             case webrtc::DataChannelInterface::kClosing:
                 if (Verbose)
                     Log() << "OnStateChange(kClosing)" << std::endl;
+                direct_()->sctp_ = nullptr;
                 break;
             case webrtc::DataChannelInterface::kClosed:
                 if (Verbose)
                     Log() << "OnStateChange(kClosed)" << std::endl;
+                direct_()->sctp_ = nullptr;
                 Stop();
                 break;
         }
@@ -278,7 +383,14 @@ _trace();
         const Subset data(buffer.data.data(), buffer.data.size());
         if (Verbose)
             Log() << "WebRTC >>> " << this << " " << data << std::endl;
-        Pump::Land(data);
+        // a full ring drops the message, much as a full socket buffer would
+        // counted first, so the drain never releases more than was held
+        Hold(data.size());
+        if (!inbound_.Push(Beam(data)))
+            return Release(data.size());
+        if (!landing_.exchange(true))
+            nest_.Hatch([&]() noexcept { return [this]() -> task<void> {
+                co_return co_await Deliver(); }; });
     }
 
     void Stop(const std::string &error = std::string()) noexcept {
@@ -288,13 +400,25 @@ _trace();
 
     task<void> Open() noexcept {
         co_await opened_.Wait();
+        // the ordered (control) channel must keep its reliable delivery
+        if (peer_->direct_ && !channel_->ordered())
+            orc_ignore({ co_await Direct(); });
     }
 
     task<void> Shut() noexcept override {
+        {
+            std::unique_lock<std::mutex> lock(sending_);
+            shutting_ = true;
+        }
+        direct_()->sctp_ = nullptr;
         channel_->Close();
         // XXX: this should be checking if Peer has a data_transport
         if (channel_->id() == -1)
             Stop();
+        co_await nest_.Shut();
+        // anything already posted to outbox_ has run once these have
+        co_await Post([]() noexcept {});
+        co_await Post([]() noexcept {}, peer_->origin_->Thread());
         co_await Pump::Shut();
     }
 
@@ -303,14 +427,22 @@ _trace();
             Log() << "WebRTC <<< " << this << " " << data << std::endl;
         rtc::CopyOnWriteBuffer buffer(data.size());
         data.copy(buffer.data(), buffer.size());
-        co_await Post([&]() {
-            if (channel_->buffered_amount() == 0)
-                channel_->Send(webrtc::DataBuffer(buffer, true));
-        });
+        std::unique_lock<std::mutex> lock(sending_);
+        if (shutting_)
+            co_return;
+        const auto size(buffer.size());
+        Hold(size);
+        if (!outbound_.Push(std::move(buffer))) {
+            Release(size);
+            co_return;
+        }
+        if (!flushing_.exchange(true))
+            (direct_()->sctp_ == nullptr ? Threads::Get().signals_.get() : peer_->origin_->Thread())->Post(RTC_FROM_HERE, &outbox_);
     }
 };
 
 std::string Strip(const std::string &sdp);
+std::string Fragment(const std::string &sdp);
 rtc::scoped_refptr<rtc::RTCCertificate> Certify();
 task<std::string> Description(const S<Origin> &origin, std::vector<std::string> ice);
 
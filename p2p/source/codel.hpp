@@ -0,0 +1,268 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_CODEL_HPP
+#define ORCHID_CODEL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <optional>
+#include <vector>
+
+#include "buffer.hpp"
+#include "error.hpp"
+
+namespace orc {
+
+// RFC 8289: once packets have been spending more than target in the queue for a
+// whole interval, drop from its head, more often the longer that goes on
+class Codel {
+  public:
+    typedef std::chrono::steady_clock Clock_;
+
+    struct Packet {
+        Beam data_;
+        Clock_::time_point stamp_;
+    };
+
+  private:
+    // a queue holding no more than a packet is never standing
+    static const size_t Mtu_ = 1514;
+
+    const Clock_::duration target_;
+    const Clock_::duration interval_;
+
+    std::deque<Packet> queue_;
+    size_t bytes_ = 0;
+
+    // when the delay will have been above target for an interval; epoch if it isn't above
+    Clock_::time_point above_;
+    Clock_::time_point next_;
+    unsigned count_ = 0;
+    unsigned last_ = 0;
+    bool dropping_ = false;
+
+    Clock_::time_point Law(Clock_::time_point time) const {
+        return time + std::chrono::duration_cast<Clock_::duration>(interval_ / std::sqrt(double(count_)));
+    }
+
+    // takes the head of the queue, and says if it may be dropped
+    bool Head(Clock_::time_point now, std::optional<Packet> &packet) {
+        if (queue_.empty()) {
+            above_ = {};
+            packet.reset();
+            return false;
+        }
+
+        packet.emplace(std::move(queue_.front()));
+        queue_.pop_front();
+        bytes_ -= packet->data_.size();
+
+        if (now - packet->stamp_ < target_ || bytes_ <= Mtu_) {
+            above_ = {};
+            return false;
+        }
+
+        if (above_ == Clock_::time_point()) {
+            above_ = now + interval_;
+            return false;
+        }
+
+        return now >= above_;
+    }
+
+  public:
+    Codel(Clock_::duration target, Clock_::duration interval) :
+        target_(target),
+        interval_(interval)
+    {
+    }
+
+    void Push(Beam data, Clock_::time_point now) {
+        bytes_ += data.size();
+        queue_.push_back({std::move(data), now});
+    }
+
+    // the next packet to send, if any; drop is told of each one dropped on the way
+    template <typename Drop_>
+    std::optional<Packet> Pop(Clock_::time_point now, Drop_ &&drop) {
+        std::optional<Packet> packet;
+        auto ok(Head(now, packet));
+
+        if (!packet)
+            dropping_ = false;
+        else if (dropping_) {
+            if (!ok)
+                dropping_ = false;
+            while (dropping_ && now >= next_) {
+                drop(*packet);
+                ++count_;
+                ok = Head(now, packet);
+                if (!packet || !ok)
+                    dropping_ = false;
+                else
+                    next_ = Law(next_);
+            }
+        } else if (ok) {
+            drop(*packet);
+            Head(now, packet);
+            dropping_ = true;
+            // if it was dropping recently, pick up near the rate that last worked
+            const auto delta(count_ - last_);
+            count_ = delta > 1 && now - next_ < interval_ * 16 ? delta : 1;
+            next_ = Law(now);
+            last_ = count_;
+        }
+
+        return packet;
+    }
+
+    // for an overflow: drops the head regardless
+    Packet Shed() {
+        auto packet(std::move(queue_.front()));
+        queue_.pop_front();
+        bytes_ -= packet.data_.size();
+        return packet;
+    }
+
+    bool Empty() const {
+        return queue_.empty();
+    }
+
+    size_t Bytes() const {
+        return bytes_;
+    }
+};
+
+// RFC 8290: packets are hashed by flow to separate Codel queues, served round
+// robin a quantum at a time, with flows that just became active going first; so
+// a sparse flow (a ping, a dns query) never waits behind a bulk one. 1 flow is
+// plain Codel; a target longer than the limit drains in is a tail-drop fifo
+class FqCodel {
+  public:
+    typedef Codel::Clock_ Clock_;
+    typedef Codel::Packet Packet;
+
+  private:
+    struct Flow {
+        Codel codel_;
+        int64_t deficit_ = 0;
+        std::list<Flow *> *list_ = nullptr;
+        // where this is in list_, so moving it doesn't have to search for it
+        std::list<Flow *>::iterator at_;
+    };
+
+    const size_t quantum_;
+    const size_t limit_;
+
+    std::vector<Flow> flows_;
+    std::list<Flow *> new_;
+    std::list<Flow *> old_;
+    size_t count_ = 0;
+
+    void Move(Flow &flow, std::list<Flow *> *list) {
+        if (flow.list_ != nullptr && list != nullptr)
+            list->splice(list->end(), *flow.list_, flow.at_);
+        else if (flow.list_ != nullptr)
+            flow.list_->erase(flow.at_);
+        else if (list != nullptr)
+            flow.at_ = list->insert(list->end(), &flow);
+        flow.list_ = list;
+    }
+
+  public:
+    FqCodel(unsigned flows, size_t limit, Clock_::duration target, Clock_::duration interval, size_t quantum = 1514) :
+        quantum_(quantum),
+        limit_(limit)
+    {
+        orc_assert(flows != 0);
+        flows_.reserve(flows);
+        for (unsigned i(0); i != flows; ++i)
+            flows_.push_back({{target, interval}});
+    }
+
+    FqCodel(const FqCodel &fq) = delete;
+
+    // past the limit, overflow is told of the packet dropped from the head of the longest queue
+    template <typename Drop_>
+    void Push(Beam data, size_t hash, Clock_::time_point now, Drop_ &&overflow) {
+        auto &flow(flows_[hash % flows_.size()]);
+        flow.codel_.Push(std::move(data), now);
+        ++count_;
+
+        if (flow.list_ == nullptr) {
+            flow.deficit_ = quantum_;
+            Move(flow, &new_);
+        }
+
+        if (count_ > limit_) {
+            const auto fattest(std::max_element(flows_.begin(), flows_.end(), [](const Flow &lhs, const Flow &rhs) {
+                return lhs.codel_.Bytes() < rhs.codel_.Bytes();
+            }));
+            overflow(fattest->codel_.Shed());
+            --count_;
+        }
+    }
+
+    template <typename Drop_>
+    std::optional<Packet> Pop(Clock_::time_point now, Drop_ &&drop) {
+        for (;;) {
+            const auto list(!new_.empty() ? &new_ : !old_.empty() ? &old_ : nullptr);
+            if (list == nullptr)
+                return std::nullopt;
+            auto &flow(*list->front());
+
+            if (flow.deficit_ <= 0) {
+                flow.deficit_ += quantum_;
+                Move(flow, &old_);
+                continue;
+            }
+
+            auto packet(flow.codel_.Pop(now, [&](const Packet &packet) {
+                --count_;
+                drop(packet);
+            }));
+
+            if (!packet) {
+                // a new flow that empties goes to the back of the old ones, so it can't starve them by coming back
+                Move(flow, list == &new_ ? &old_ : nullptr);
+                continue;
+            }
+
+            --count_;
+            flow.deficit_ -= packet->data_.size();
+            return packet;
+        }
+    }
+
+    size_t Size() const {
+        return count_;
+    }
+};
+
+}
+
+#endif//ORCHID_CODEL_HPP
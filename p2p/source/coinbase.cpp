@@ -29,8 +29,8 @@
 
 namespace orc {
 
-task<Float> Price(const std::string &from, const std::string &to, const Float &adjust) {
-    const auto response(co_await Request("GET", {"https", "api.coinbase.com", "443", "/v2/prices/" + from + "-" + to + "/spot"}, {}, {}));
+task<Float> Price(const Locator &api, const std::string &from, const std::string &to, const Float &adjust) {
+    const auto response(co_await Request("GET", {api.scheme_, api.host_, api.port_, api.path_ + "v2/prices/" + from + "-" + to + "/spot"}, {}, {}));
     const auto result(Parse(response.body_));
     if (response.code_ == boost::beast::http::status::ok) {
         const auto &data(result["data"]);
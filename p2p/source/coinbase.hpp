@@ -27,13 +27,15 @@
 
 #include <boost/multiprecision/cpp_bin_float.hpp>
 
+#include "locator.hpp"
 #include "task.hpp"
 
 namespace orc {
 
 typedef boost::multiprecision::cpp_bin_float_oct Float;
 
-task<Float> Price(const std::string &from, const std::string &to, const Float &adjust);
+// api is coinbase's (https://api.coinbase.com/) or anything serving its /v2/prices
+task<Float> Price(const Locator &api, const std::string &from, const std::string &to, const Float &adjust);
 
 }
 
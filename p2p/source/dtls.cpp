@@ -0,0 +1,401 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <chrono>
+#include <sstream>
+
+#include <openssl/bio.h>
+
+#include <rtc_base/openssl_identity.h>
+
+#include "crypto.hpp"
+#include "dtls.hpp"
+#include "sleep.hpp"
+
+namespace orc {
+
+static size_t Get(const uint8_t *data, size_t size) {
+    size_t value(0);
+    for (size_t i(0); i != size; ++i)
+        value = value << 8 | data[i];
+    return value;
+}
+
+static void Put(uint8_t *data, size_t size, size_t value) {
+    for (size_t i(size); i-- != 0; value >>= 8)
+        data[i] = uint8_t(value);
+}
+
+// the offset of the cookie (its length) if datagram is a ClientHello, alone and unfragmented:
+// a record header (13 bytes), a handshake header (12), a version (2), a random (32) and a session id
+static size_t Hello(const Buffer &datagram) {
+    if (datagram.size() < 60)
+        return 0;
+    const Beam beam(datagram);
+    const auto data(beam.data());
+    if (data[0] != 22 || Get(data + 11, 2) != beam.size() - 13 || data[13] != 1)
+        return 0;
+    const auto size(Get(data + 14, 3));
+    if (size != beam.size() - 25 || Get(data + 19, 3) != 0 || Get(data + 22, 3) != size)
+        return 0;
+    const auto at(60 + data[59]);
+    return at < beam.size() ? at : 0;
+}
+
+// the ClientHello with the cookie at at (previously old bytes long) replaced
+static Beam Splice(const Buffer &hello, size_t at, const Buffer &cookie, size_t old) {
+    const Beam beam(hello);
+    const auto data(beam.data());
+    Beam spliced(beam.size() - old + cookie.size());
+    const auto out(spliced.data());
+    memcpy(out, data, at);
+    out[at] = uint8_t(cookie.size());
+    cookie.copy(out + at + 1, cookie.size());
+    memcpy(out + at + 1 + cookie.size(), data + at + 1 + old, beam.size() - at - 1 - old);
+    // the record, the handshake message and its one fragment all change size alike
+    Put(out + 11, 2, spliced.size() - 13);
+    Put(out + 14, 3, spliced.size() - 25);
+    Put(out + 22, 3, spliced.size() - 25);
+    return spliced;
+}
+
+// the cookie in datagram if it is a HelloVerifyRequest, or else nothing
+static Beam Verify(const Buffer &datagram) {
+    if (datagram.size() < 28)
+        return Beam();
+    const Beam beam(datagram);
+    const auto data(beam.data());
+    if (data[0] != 22 || Get(data + 11, 2) != beam.size() - 13 || data[13] != 3 || 28 + data[27] != beam.size())
+        return Beam();
+    return Beam(data + 28, data[27]);
+}
+
+void Dtls::Cookie(const Lock<Locked_> &locked, std::vector<Beam> &output) {
+    for (auto &datagram : output) {
+        const auto at(Hello(datagram));
+        if (at == 0)
+            continue;
+        locked->hello_ = Beam(datagram);
+        if (locked->cookie_.size() != 0 && datagram.data()[at] == 0)
+            datagram = Splice(datagram, at, locked->cookie_, 0);
+    }
+}
+
+BIO_METHOD *Dtls::Method() {
+    // every write from ssl_ is exactly one datagram; a memory bio would run them together
+    static BIO_METHOD *const method([]() {
+        const auto method(BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "orchid dtls"));
+        orc_assert(method != nullptr);
+
+        BIO_meth_set_create(method, [](BIO *bio) -> int {
+            BIO_set_init(bio, 1);
+            return 1;
+        });
+
+        BIO_meth_set_write(method, [](BIO *bio, const char *data, int size) -> int {
+            static_cast<std::vector<Beam> *>(BIO_get_data(bio))->emplace_back(data, size);
+            return size;
+        });
+
+        BIO_meth_set_ctrl(method, [](BIO *bio, int command, long number, void *pointer) -> long {
+            return command == BIO_CTRL_FLUSH ? 1 : 0;
+        });
+
+        return method;
+    }());
+
+    return method;
+}
+
+void Dtls::Flush(std::vector<Beam> output) {
+    for (auto &datagram : output)
+        nest_.Hatch([&]() noexcept { return [this, datagram = std::move(datagram)]() -> task<void> {
+            co_return co_await Inner()->Send(datagram); }; });
+}
+
+void Dtls::Fail(const std::string &error) noexcept {
+    {
+        const auto locked(locked_());
+        if (locked->stopped_)
+            return;
+        locked->stopped_ = true;
+        locked->error_ = error;
+    }
+
+    connected_();
+    Pump::Stop(error);
+}
+
+bool Dtls::Check(const Lock<Locked_> &locked, int result) {
+    if (result > 0)
+        return true;
+    const auto error(SSL_get_error(locked->ssl_.get(), result));
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_ZERO_RETURN)
+        return false;
+    const auto reason(ERR_reason_error_string(ERR_get_error()));
+    orc_throw("dtls error " << error << " " << (reason == nullptr ? "" : reason));
+}
+
+void Dtls::Land(const Buffer &data) {
+    std::vector<Beam> output;
+    std::vector<Beam> input;
+    bool connected(false);
+    bool closed(false);
+
+    {
+        // ssl_ never sees a HelloVerifyRequest: the client just sends its hello again, with the cookie
+        const auto locked(locked_());
+        if (!locked->connected_ && locked->hello_.size() != 0 && !SSL_is_server(locked->ssl_.get())) {
+            auto cookie(Verify(data));
+            if (cookie.size() != 0) {
+                locked->cookie_ = std::move(cookie);
+                output.emplace_back(Splice(locked->hello_, Hello(locked->hello_), locked->cookie_, 0));
+            }
+        }
+    }
+
+    if (!output.empty())
+        return Flush(std::move(output));
+
+    try {
+        const auto locked(locked_());
+        if (locked->stopped_)
+            return;
+        const auto ssl(locked->ssl_.get());
+
+        const Beam beam(data);
+        orc_assert(BIO_write(SSL_get_rbio(ssl), beam.data(), beam.size()) == int(beam.size()));
+
+        if (!locked->connected_ && Check(locked, SSL_do_handshake(ssl)))
+            connected = locked->connected_ = true;
+
+        if (locked->connected_)
+            for (;;) {
+                Beam beam(2048);
+                const auto writ(SSL_read(ssl, beam.data(), beam.size()));
+                if (!Check(locked, writ))
+                    break;
+                input.emplace_back(beam.subset(0, writ));
+            }
+
+        closed = (SSL_get_shutdown(ssl) & SSL_RECEIVED_SHUTDOWN) != 0;
+        output.swap(locked->output_);
+        Cookie(locked, output);
+    } catch (const std::exception &error) {
+        return Fail(error.what());
+    }
+
+    Flush(std::move(output));
+
+    if (connected)
+        connected_();
+    for (const auto &beam : input)
+        Pump::Land(beam);
+
+    if (closed)
+        Fail(std::string());
+}
+
+void Dtls::Stop(const std::string &error) noexcept {
+    Fail(error);
+}
+
+Dtls::Dtls(BufferDrain *drain, const rtc::scoped_refptr<rtc::RTCCertificate> &local, Verify verify) :
+    Pump(drain),
+    verify_(std::move(verify))
+{
+    bssl::UniquePtr<SSL_CTX> context(SSL_CTX_new(DTLS_method()));
+    orc_assert(context != nullptr);
+    orc_assert(SSL_CTX_set_min_proto_version(context.get(), DTLS1_2_VERSION));
+
+    if (local != nullptr)
+        // NOLINTNEXTLINE (cppcoreguidelines-pro-type-static-cast-downcast)
+        orc_assert(static_cast<rtc::OpenSSLIdentity *>(local->identity())->ConfigureIdentity(context.get()));
+    else {
+        orc_assert(verify_ != nullptr);
+        SSL_CTX_set_custom_verify(context.get(), SSL_VERIFY_PEER, [](SSL *ssl, uint8_t *alert) -> ssl_verify_result_t {
+            const auto dtls(static_cast<Dtls *>(SSL_get_app_data(ssl)));
+            const auto chain(SSL_get_peer_cert_chain(ssl));
+            std::list<const rtc::OpenSSLCertificate> certificates;
+            for (auto e(chain != nullptr ? sk_X509_num(chain) : 0), i(decltype(e)(0)); i != e; i++)
+                certificates.emplace_back(sk_X509_value(chain, i));
+            return dtls->verify_(certificates) ? ssl_verify_ok : ssl_verify_invalid;
+        });
+    }
+
+    const auto locked(locked_());
+    locked->ssl_.reset(SSL_new(context.get()));
+    const auto ssl(locked->ssl_.get());
+    orc_assert(ssl != nullptr);
+
+    SSL_set_app_data(ssl, this);
+    SSL_set_options(ssl, SSL_OP_NO_QUERY_MTU);
+    SSL_set_mtu(ssl, Mtu_);
+
+    const auto input(BIO_new(BIO_s_mem()));
+    orc_assert(input != nullptr);
+    BIO_set_mem_eof_return(input, -1);
+
+    const auto output(BIO_new(Method()));
+    orc_assert(output != nullptr);
+    BIO_set_data(output, &locked->output_);
+
+    SSL_set_bio(ssl, input, output);
+
+    if (local != nullptr)
+        SSL_set_accept_state(ssl);
+    else
+        SSL_set_connect_state(ssl);
+}
+
+task<void> Dtls::Open() {
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        // the client sends its hello; the server just finds it has nothing to read yet
+        Check(locked, SSL_do_handshake(locked->ssl_.get()));
+        output.swap(locked->output_);
+        Cookie(locked, output);
+    }
+
+    for (const auto &datagram : output)
+        co_await Inner()->Send(datagram);
+
+    nest_.Hatch([&]() noexcept { return [this]() -> task<void> {
+        for (;;) {
+            co_await Sleep(1);
+
+            std::vector<Beam> output;
+            bool timeout;
+
+            {
+                const auto locked(locked_());
+                if (locked->connected_ || locked->stopped_)
+                    break;
+                // NB: ssl_ gives up (returning -1) after a dozen doubling timeouts
+                timeout = DTLSv1_handle_timeout(locked->ssl_.get()) < 0;
+                output.swap(locked->output_);
+                Cookie(locked, output);
+            }
+
+            if (timeout) {
+                Fail("dtls timeout");
+                break;
+            }
+
+            for (const auto &datagram : output)
+                co_await Inner()->Send(datagram);
+        }
+    }; });
+
+    co_await connected_.Wait();
+
+    const auto locked(locked_());
+    orc_assert_(!locked->stopped_, "dtls " << (locked->error_.empty() ? "closed" : locked->error_));
+}
+
+task<void> Dtls::Shut() noexcept {
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        if (locked->connected_ && !locked->stopped_)
+            SSL_shutdown(locked->ssl_.get());
+        output.swap(locked->output_);
+    }
+
+    for (const auto &datagram : output)
+        orc_ignore({ co_await Inner()->Send(datagram); });
+
+    Fail(std::string());
+
+    co_await nest_.Shut();
+    co_await Inner()->Shut();
+    co_await Pump::Shut();
+}
+
+task<void> Dtls::Send(const Buffer &data) {
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        orc_assert(locked->connected_ && !locked->stopped_);
+        const Beam beam(data);
+        orc_assert(SSL_write(locked->ssl_.get(), beam.data(), beam.size()) == int(beam.size()));
+        output.swap(locked->output_);
+    }
+
+    for (const auto &datagram : output)
+        co_await Inner()->Send(datagram);
+}
+
+Cookies::Cookies() :
+    secret_(Random<32>())
+{
+}
+
+Brick<16> Cookies::Cookie(const Socket &remote, uint64_t epoch) const {
+    std::ostringstream address;
+    address << remote;
+    return Hash(Tie(secret_, Number<uint64_t>(epoch), Strung<std::string>(address.str()))).Clip<16>();
+}
+
+bool Cookies::Check(const Socket &remote, Beam &hello, Beam &reply) const {
+    const auto at(Hello(hello));
+    if (at == 0)
+        return false;
+
+    // a cookie is good for between 30 and 60 seconds
+    const auto epoch(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 30);
+    const auto size(hello.data()[at]);
+    if (size == 16) {
+        const Beam cookie(hello.data() + at + 1, size);
+        if (cookie == Cookie(remote, epoch) || cookie == Cookie(remote, epoch - 1)) {
+            hello = Splice(hello, at, Beam(), size);
+            return true;
+        }
+    }
+
+    const auto cookie(Cookie(remote, epoch));
+    reply = Beam(13 + 12 + 3 + cookie.size());
+    const auto out(reply.data());
+    out[0] = 22;
+    out[1] = 0xfe;
+    out[2] = 0xff;
+    // with the epoch and sequence number of the ClientHello
+    memcpy(out + 3, hello.data() + 3, 8);
+    Put(out + 11, 2, reply.size() - 13);
+    out[13] = 3;
+    Put(out + 14, 3, 3 + cookie.size());
+    memcpy(out + 17, hello.data() + 17, 2);
+    Put(out + 19, 3, 0);
+    Put(out + 22, 3, 3 + cookie.size());
+    out[25] = 0xfe;
+    out[26] = 0xff;
+    out[27] = uint8_t(cookie.size());
+    cookie.copy(out + 28, cookie.size());
+    return false;
+}
+
+}
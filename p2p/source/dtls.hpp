@@ -0,0 +1,119 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_DTLS_HPP
+#define ORCHID_DTLS_HPP
+
+#include <functional>
+#include <list>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include <rtc_base/openssl_certificate.h>
+#include <rtc_base/rtc_certificate.h>
+
+#include "buffer.hpp"
+#include "event.hpp"
+#include "link.hpp"
+#include "locked.hpp"
+#include "nest.hpp"
+#include "socket.hpp"
+
+namespace orc {
+
+// a datagram tls session wrapped directly around a udp link: an alternative to
+// the webrtc data channel (ice, dtls and sctp) for servers with a public address
+
+class Dtls :
+    public Pump<Buffer>,
+    public BufferDrain
+{
+  public:
+    typedef std::function<bool (const std::list<const rtc::OpenSSLCertificate> &)> Verify;
+
+  private:
+    const Verify verify_;
+
+    struct Locked_ {
+        bssl::UniquePtr<SSL> ssl_;
+        // datagrams written by ssl_ since the last Flush
+        std::vector<Beam> output_;
+        bool connected_ = false;
+        bool stopped_ = false;
+        std::string error_;
+        // a client's last ClientHello (as ssl_ wrote it), and the cookie it gets sent with
+        Beam hello_;
+        Beam cookie_;
+    }; Locked<Locked_> locked_;
+
+    Event connected_;
+    Nest nest_;
+
+    static BIO_METHOD *Method();
+
+    void Cookie(const Lock<Locked_> &locked, std::vector<Beam> &output);
+    void Flush(std::vector<Beam> output);
+    void Fail(const std::string &error) noexcept;
+    bool Check(const Lock<Locked_> &locked, int result);
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override;
+    void Stop(const std::string &error) noexcept override;
+
+  public:
+    static const size_t Mtu_ = 1200;
+
+    // the side holding a certificate accepts; the other checks it with verify
+    Dtls(BufferDrain *drain, const rtc::scoped_refptr<rtc::RTCCertificate> &local, Verify verify = nullptr);
+
+    task<void> Open();
+    task<void> Shut() noexcept override;
+
+    task<void> Send(const Buffer &data) override;
+};
+
+// a stateless HelloVerifyRequest (RFC 6347 4.2.1) for a server making a session for
+// each new address: BoringSSL has no server side for these, so Check answers a first
+// ClientHello itself, and takes the cookie back out of the second before any Dtls is
+// made for it; a client Dtls puts the cookie into its ClientHello, which is otherwise
+// exactly as both of their transcripts have it
+class Cookies {
+  private:
+    const Brick<32> secret_;
+
+    Brick<16> Cookie(const Socket &remote, uint64_t epoch) const;
+
+  public:
+    Cookies();
+
+    // true if hello is a ClientHello with a good cookie, which is then taken out of it;
+    // otherwise reply is the HelloVerifyRequest to send back (or empty, for no reply)
+    bool Check(const Socket &remote, Beam &hello, Beam &reply) const;
+};
+
+}
+
+#endif//ORCHID_DTLS_HPP
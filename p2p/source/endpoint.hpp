@@ -168,6 +168,12 @@ class Selector final :
         return name_;
     }
 
+    Beam Encode(const Args_ &...args) const {
+        Builder builder;
+        Coder<Args_...>::Encode(builder, std::forward<const Args_>(args)...);
+        return Beam(Tie(*this, builder));
+    }
+
     task<Result_> Call(const Endpoint &endpoint, const Argument &number, const Address &contract, const uint256_t &gas, const Args_ &...args) const { orc_block({
         Builder builder;
         Coder<Args_...>::Encode(builder, std::forward<const Args_>(args)...);
@@ -0,0 +1,180 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <chrono>
+
+#include "baton.hpp"
+#include "gateway.hpp"
+#include "log.hpp"
+
+namespace orc {
+
+static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Lane::Lane(BufferDrain *drain, Gateway *gateway, const Socket &remote) :
+    Pump(drain),
+    gateway_(gateway),
+    remote_(remote),
+    seen_(Now())
+{
+}
+
+task<void> Lane::Shut() noexcept {
+    gateway_->Drop(remote_, this);
+    Pump::Stop();
+    co_await Pump::Shut();
+}
+
+task<void> Lane::Send(const Buffer &data) {
+    co_return co_await gateway_->Send(data, remote_);
+}
+
+void Gateway::Land(const Buffer &data, const Socket &socket) {
+    Lane *lane(nullptr);
+    std::unique_lock<std::recursive_mutex> landing;
+
+    {
+        const auto locked(locked_());
+        const auto iterator(locked->lanes_.find(socket));
+        if (iterator != locked->lanes_.end()) {
+            lane = iterator->second;
+            // this keeps Drop from returning (and so lane from going away) until the Land is done
+            landing = std::unique_lock(lane->mutex_);
+        }
+    }
+
+    if (lane != nullptr) {
+        lane->seen_ = Now();
+        return lane->Land(data);
+    }
+
+    // accept_ makes a whole session, so it (and then Land) runs without holding locked_
+    Beam beam(data);
+    lane = accept_(this, socket, beam);
+    if (lane == nullptr)
+        return;
+
+    {
+        const auto locked(locked_());
+        locked->lanes_.emplace(socket, lane);
+        landing = std::unique_lock(lane->mutex_);
+    }
+
+    lane->Land(beam);
+}
+
+void Gateway::Drop(const Socket &socket, Lane *lane) {
+    {
+        const auto locked(locked_());
+        const auto iterator(locked->lanes_.find(socket));
+        if (iterator != locked->lanes_.end() && iterator->second == lane)
+            locked->lanes_.erase(iterator);
+    }
+
+    // wait out a Land that found this Lane before it was erased
+    const std::unique_lock<std::recursive_mutex> landing(lane->mutex_);
+}
+
+Gateway::Gateway(Accept accept, unsigned idle) :
+    accept_(std::move(accept)),
+    idle_(idle),
+    connection_(Context())
+{
+    type_ = typeid(*this).name();
+}
+
+Socket Gateway::Local() const {
+    return connection_.local_endpoint();
+}
+
+void Gateway::Open(const Socket &socket) {
+    connection_.open(socket.Host().v4() ? asio::ip::udp::v4() : asio::ip::udp::v6());
+    connection_.non_blocking(true);
+    connection_.bind({socket.Host(), socket.Port()});
+
+    Spawn([this]() noexcept -> task<void> {
+        for (;;) {
+            // NOLINTNEXTLINE (modernize-avoid-c-arrays)
+            char data[2048];
+            asio::ip::udp::endpoint endpoint;
+            size_t writ;
+            try {
+                writ = co_await connection_.async_receive_from(asio::buffer(data), endpoint, Token());
+            } catch (const asio::system_error &error) {
+                if (!connection_.is_open())
+                    break;
+                orc_ignore({ orc_adapt(error); });
+                continue;
+            }
+
+            Subset subset(data, writ);
+            if (Verbose)
+                Log() << "\e[33mRECV " << writ << " " << subset << "\e[0m" << std::endl;
+            Land(subset, endpoint);
+        }
+
+        Stop();
+    });
+}
+
+task<void> Gateway::Shut() noexcept {
+    orc_except({ connection_.close(); })
+    co_await Valve::Shut();
+}
+
+void Gateway::Reap() {
+    if (idle_ == 0)
+        return;
+
+    const auto now(Now());
+    std::vector<std::pair<Lane *, std::unique_lock<std::recursive_mutex>>> idle;
+
+    {
+        const auto locked(locked_());
+        for (auto lane(locked->lanes_.begin()); lane != locked->lanes_.end(); )
+            if (now - lane->second->seen_ < idle_)
+                ++lane;
+            else {
+                idle.emplace_back(lane->second, lane->second->mutex_);
+                lane = locked->lanes_.erase(lane);
+            }
+    }
+
+    for (auto &[lane, landing] : idle) {
+        auto reap(lane->reap_);
+        // the Lane itself is only stopped by its Shut, which follows from this
+        lane->Outer()->Stop("idle");
+        landing.unlock();
+        if (reap != nullptr)
+            reap();
+    }
+}
+
+task<void> Gateway::Send(const Buffer &data, const Socket &socket) {
+    const auto writ(co_await connection_.async_send_to(Sequence(data), {socket.Host(), socket.Port()}, Token()));
+    orc_assert_(writ == data.size(), "orc_assert(" << writ << " {writ} == " << data.size() << " {data.size()})");
+}
+
+}
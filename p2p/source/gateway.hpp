@@ -0,0 +1,106 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_GATEWAY_HPP
+#define ORCHID_GATEWAY_HPP
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include <asio/ip/udp.hpp>
+
+#include "link.hpp"
+#include "locked.hpp"
+#include "socket.hpp"
+
+namespace orc {
+
+class Gateway;
+
+// the part of a Gateway that belongs to a single remote address
+class Lane :
+    public Pump<Buffer>
+{
+    friend class Gateway;
+
+  private:
+    Gateway *const gateway_;
+    const Socket remote_;
+
+    // held while Gateway lands data on this Lane, so Drop can wait for it
+    std::recursive_mutex mutex_;
+    std::atomic<int64_t> seen_;
+
+  public:
+    // called (once whatever it feeds is stopped) when Gateway reaps this Lane for being idle
+    std::function<void ()> reap_;
+
+    Lane(BufferDrain *drain, Gateway *gateway, const Socket &remote);
+
+    task<void> Shut() noexcept override;
+
+    task<void> Send(const Buffer &data) override;
+};
+
+// one bound udp socket shared by many peers; the first datagram from an
+// unknown address asks accept_ to wire a Lane for it (or to drop it), and
+// may be rewritten by accept_ before it is landed on that Lane
+class Gateway :
+    public Valve
+{
+    friend class Lane;
+
+  public:
+    typedef std::function<Lane *(Gateway *, const Socket &, Beam &)> Accept;
+
+  private:
+    const Accept accept_;
+    const unsigned idle_;
+    asio::ip::udp::socket connection_;
+
+    struct Locked_ {
+        std::map<Socket, Lane *> lanes_;
+    }; Locked<Locked_> locked_;
+
+    void Land(const Buffer &data, const Socket &socket);
+    void Drop(const Socket &socket, Lane *lane);
+
+  public:
+    // a Lane that receives nothing for idle seconds (if not 0) is reaped
+    Gateway(Accept accept, unsigned idle = 0);
+
+    Socket Local() const;
+
+    void Open(const Socket &socket);
+    task<void> Shut() noexcept override;
+
+    void Reap();
+
+    task<void> Send(const Buffer &data, const Socket &socket);
+};
+
+}
+
+#endif//ORCHID_GATEWAY_HPP
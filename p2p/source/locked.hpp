@@ -23,6 +23,7 @@
 #define ORCHID_LOCKED_HPP
 
 #include <mutex>
+#include <utility>
 
 namespace orc {
 
@@ -62,6 +63,12 @@ class Locked {
     Locked() = default;
     Locked(const Locked<Locked_> &lock) = delete;
 
+    template <typename... Args_>
+    explicit Locked(std::in_place_t, Args_ &&...args) :
+        locked_(std::forward<Args_>(args)...)
+    {
+    }
+
     Lock<Locked_> operator ()() {
         return {mutex_, locked_};
     }
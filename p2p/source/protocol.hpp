@@ -24,6 +24,7 @@
 #define ORCHID_PROTOCOL_HPP
 
 #include <functional>
+#include <string>
 #include <tuple>
 
 #include "jsonrpc.hpp"
@@ -39,6 +40,9 @@ static uint32_t Stamp_(0xee6d796e);
 static uint32_t Submit_(0xfd90e312);
 static uint32_t Invoice_(0x01959987);
 
+// label of the ordered, reliable data channel used for Submit_ and Invoice_
+static const std::string Control_("orchid.control");
+
 task<void> Scan(const Buffer &data, const std::function<task<void> (const Buffer &)> &code);
 
 template <typename... Args_>
@@ -0,0 +1,103 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_RING_HPP
+#define ORCHID_RING_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace orc {
+
+// a fixed capacity queue with exactly one producer and one consumer thread,
+// neither of which ever takes a lock; a full ring drops (and counts) values
+template <typename Type_, size_t Size_>
+class Ring {
+    static_assert((Size_ & (Size_ - 1)) == 0, "Size_ must be a power of two");
+
+  private:
+    std::array<Type_, Size_> values_;
+
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) std::atomic<size_t> tail_ = 0;
+
+    // both written only by the producer
+    alignas(64) std::atomic<size_t> peak_ = 0;
+    std::atomic<uint64_t> dropped_ = 0;
+
+  public:
+    bool Push(Type_ &&value) {
+        const auto tail(tail_.load(std::memory_order_relaxed));
+        const auto occupancy(tail - head_.load(std::memory_order_acquire));
+        if (occupancy == Size_) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        values_[tail & (Size_ - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+
+        if (occupancy >= peak_.load(std::memory_order_relaxed))
+            peak_.store(occupancy + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // hands up to limit values to code, oldest first, and returns how many
+    template <typename Code_>
+    size_t Drain(Code_ &&code, size_t limit = Size_) {
+        const auto head(head_.load(std::memory_order_relaxed));
+        const auto count(std::min<size_t>(tail_.load(std::memory_order_acquire) - head, limit));
+
+        for (size_t i(0); i != count; ++i) {
+            auto &value(values_[(head + i) & (Size_ - 1)]);
+            code(value);
+            // release whatever the value holds now, not when the slot is reused
+            value = Type_();
+        }
+
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // NB: sequentially consistent, so it can pair with a flag in a wakeup handshake
+    bool Empty() const {
+        return head_.load() == tail_.load();
+    }
+
+    size_t Occupancy() const {
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+
+    size_t Peak() const {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_RING_HPP
@@ -0,0 +1,118 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SIZER_HPP
+#define ORCHID_SIZER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace orc {
+
+// how much a client keeps prepaid, and so how large its tickets are: horizon
+// seconds of its traffic at the price its invoices imply, but never under floor
+// nor (as Client tops up to twice it) over half of risk. a fast link then pays
+// in a few large tickets and a slow one in small frequent ones, and it asks for
+// invoices often enough (an eighth of the prepay apart) to top up before it
+// runs dry. amounts are in invoice units
+class Sizer {
+  public:
+    typedef std::chrono::steady_clock Clock_;
+
+  private:
+    const double floor_;
+    // the most to prepay
+    const double risk_;
+    const double horizon_;
+
+    // bytes/s, averaged over windows of a quarter second
+    Clock_::time_point start_;
+    uint64_t window_ = 0;
+    double rate_ = 0;
+
+    // per byte, from what was spent between invoices
+    bool told_ = false;
+    double balance_ = 0;
+    double credited_ = 0;
+    uint64_t bytes_ = 0;
+    double price_ = 0;
+
+    static double Average(double average, double sample) {
+        return average == 0 ? sample : average * 0.75 + sample * 0.25;
+    }
+
+  public:
+    Sizer(double floor, double risk, double horizon) :
+        floor_(floor),
+        risk_(std::max(floor, risk / 2)),
+        horizon_(horizon)
+    {
+    }
+
+    void Transfer(Clock_::time_point now, size_t size) {
+        if (start_ == Clock_::time_point())
+            start_ = now;
+        window_ += size;
+        bytes_ += size;
+        const auto elapsed(std::chrono::duration<double>(now - start_).count());
+        if (elapsed < 0.25)
+            return;
+        rate_ = Average(rate_, window_ / elapsed);
+        window_ = 0;
+        start_ = now;
+    }
+
+    // a ticket the server acknowledged
+    void Credited(double amount) {
+        credited_ += amount;
+    }
+
+    void Invoice(double balance) {
+        // too few bytes and the invoice's rounding (and packets in flight) dominate
+        if (told_ && bytes_ >= 64 * 1024) {
+            const auto spent(balance_ + credited_ - balance);
+            if (spent > 0)
+                price_ = Average(price_, spent / bytes_);
+        }
+
+        told_ = true;
+        balance_ = balance;
+        credited_ = 0;
+        bytes_ = 0;
+    }
+
+    double Prepay() const {
+        return std::clamp(rate_ * price_ * horizon_, floor_, risk_);
+    }
+
+    // bytes to carry between asking for invoices
+    uint64_t Cadence() const {
+        if (price_ == 0)
+            return 256 * 1024;
+        return std::clamp<uint64_t>(Prepay() / price_ / 8, 64 * 1024, 64 * 1024 * 1024);
+    }
+};
+
+}
+
+#endif//ORCHID_SIZER_HPP
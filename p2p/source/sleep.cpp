@@ -31,4 +31,9 @@ task<void> Sleep(unsigned seconds) noexcept {
     co_await timer.async_wait(Token());
 }
 
+task<void> Sleep(std::chrono::milliseconds duration) noexcept {
+    boost::asio::deadline_timer timer(Context(), boost::posix_time::milliseconds(duration.count()));
+    co_await timer.async_wait(Token());
+}
+
 }
@@ -23,11 +23,14 @@
 #ifndef ORCHID_SLEEP_HPP
 #define ORCHID_SLEEP_HPP
 
+#include <chrono>
+
 #include "task.hpp"
 
 namespace orc {
 
 task<void> Sleep(unsigned seconds) noexcept;
+task<void> Sleep(std::chrono::milliseconds duration) noexcept;
 
 }
 
@@ -0,0 +1,158 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_SNAPSHOT_HPP
+#define ORCHID_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "error.hpp"
+
+namespace orc {
+
+// hazard pointers: each thread says which versions it is reading in slots of
+// its own (a store to its own cache line), and a version is only freed once
+// no slot has it; a thread's record is kept (empty) after the thread exits
+class Hazards {
+  public:
+    static const unsigned Slots_ = 4;
+
+    struct alignas(64) Record {
+        std::atomic<const void *> slots_[Slots_] = {};
+        Record *next_ = nullptr;
+    };
+
+  private:
+    static inline std::atomic<Record *> records_ = nullptr;
+
+  public:
+    static Record &Local() {
+        thread_local Record *const record([]() {
+            const auto record(new Record());
+            record->next_ = records_.load();
+            while (!records_.compare_exchange_weak(record->next_, record));
+            return record;
+        }());
+        return *record;
+    }
+
+    static bool Used(const void *pointer) {
+        for (auto record(records_.load()); record != nullptr; record = record->next_)
+            for (const auto &slot : record->slots_)
+                if (slot.load() == pointer)
+                    return true;
+        return false;
+    }
+};
+
+// an immutable value that readers get with an atomic load (and publishing it in
+// a hazard slot), never taking a lock or writing to a shared cache line; writers
+// take turns, and free what they replaced once no reader has it. a Reader must
+// not be held across a co_await, as its slot belongs to the thread it was on
+template <typename Type_>
+class Snapshot {
+  public:
+    class Reader {
+      private:
+        std::atomic<const void *> &slot_;
+        const Type_ *const value_;
+
+      public:
+        Reader(std::atomic<const void *> &slot, const Type_ *value) :
+            slot_(slot),
+            value_(value)
+        {
+        }
+
+        Reader(const Reader &reader) = delete;
+
+        ~Reader() {
+            slot_.store(nullptr, std::memory_order_release);
+        }
+
+        const Type_ *operator ->() const {
+            return value_;
+        }
+
+        const Type_ &operator *() const {
+            return *value_;
+        }
+    };
+
+  private:
+    std::atomic<const Type_ *> current_;
+
+    std::mutex mutex_;
+    std::vector<const Type_ *> retired_;
+
+  public:
+    Snapshot(Type_ value = Type_()) :
+        current_(new Type_(std::move(value)))
+    {
+    }
+
+    Snapshot(const Snapshot<Type_> &snapshot) = delete;
+
+    ~Snapshot() {
+        delete current_.load();
+        for (const auto value : retired_)
+            delete value;
+    }
+
+    Reader operator ()() const {
+        auto &slots(Hazards::Local().slots_);
+        const auto slot(std::find_if(std::begin(slots), std::end(slots), [](const auto &slot) {
+            return slot.load(std::memory_order_relaxed) == nullptr;
+        }));
+        orc_insist(slot != std::end(slots));
+
+        // the version is only safe once it is still current after it is published
+        auto value(current_.load());
+        for (;;) {
+            slot->store(value);
+            const auto again(current_.load());
+            if (again == value)
+                return Reader(*slot, value);
+            value = again;
+        }
+    }
+
+    void operator =(Type_ value) {
+        const auto next(new Type_(std::move(value)));
+        std::unique_lock<std::mutex> lock(mutex_);
+        retired_.push_back(current_.exchange(next));
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [](const Type_ *value) {
+            if (Hazards::Used(value))
+                return false;
+            delete value;
+            return true;
+        }), retired_.end());
+    }
+};
+
+}
+
+#endif//ORCHID_SNAPSHOT_HPP
@@ -20,7 +20,9 @@
 /* }}} */
 
 
+#include <condition_variable>
 #include <iostream>
+#include <map>
 #include <mutex>
 
 #include <rtc_base/thread.h>
@@ -36,12 +38,42 @@ namespace orc {
 
 class Pool {
   private:
+    // an ordered pool takes all that is stacked at once, and runs it oldest first
+    const bool ordered_;
+
     std::atomic<Stacked *> stack_ = nullptr;
+    // set (under mutex_) by Run before it checks stack_ one last time and
+    // waits, so Stack only has to lock and notify while this might sleep
+    std::atomic<bool> sleeping_ = false;
     std::mutex mutex_;
     std::condition_variable ready_;
 
   public:
+    Pool(bool ordered = false) :
+        ordered_(ordered)
+    {
+    }
+
     void Drain() {
+        if (ordered_)
+            for (;;) {
+                auto stacked(stack_.exchange(nullptr));
+                if (stacked == nullptr)
+                    return;
+                Stacked *queue(nullptr);
+                while (stacked != nullptr) {
+                    const auto next(stacked->next_);
+                    stacked->next_ = queue;
+                    queue = stacked;
+                    stacked = next;
+                }
+                while (queue != nullptr) {
+                    const auto next(queue->next_);
+                    queue->code_.resume();
+                    queue = next;
+                }
+            }
+
         for (;;) {
             auto stacked(stack_.load()); do {
                 if (stacked == nullptr)
@@ -55,7 +87,9 @@ class Pool {
         for (;;) {
             Drain();
             std::unique_lock<std::mutex> lock(mutex_);
-            ready_.wait(lock);
+            sleeping_ = true;
+            ready_.wait(lock, [&]() { return stack_.load() != nullptr; });
+            sleeping_ = false;
         }
     }
 
@@ -66,6 +100,12 @@ class Pool {
             stacked->next_ = stack;
         } while (!stack_.compare_exchange_strong(stack, stacked));
 
+        // both sides are sequentially consistent: either this sees sleeping_, or
+        // Run (having set it after this pushed) sees the stack and doesn't wait;
+        // the lock is so the notify can't fall between Run's check and its wait
+        if (!sleeping_.load())
+            return;
+        { std::unique_lock<std::mutex> lock(mutex_); }
         ready_.notify_one();
     }
 };
@@ -84,4 +124,21 @@ Scheduled Schedule() {
     return {&pool};
 }
 
+Pool *Worker(unsigned index) {
+    static std::mutex mutex;
+    static std::map<unsigned, Pool *> workers;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto &worker(workers[index]);
+    if (worker == nullptr) {
+        // like the shared pool, this is never torn down
+        worker = new Pool(true);
+        std::thread([worker]() {
+            rtc::ThreadManager::Instance()->WrapCurrentThread();
+            worker->Run();
+        }).detach();
+    }
+    return worker;
+}
+
 }
@@ -64,6 +64,10 @@ class Scheduled :
 
 Scheduled Schedule();
 
+// a thread of its own for each index (made the first time it is asked for); what is
+// scheduled on it (with co_await Scheduled(worker)) runs in the order it came in
+Pool *Worker(unsigned index);
+
 template <typename Type_>
 Type_ Wait(task<Type_> code) {
     // XXX: centralize Schedule?
@@ -0,0 +1,293 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <netinet/in.h>
+
+#include <boost/endian/conversion.hpp>
+
+#include "sleep.hpp"
+#include "utp.hpp"
+
+namespace orc {
+
+const sockaddr *Utp::Address() {
+    // libutp keys sockets by address, but each Utp has a context (and a peer) of its own
+    static const sockaddr_in address([]() {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = boost::endian::native_to_big(uint16_t(1));
+        return address;
+    }());
+
+    return reinterpret_cast<const sockaddr *>(&address);
+}
+
+uint64 Utp::Callback(utp_callback_arguments *arguments) {
+    // these are all called from inside libutp, with locked_ held by whoever called it
+    auto &locked(*static_cast<Locked_ *>(utp_context_get_userdata(arguments->context)));
+
+    switch (arguments->callback_type) {
+        case UTP_ON_FIREWALL:
+            return locked.server_ && locked.socket_ == nullptr ? 0 : 1;
+
+        case UTP_ON_ACCEPT:
+            locked.socket_ = arguments->socket;
+            locked.connected_ = true;
+            break;
+
+        case UTP_ON_STATE_CHANGE:
+            switch (arguments->state) {
+                case UTP_STATE_CONNECT:
+                    locked.connected_ = true;
+                    break;
+                case UTP_STATE_EOF:
+                    locked.closed_ = true;
+                    break;
+                case UTP_STATE_DESTROYING:
+                    if (locked.socket_ == arguments->socket)
+                        locked.socket_ = nullptr;
+                    locked.closed_ = true;
+                    break;
+            }
+            break;
+
+        case UTP_ON_ERROR:
+            locked.error_ = "utp error " + std::to_string(arguments->error_code);
+            locked.closed_ = true;
+            break;
+
+        case UTP_ON_READ: {
+            auto &input(locked.input_);
+            input.append(reinterpret_cast<const char *>(arguments->buf), arguments->len);
+
+            size_t offset(0);
+            while (input.size() - offset >= 2) {
+                const size_t size(uint8_t(input[offset]) << 8 | uint8_t(input[offset + 1]));
+                if (input.size() - offset - 2 < size)
+                    break;
+                locked.frames_.emplace_back(input.data() + offset + 2, size);
+                offset += 2 + size;
+            }
+
+            input.erase(0, offset);
+            utp_read_drained(arguments->socket);
+        } break;
+
+        case UTP_SENDTO:
+            locked.output_.emplace_back(arguments->buf, arguments->len);
+            break;
+    }
+
+    return 0;
+}
+
+void Utp::Write(Locked_ &locked) {
+    if (!locked.connected_ || locked.socket_ == nullptr)
+        return;
+
+    while (!locked.writes_.empty()) {
+        auto &write(locked.writes_.front());
+        const auto writ(utp_write(locked.socket_, write.data() + locked.offset_, write.size() - locked.offset_));
+        if (writ <= 0)
+            break;
+        locked.offset_ += writ;
+        locked.queued_ -= writ;
+        if (locked.offset_ == write.size()) {
+            locked.writes_.pop_front();
+            locked.offset_ = 0;
+        }
+    }
+}
+
+void Utp::Flush(std::vector<Beam> output) {
+    for (auto &datagram : output)
+        nest_.Hatch([&]() noexcept { return [this, datagram = std::move(datagram)]() -> task<void> {
+            co_return co_await Inner()->Send(datagram); }; });
+}
+
+void Utp::Fail(const std::string &error) noexcept {
+    {
+        const auto locked(locked_());
+        if (locked->stopped_)
+            return;
+        locked->stopped_ = true;
+        locked->error_ = error;
+    }
+
+    connected_();
+    Pump::Stop(error);
+}
+
+void Utp::Land(const Buffer &data) {
+    std::vector<Beam> output;
+    std::vector<Beam> frames;
+    bool connected;
+    bool closed;
+    std::string error;
+
+    {
+        const auto locked(locked_());
+        if (locked->stopped_)
+            return;
+        const auto context(locked->context_.get());
+
+        const auto before(locked->connected_);
+        const Beam beam(data);
+        utp_process_udp(context, beam.data(), beam.size(), Address(), sizeof(sockaddr_in));
+        utp_issue_deferred_acks(context);
+        Write(*locked);
+
+        connected = !before && locked->connected_;
+        closed = locked->closed_;
+        error = locked->error_;
+        output.swap(locked->output_);
+        frames.swap(locked->frames_);
+    }
+
+    Flush(std::move(output));
+
+    if (connected)
+        connected_();
+    for (const auto &frame : frames)
+        Pump::Land(frame);
+
+    if (closed)
+        Fail(error);
+}
+
+void Utp::Stop(const std::string &error) noexcept {
+    Fail(error);
+}
+
+Utp::Utp(BufferDrain *drain, bool server) :
+    Pump(drain)
+{
+    const auto locked(locked_());
+    const auto context(locked->context_.get());
+    orc_assert(context != nullptr);
+
+    locked->server_ = server;
+    utp_context_set_userdata(context, &*locked);
+
+    for (const auto callback : {UTP_ON_FIREWALL, UTP_ON_ACCEPT, UTP_ON_STATE_CHANGE, UTP_ON_ERROR, UTP_ON_READ, UTP_SENDTO})
+        utp_set_callback(context, callback, &Callback);
+}
+
+size_t Utp::Queued() {
+    return locked_()->queued_;
+}
+
+task<void> Utp::Open() {
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        if (!locked->server_) {
+            locked->socket_ = utp_create_socket(locked->context_.get());
+            orc_assert(locked->socket_ != nullptr);
+            orc_assert(utp_connect(locked->socket_, Address(), sizeof(sockaddr_in)) == 0);
+        }
+        output.swap(locked->output_);
+    }
+
+    for (const auto &datagram : output)
+        co_await Inner()->Send(datagram);
+
+    nest_.Hatch([&]() noexcept { return [this]() -> task<void> {
+        for (;;) {
+            // libutp wants this twice a second, for retransmissions and its own keepalives
+            co_await Sleep(std::chrono::milliseconds(500));
+
+            std::vector<Beam> output;
+            bool closed;
+            std::string error;
+
+            {
+                const auto locked(locked_());
+                if (locked->stopped_)
+                    break;
+                utp_check_timeouts(locked->context_.get());
+                Write(*locked);
+                closed = locked->closed_;
+                error = locked->error_;
+                output.swap(locked->output_);
+            }
+
+            if (closed) {
+                Fail(error);
+                break;
+            }
+
+            for (const auto &datagram : output)
+                co_await Inner()->Send(datagram);
+        }
+    }; });
+
+    co_await connected_.Wait();
+
+    const auto locked(locked_());
+    orc_assert_(!locked->stopped_, "utp " << (locked->error_.empty() ? "closed" : locked->error_));
+}
+
+task<void> Utp::Shut() noexcept {
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        if (locked->socket_ != nullptr && !locked->stopped_)
+            utp_close(locked->socket_);
+        output.swap(locked->output_);
+    }
+
+    for (const auto &datagram : output)
+        orc_ignore({ co_await Inner()->Send(datagram); });
+
+    Fail(std::string());
+
+    co_await nest_.Shut();
+    co_await Inner()->Shut();
+    co_await Pump::Shut();
+}
+
+task<void> Utp::Send(const Buffer &data) {
+    const auto size(data.size());
+    orc_assert(size <= 0xffff);
+
+    std::vector<Beam> output;
+
+    {
+        const auto locked(locked_());
+        orc_assert(!locked->stopped_);
+        if (locked->queued_ + size + 2 > Queue_)
+            co_return;
+        locked->writes_.emplace_back(Tie(Number<uint16_t>(size), data));
+        locked->queued_ += size + 2;
+        Write(*locked);
+        output.swap(locked->output_);
+    }
+
+    for (const auto &datagram : output)
+        co_await Inner()->Send(datagram);
+}
+
+}
@@ -0,0 +1,103 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_UTP_HPP
+#define ORCHID_UTP_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <utp.h>
+
+#include "event.hpp"
+#include "link.hpp"
+#include "locked.hpp"
+#include "nest.hpp"
+
+namespace orc {
+
+// a utp (ledbat) connection wrapped around a udp link: packets are framed onto
+// its byte stream, and it backs off as soon as it sees queueing delay build up
+
+class Utp :
+    public Pump<Buffer>,
+    public BufferDrain
+{
+  private:
+    struct Locked_ {
+        bool server_ = false;
+        std::unique_ptr<utp_context, decltype(&utp_destroy)> context_{utp_init(2), &utp_destroy};
+        utp_socket *socket_ = nullptr;
+
+        // datagrams from UTP_SENDTO since the last Flush
+        std::vector<Beam> output_;
+
+        std::string input_;
+        std::vector<Beam> frames_;
+
+        std::deque<Beam> writes_;
+        size_t offset_ = 0;
+        size_t queued_ = 0;
+
+        bool connected_ = false;
+        bool closed_ = false;
+        bool stopped_ = false;
+        std::string error_;
+    }; Locked<Locked_> locked_;
+
+    Event connected_;
+    Nest nest_;
+
+    static const sockaddr *Address();
+    static uint64 Callback(utp_callback_arguments *arguments);
+
+    static void Write(Locked_ &locked);
+
+    void Flush(std::vector<Beam> output);
+    void Fail(const std::string &error) noexcept;
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override;
+    void Stop(const std::string &error) noexcept override;
+
+  public:
+    // packets beyond this many queued bytes are dropped, as a router would
+    static const size_t Queue_ = 256 * 1024;
+
+    Utp(BufferDrain *drain, bool server);
+
+    size_t Queued();
+
+    task<void> Open();
+    task<void> Shut() noexcept override;
+
+    task<void> Send(const Buffer &data) override;
+};
+
+}
+
+#endif//ORCHID_UTP_HPP
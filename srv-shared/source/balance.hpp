@@ -0,0 +1,77 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_BALANCE_HPP
+#define ORCHID_BALANCE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <tuple>
+
+namespace orc {
+
+// balances are fixed point, in units of 1/65536 of the price of one byte: a
+// packet costs exactly its size << Fraction_, and a whole session's balance
+// (about 140TB either way) fits in a lock-free std::atomic<int64_t>
+typedef int64_t Fixed;
+static const unsigned Fraction_ = 16;
+
+class Balance {
+  private:
+    std::atomic<Fixed> value_ = 0;
+    std::atomic<uint64_t> serial_ = 0;
+
+  public:
+    static Fixed Cost(size_t size) {
+        return Fixed(size) << Fraction_;
+    }
+
+    // unless forced, refuses (returning false) to go below zero; after is the new balance
+    bool Debit(Fixed amount, bool force, Fixed &after) {
+        auto value(value_.load(std::memory_order_relaxed));
+        do if (!force && value < amount)
+            return false;
+        while (!value_.compare_exchange_weak(value, value - amount, std::memory_order_relaxed));
+        serial_.fetch_add(1, std::memory_order_relaxed);
+        after = value - amount;
+        return true;
+    }
+
+    Fixed Credit(Fixed amount) {
+        const auto value(value_.fetch_add(amount, std::memory_order_relaxed) + amount);
+        serial_.fetch_add(1, std::memory_order_relaxed);
+        return value;
+    }
+
+    // NB: not a snapshot; clients only use the serial to discard stale invoices
+    std::tuple<uint64_t, Fixed> Read() const {
+        const auto serial(serial_.load(std::memory_order_relaxed));
+        return {serial, value_.load(std::memory_order_relaxed)};
+    }
+};
+
+static_assert(std::atomic<Fixed>::is_always_lock_free);
+
+}
+
+#endif//ORCHID_BALANCE_HPP
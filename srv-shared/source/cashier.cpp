@@ -20,12 +20,15 @@
 /* }}} */
 
 
+#include <limits>
+
 #include <boost/multiprecision/cpp_bin_float.hpp>
 
 #include "baton.hpp"
 #include "cashier.hpp"
 #include "duplex.hpp"
 #include "json.hpp"
+#include "log.hpp"
 #include "sleep.hpp"
 #include "structured.hpp"
 
@@ -39,18 +42,19 @@ static const auto Update_(Hash("Update(address,address,uint128,uint128,uint256)"
 static const auto Bound_(Hash("Update(address,address)"));
 
 task<void> Cashier::Update() {
-    auto eth(co_await Price("ETH", currency_, Ten18));
+    auto eth(co_await Price(oracle_, "ETH", currency_, Ten18));
     orc_assert(eth != 0);
 
-    auto oxt(co_await Price("OXT", currency_, Ten18));
+    auto oxt(co_await Price(oracle_, "OXT", currency_, Ten18));
     if (oxt == 0)
         oxt = eth / 300;
 
     //auto predict(Parse(co_await Request("GET", {"https", "ethgasstation.info", "443", "/json/predictTable.json"}, {}, {})));
 
-    const auto prices(prices_());
-    prices->eth_ = std::move(eth);
-    prices->oxt_ = std::move(oxt);
+    const Float unit(1 << Fraction_);
+    auto convert(price_ / unit / oxt * Two128);
+    auto credit(oxt / Two128 / price_ * unit);
+    prices_ = Prices_{std::move(eth), std::move(oxt), std::move(convert), std::move(credit)};
 }
 
 task<void> Cashier::Look(const Address &signer, const Address &funder, const std::string &combined) {
@@ -106,13 +110,7 @@ void Cashier::Land(Json::Value data) {
             const auto [amount, escrow, unlock] = Coded<std::tuple<uint128_t, uint128_t, uint256_t>>::Decode(window);
             window.Stop();
 
-            {
-                const auto locked(pot->locked_());
-                locked->amount_ = amount;
-                locked->escrow_ = escrow;
-                locked->unlock_ = unlock;
-            }
-
+            pot->state_ = Pot::State{amount, escrow, unlock};
             (*pot)();
         } else if (event == Bound_) {
             std::cout << "BIND " << data << std::endl;
@@ -139,13 +137,7 @@ void Cashier::Land(Json::Value data) {
                     return pot->second;
                 }());
 
-                {
-                    const auto locked(pot->locked_());
-                    locked->amount_ = amount;
-                    locked->escrow_ = escrow;
-                    locked->unlock_ = unlock;
-                }
-
+                pot->state_ = Pot::State{amount, escrow, unlock};
                 (*pot)();
             } break;
 
@@ -159,18 +151,21 @@ void Cashier::Stop(const std::string &error) noexcept {
     orc_insist_(false, error);
 }
 
-Cashier::Cashier(const S<Origin> &origin, Endpoint endpoint, Locator locator, const Float &price, std::string currency, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient) :
+Cashier::Cashier(const S<Origin> &origin, Endpoint endpoint, Locator locator, const Float &price, std::string currency, Locator oracle, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient, const std::string &journal) :
     endpoint_(std::move(endpoint)),
 
     price_(price),
     currency_(std::move(currency)),
+    oracle_(std::move(oracle)),
 
     personal_(personal),
     password_(std::move(password)),
 
     lottery_(lottery),
     chain_(chain),
-    recipient_(recipient)
+    recipient_(recipient),
+
+    journal_(std::make_unique<Journal>(journal))
 {
     Wait([&]() -> task<void> {
         auto duplex(std::make_unique<Duplex>(origin));
@@ -191,20 +186,106 @@ Cashier::Cashier(const S<Origin> &origin, Endpoint endpoint, Locator locator, co
             orc_ignore({ co_await Update(); });
         }
     });
+
+    // tickets that were won before a restart but never sent
+    for (const auto &[id, entry] : journal_->Pending()) {
+        const auto [gas, data] = Take<uint256_t, Window>(entry);
+        Queue(id, gas, Beam(data));
+    }
+}
+
+void Cashier::Queue(std::optional<Journal::Id> id, const uint256_t &gas, Beam data) {
+    {
+        const auto redeeming(redeeming_());
+        redeeming->queue_.try_emplace(redeeming->serial_++, Redemption_{id, gas, std::move(data)});
+        if (redeeming->running_)
+            return;
+        redeeming->running_ = true;
+    }
+
+    Spawn([this]() noexcept -> task<void> {
+        co_await Redeem();
+    });
 }
 
-Float Cashier::Bill(size_t size) const {
-    return price_ * size;
+// one at a time, so a slow RPC node doesn't pile up coroutines
+task<void> Cashier::Redeem() {
+    uint64_t next(0);
+    unsigned delay(5);
+
+    for (;;) {
+        std::optional<Journal::Id> id;
+        uint256_t gas;
+        Beam data;
+
+        {
+            const auto redeeming(redeeming_());
+            auto &queue(redeeming->queue_);
+            if (queue.empty()) {
+                redeeming->running_ = false;
+                co_return;
+            }
+
+            auto redemption(queue.lower_bound(next));
+            if (redemption == queue.end())
+                redemption = queue.begin();
+            next = redemption->first;
+
+            id = redemption->second.id_;
+            gas = redemption->second.gas_;
+            data = Beam(redemption->second.data_);
+        }
+
+        std::string error;
+        try {
+            co_await Transact(gas, data);
+        } catch (const std::exception &failure) {
+            error = failure.what();
+            if (error.empty())
+                error = "unknown error";
+        }
+
+        if (!error.empty()) {
+            // a revert is the lottery refusing it (as claimed or expired), and it would just refuse it again
+            const auto terminal(error.find("revert") != std::string::npos);
+            const auto failures(++redeeming_()->queue_.at(next).failures_);
+            if (!terminal && failures != Attempts_) {
+                // move on to the others before retrying this one, backing off
+                ++next;
+                co_await Sleep(delay);
+                delay = std::min(delay * 2, 300u);
+                continue;
+            }
+
+            Log() << "giving up redeeming " << data << " (with " << gas << " gas) after " << failures << " failure(s): " << error << std::endl;
+        } else
+            delay = 5;
+
+        redeeming_()->queue_.erase(next);
+        if (id)
+            orc_ignore({ co_await journal_->Settle(*id); });
+    }
+}
+
+task<void> Cashier::Transact(const uint256_t &gas, const Buffer &data) {
+    co_await endpoint_("personal_sendTransaction", {Map{
+        {"from", personal_},
+        {"to", lottery_},
+        {"gas", gas},
+        {"gasPrice", 10*Gwei},
+        {"data", data},
+    }, password_});
 }
 
-checked_int256_t Cashier::Convert(const Float &balance) const {
-    const auto oxt(prices_()->oxt_);
-    return checked_int256_t(balance / oxt * Two128);
+checked_int256_t Cashier::Convert(Fixed balance) const {
+    return checked_int256_t(Float(balance) * prices_()->convert_);
 }
 
-Float Cashier::Credit(const uint256_t &now, const uint256_t &start, const uint256_t &until, const uint256_t &amount, const uint256_t &gas) const {
-    const auto oxt(prices_()->oxt_);
-    return Float(amount) * oxt / Two128;
+Fixed Cashier::Credit(const uint256_t &now, const uint256_t &start, const uint256_t &until, const uint256_t &amount, const uint256_t &gas) const {
+    // rounded down, so a client is never credited for a fraction it didn't pay
+    const auto credit(floor(Float(amount) * prices_()->credit_));
+    static const Float Limit(std::numeric_limits<Fixed>::max() >> 2);
+    return Fixed(credit < Limit ? credit : Limit);
 }
 
 task<void> Cashier::Check(const Address &signer, const Address &funder, const uint128_t &amount, const Address &recipient, const Buffer &receipt) {
@@ -232,10 +313,10 @@ task<void> Cashier::Check(const Address &signer, const Address &funder, const ui
 
     co_await pot->Wait();
 
-    const auto locked(pot->locked_());
-    orc_assert(amount < locked->amount_);
-    orc_assert(amount < locked->escrow_ / 2);
-    orc_assert(locked->unlock_ == 0);
+    const auto state(pot->state_());
+    orc_assert(amount < state->amount_);
+    orc_assert(amount < state->escrow_ / 2);
+    orc_assert(state->unlock_ == 0);
 }
 
 }
@@ -23,15 +23,19 @@
 #ifndef ORCHID_CASHIER_HPP
 #define ORCHID_CASHIER_HPP
 
+#include <optional>
 #include <string>
 
+#include "balance.hpp"
 #include "coinbase.hpp"
 #include "endpoint.hpp"
 #include "event.hpp"
+#include "journal.hpp"
 #include "local.hpp"
 #include "locked.hpp"
 #include "locator.hpp"
 #include "sleep.hpp"
+#include "snapshot.hpp"
 #include "station.hpp"
 
 namespace orc {
@@ -45,11 +49,11 @@ static std::string Combine(const Address &signer, const Address &funder) {
 struct Pot :
     public Event
 {
-    struct Locked_ {
+    struct State {
         uint128_t amount_ = 0;
         uint128_t escrow_ = 0;
         uint256_t unlock_ = 0;
-    }; Locked<Locked_> locked_;
+    }; Snapshot<State> state_;
 };
 
 class Cashier :
@@ -60,6 +64,7 @@ class Cashier :
 
     const Float price_;
     const std::string currency_;
+    const Locator oracle_;
 
     const Address personal_;
     const std::string password_;
@@ -68,10 +73,14 @@ class Cashier :
     const uint256_t chain_;
     const Address recipient_;
 
+    // replaced by Update; Convert and Credit never wait on it
     struct Prices_ {
         Float eth_ = 0;
         Float oxt_ = 0;
-    }; Locked<Prices_> prices_;
+        // from a Fixed balance to an invoiced amount, and from a ticket back
+        Float convert_ = 0;
+        Float credit_ = 0;
+    }; Snapshot<Prices_> prices_;
 
     U<Station> station_;
 
@@ -80,15 +89,38 @@ class Cashier :
         std::map<Identity, S<Pot>> pots_;
     }; Locked<Cache_> cache_;
 
+    // winning tickets are only redeemed once they are on disk
+    const U<Journal> journal_;
+
+    // a redemption is given up after this many failures, or as soon as the lottery refuses it
+    static const unsigned Attempts_ = 16;
+
+    struct Redemption_ {
+        std::optional<Journal::Id> id_;
+        uint256_t gas_;
+        Beam data_;
+        unsigned failures_ = 0;
+    };
+
+    struct Redeeming_ {
+        uint64_t serial_ = 0;
+        std::map<uint64_t, Redemption_> queue_;
+        bool running_ = false;
+    }; Locked<Redeeming_> redeeming_;
+
     task<void> Update();
     task<void> Look(const Address &signer, const Address &funder, const std::string &combined);
 
+    void Queue(std::optional<Journal::Id> id, const uint256_t &gas, Beam data);
+    task<void> Redeem();
+    task<void> Transact(const uint256_t &gas, const Buffer &data);
+
   protected:
     void Land(Json::Value data) override;
     void Stop(const std::string &error) noexcept override;
 
   public:
-    Cashier(const S<Origin> &origin, Endpoint endpoint, Locator locator, const Float &price, std::string currency, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient);
+    Cashier(const S<Origin> &origin, Endpoint endpoint, Locator locator, const Float &price, std::string currency, Locator oracle, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient, const std::string &journal);
 
     virtual ~Cashier() = default;
 
@@ -96,25 +128,18 @@ class Cashier :
         return std::tie(lottery_, chain_, recipient_);
     }
 
-    Float Bill(size_t size) const;
-    checked_int256_t Convert(const Float &balance) const;
+    checked_int256_t Convert(Fixed balance) const;
 
-    Float Credit(const uint256_t &now, const uint256_t &start, const uint256_t &until, const uint256_t &amount, const uint256_t &gas) const;
+    Fixed Credit(const uint256_t &now, const uint256_t &start, const uint256_t &until, const uint256_t &amount, const uint256_t &gas) const;
     task<void> Check(const Address &signer, const Address &funder, const uint128_t &amount, const Address &recipient, const Buffer &receipt);
 
     template <typename Selector_, typename... Args_>
     void Send(Selector_ &selector, const uint256_t &gas, Args_ &&...args) {
-        Spawn([=]() mutable noexcept -> task<void> {
-            for (;;) {
-                orc_ignore({
-                    co_await selector.Send(endpoint_, personal_, password_, lottery_, gas, 10*Gwei, std::forward<Args_>(args)...);
-                    break;
-                });
-
-                // XXX: I should dump these to a disk queue as they are worth "real money"
-                // XXX: that same disk queue should maybe be in charge of the old tickets?
-                co_await Sleep(5);
-            }
+        Spawn([this, gas, data = selector.Encode(std::forward<Args_>(args)...)]() mutable noexcept -> task<void> {
+            std::optional<Journal::Id> id;
+            // if the disk fails, it is still worth trying to redeem it from memory
+            orc_ignore({ id = co_await journal_->Append(Tie(Number<uint256_t>(gas), data)); });
+            Queue(id, gas, std::move(data));
         });
     }
 };
@@ -20,6 +20,9 @@
 /* }}} */
 
 
+#include <exception>
+#include <set>
+
 #include "egress.hpp"
 #include "forge.hpp"
 
@@ -35,7 +38,7 @@ void Egress::Land(const Buffer &data) {
         case openvpn::IPCommon::TCP: {
             auto &tcp(span.cast<openvpn::TCPHeader>(length));
             const Three destination(openvpn::IPCommon::TCP, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(tcp.dest));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, tcp.flags)) {
                 const auto &[replace, translator] = *translation;
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, replace.Host());
                 Forge(tcp, &openvpn::TCPHeader::dest, replace.Port());
@@ -46,7 +49,7 @@ void Egress::Land(const Buffer &data) {
         case openvpn::IPCommon::UDP: {
             auto &udp(span.cast<openvpn::UDPHeader>(length));
             const Three destination(openvpn::IPCommon::UDP, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(udp.dest));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, 0)) {
                 const auto &[replace, translator] = *translation;
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, replace.Host());
                 Forge(udp, &openvpn::UDPHeader::dest, replace.Port());
@@ -58,7 +61,7 @@ void Egress::Land(const Buffer &data) {
             auto &icmp(span.cast<openvpn::ICMPv4>());
             // NOLINTNEXTLINE (cppcoreguidelines-pro-type-union-access)
             const Three destination(openvpn::IPCommon::ICMPv4, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(icmp.id));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, 0)) {
                 const auto &[replace, translator] = *translation;
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, replace.Host());
                 Forge(icmp, &openvpn::ICMPv4::id, replace.Port());
@@ -69,43 +72,278 @@ void Egress::Land(const Buffer &data) {
 }
 
 void Egress::Stop(const std::string &error) noexcept {
-    const auto locked(locked_());
-    for (auto translation : locked->translations_)
-        translation.second.translator_.Stop(error);
+    std::set<Translator *> translators;
+    inbound_.Each([&](uint32_t, const Inside_ &inside) {
+        translators.insert(inside.translator_);
+    });
+    for (const auto translator : translators)
+        translator->Stop(error);
+}
+
+Egress::Egress(uint32_t local) :
+    Egress(local, Timeouts())
+{
+}
+
+Egress::Egress(uint32_t local, const Timeouts &timeouts, unsigned shard, unsigned shards) :
+    local_(local),
+    ephemeral_base_(4096 + (65536 - 4096) / shards * shard),
+    ephemeral_end_(shard + 1 == shards ? 65536 : ephemeral_base_ + (65536 - 4096) / shards),
+    worker_(shards == 1 ? nullptr : orc::Worker(shard)),
+    timeouts_(timeouts),
+    inbound_(ephemeral_end_ - ephemeral_base_),
+    outbound_(ephemeral_end_ - ephemeral_base_),
+    icmp_(std::in_place, ephemeral_base_, std::chrono::seconds(timeouts.cooldown_), ephemeral_end_),
+    tcp_(std::in_place, ephemeral_base_, std::chrono::seconds(timeouts.cooldown_), ephemeral_end_),
+    udp_(std::in_place, ephemeral_base_, std::chrono::seconds(timeouts.cooldown_), ephemeral_end_),
+    epoch_(std::chrono::steady_clock::now()),
+    wheel_(std::in_place, 1024)
+{
+}
+
+Locked<Ephemeral> &Egress::Ports(uint8_t protocol) {
+    switch (protocol) {
+        case openvpn::IPCommon::ICMPv4:
+            return icmp_;
+        case openvpn::IPCommon::TCP:
+            return tcp_;
+        case openvpn::IPCommon::UDP:
+            return udp_;
+        default:
+            orc_throw("no ports for protocol " << unsigned(protocol));
+    }
+}
+
+unsigned Egress::Timeout(uint8_t protocol, State_ state) const {
+    switch (protocol) {
+        case openvpn::IPCommon::ICMPv4:
+            return timeouts_.icmp_;
+        case openvpn::IPCommon::UDP:
+            return timeouts_.udp_;
+        default: switch (state) {
+            case Opening:
+                return timeouts_.opening_;
+            case Established:
+                return timeouts_.established_;
+            default:
+                return timeouts_.closing_;
+        }
+    }
+}
+
+// moves a tcp translation along by the flags of a packet; true if that closed it
+bool Egress::Advance(Inside_ &inside, uint8_t flags, bool inbound) {
+    if ((flags & (openvpn::TCPHeader::FLAG_FIN | openvpn::TCPHeader::FLAG_RST)) != 0) {
+        if (inside.state_ == Closing)
+            return false;
+        inside.state_ = Closing;
+        return true;
+    }
+
+    // the other end answered
+    if (inbound && inside.state_ == Opening)
+        inside.state_ = Established;
+    return false;
+}
+
+void Egress::Schedule(uint32_t key, uint32_t stamp, uint32_t due) {
+    wheel_()->Add(due, {key, stamp});
 }
 
-std::optional<std::pair<const Socket, Translator &>> Egress::Find(const Three &target) {
-    const auto locked(locked_());
-    const auto translation_iter(locked->translations_.find(target));
-    if (translation_iter == locked->translations_.end())
+std::optional<std::pair<const Socket, Translator &>> Egress::Find(const Three &target, uint8_t flags) {
+    if (!(target.Host() == Host(local_)))
         return {};
-    locked->lru_.erase(translation_iter->second.lru_iter_);
-    locked->lru_.push_back(translation_iter->first);
-    translation_iter->second.lru_iter_ = std::prev(locked->lru_.end());
-    return {{translation_iter->second.socket_, std::ref(translation_iter->second.translator_)}};
-}
-
-Socket Egress::Translate(Translator &translator, const Three &three) {
-    const auto locked(locked_());
-    auto ephemeral(ephemeral_base_ + locked->translations_.size());
-    if (ephemeral >= 65535) {
-        auto old_three(*locked->lru_.begin());
-        auto old_translation_iter(locked->translations_.find(old_three));
-        orc_insist(old_translation_iter != locked->translations_.end());
-        ephemeral = old_three.Port();
-        auto old_translation(old_translation_iter->second);
-        old_translation.translator_.Remove(Three(old_three.Protocol(), old_translation.socket_));
-        locked->translations_.erase(old_translation_iter);
-        locked->lru_.pop_front();
+    const auto key(Inbound(target.Protocol(), target.Port()));
+    const auto tick(tick_.load(std::memory_order_relaxed));
+
+    Inside_ inside;
+    bool closed(false);
+    if (!inbound_.Find(key, [&](Inside_ &value) {
+        value.seen_ = tick;
+        if (target.Protocol() == openvpn::IPCommon::TCP)
+            closed = Advance(value, flags, true);
+        inside = value;
+    }))
+        return {};
+
+    // it was filed for much later
+    if (closed)
+        Schedule(key, inside.stamp_, tick + timeouts_.closing_);
+    return {{Socket(inside.host_, inside.port_), std::ref(*inside.translator_)}};
+}
+
+// undoes the rest of a translation that was dropped from inbound_, except for giving back its port
+void Egress::Forget(const Inbound_::Entry &entry) {
+    const auto &[key, inside] = entry;
+    if (outbound_.Erase({inside.translator_, Pack(key >> 16, inside.host_, inside.port_)}))
+        --inside.translator_->count_;
+}
+
+uint16_t Egress::Allocate(uint8_t protocol) {
+    if (const auto port = Ports(protocol)()->Allocate(Ephemeral::Clock_::now()))
+        return *port;
+
+    // every port is in use, so the least recently used translation (of some shard) of this protocol gives its up
+    const auto evicted(inbound_.Evict(victim_.fetch_add(1, std::memory_order_relaxed), [&](uint32_t key, const Inside_ &) {
+        return key >> 16 == protocol;
+    }));
+    orc_assert(evicted);
+    Forget(*evicted);
+    return uint16_t(evicted->first);
+}
+
+void Egress::Free(uint8_t protocol, uint16_t port, bool used) {
+    Ports(protocol)()->Free(port, Ephemeral::Clock_::now(), used);
+}
+
+Socket Egress::Translate(Translator &translator, const Three &three, uint8_t flags) {
+    const auto protocol(three.Protocol());
+    const Outside_ outside{&translator, Pack(protocol, three.Host(), three.Port())};
+    const auto tick(tick_.load(std::memory_order_relaxed));
+    const auto tcp(protocol == openvpn::IPCommon::TCP);
+
+    uint16_t port;
+    if (outbound_.Find(outside, [&](Port_ &value) { value.seen_ = tick; port = value.port_; })) {
+        // only a fin or rst going out changes what inbound_ has
+        if (tcp && (flags & (openvpn::TCPHeader::FLAG_FIN | openvpn::TCPHeader::FLAG_RST)) != 0) {
+            const auto key(Inbound(protocol, port));
+            uint32_t stamp;
+            bool closed(false);
+            inbound_.Peek(key, [&](Inside_ &inside) { closed = Advance(inside, flags, false); stamp = inside.stamp_; });
+            if (closed)
+                Schedule(key, stamp, tick + timeouts_.closing_);
+        }
+
+        return {local_, port};
+    }
+
+    port = Allocate(protocol);
+    const auto key(Inbound(protocol, port));
+
+    Inside_ inside{&translator, three.Host(), three.Port(), Opening, tick, stamp_.fetch_add(1, std::memory_order_relaxed)};
+    if (tcp)
+        Advance(inside, flags, false);
+
+    {
+        auto value(inside);
+        std::optional<Inbound_::Entry> evicted;
+        orc_insist(inbound_.Insert(key, value, evicted));
+        if (evicted) {
+            Forget(*evicted);
+            Free(evicted->first >> 16, uint16_t(evicted->first));
+        }
+    }
+
+    Port_ value{port, tick};
+    std::optional<Outbound_::Entry> evicted;
+    if (!outbound_.Insert(outside, value, evicted)) {
+        // another packet of this flow got here first
+        inbound_.Erase(key);
+        Free(protocol, port, false);
+        return {local_, value.port_};
     }
-    const auto new_three(Three(three.Protocol(), local_, ephemeral));
-    locked->lru_.push_back(new_three);
-    const auto lru_iter(std::prev(locked->lru_.end()));
-    orc_assert(locked->translations_.emplace(new_three, Translation_{three.Two(), translator, lru_iter}).second);
-    return new_three.Two();
+
+    ++translator.count_;
+    Schedule(key, inside.stamp_, tick + Timeout(protocol, inside.state_));
+
+    if (evicted) {
+        const auto &[lost, other] = *evicted;
+        if (inbound_.Erase(Inbound(lost.three_ >> 48, other.port_))) {
+            --lost.translator_->count_;
+            Free(lost.three_ >> 48, other.port_);
+        }
+    }
+
+    return {local_, port};
 }
 
-task<void> Translator::Send(const Buffer &data) {
+void Egress::Close(Translator &translator) {
+    std::vector<uint32_t> ports;
+    inbound_.Sweep([&](uint32_t key, const Inside_ &inside) {
+        if (inside.translator_ != &translator)
+            return false;
+        ports.push_back(key);
+        return true;
+    });
+    outbound_.Sweep([&](const Outside_ &outside, const Port_ &) {
+        return outside.translator_ == &translator;
+    });
+    translator.count_ = 0;
+
+    for (const auto key : ports)
+        Free(key >> 16, uint16_t(key));
+}
+
+void Egress::Expire(std::chrono::steady_clock::time_point now) {
+    const auto tick(uint32_t(std::chrono::duration_cast<std::chrono::seconds>(now - epoch_).count()));
+    tick_.store(tick, std::memory_order_relaxed);
+
+    std::vector<Timer_> due;
+    wheel_()->Advance(tick, [&](const Timer_ &timer) {
+        due.emplace_back(timer);
+    });
+
+    Expired expired;
+    for (const auto &timer : due) {
+        const auto protocol(uint8_t(timer.key_ >> 16));
+
+        // that port might be gone, or be another translation's by now
+        Inside_ inside;
+        if (!inbound_.Peek(timer.key_, [&](const Inside_ &value) { inside = value; }) || inside.stamp_ != timer.stamp_)
+            continue;
+
+        auto seen(inside.seen_);
+        outbound_.Peek({inside.translator_, Pack(protocol, inside.host_, inside.port_)}, [&](const Port_ &value) {
+            seen = std::max(seen, value.seen_);
+        });
+
+        const auto idle(seen + Timeout(protocol, inside.state_));
+        if (idle > tick) {
+            Schedule(timer.key_, timer.stamp_, idle);
+            continue;
+        }
+
+        // unless a packet came back since
+        if (!inbound_.Erase(timer.key_, [&](const Inside_ &value) { return value.stamp_ == timer.stamp_ && value.seen_ == inside.seen_; }))
+            continue;
+        Forget({timer.key_, inside});
+        Free(protocol, uint16_t(timer.key_));
+
+        switch (protocol) {
+            case openvpn::IPCommon::ICMPv4:
+                ++expired.icmp_;
+                break;
+            case openvpn::IPCommon::UDP:
+                ++expired.udp_;
+                break;
+            case openvpn::IPCommon::TCP:
+                ++expired.tcp_;
+                if (inside.state_ == Closing)
+                    ++expired.closed_;
+                break;
+        }
+    }
+
+    const auto locked(expired_());
+    locked->icmp_ += expired.icmp_;
+    locked->udp_ += expired.udp_;
+    locked->tcp_ += expired.tcp_;
+    locked->closed_ += expired.closed_;
+}
+
+size_t Egress::Used() {
+    return icmp_()->Used() + tcp_()->Used() + udp_()->Used();
+}
+
+size_t Egress::Cooling() {
+    return icmp_()->Cooling() + tcp_()->Cooling() + udp_()->Cooling();
+}
+
+uint64_t Egress::Exhausted() {
+    return icmp_()->Exhausted() + tcp_()->Exhausted() + udp_()->Exhausted();
+}
+
+task<void> Translator::Forward(const Buffer &data) {
     Beam beam(data);
     auto span(beam.span());
     auto &ip4(span.cast<openvpn::IPv4Header>());
@@ -115,32 +353,60 @@ task<void> Translator::Send(const Buffer &data) {
         case openvpn::IPCommon::TCP: {
             auto &tcp(span.cast<openvpn::TCPHeader>(length));
             const Three source(openvpn::IPCommon::TCP, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(tcp.source));
-            const auto replace(Translate(source));
+            auto &egress(Pick(source));
+            if (const auto worker = egress.Worker())
+                co_await Scheduled(worker);
+            const auto replace(egress.Translate(*this, source, tcp.flags));
             ForgeIP4(span, &openvpn::IPv4Header::saddr, replace.Host());
             Forge(tcp, &openvpn::TCPHeader::source, replace.Port());
-            co_return co_await egress_->Send(beam);
+            co_return co_await egress.Send(beam);
         } break;
 
         case openvpn::IPCommon::UDP: {
             auto &udp(span.cast<openvpn::UDPHeader>(length));
             const Three source(openvpn::IPCommon::UDP, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(udp.source));
-            const auto replace(Translate(source));
+            auto &egress(Pick(source));
+            if (const auto worker = egress.Worker())
+                co_await Scheduled(worker);
+            const auto replace(egress.Translate(*this, source));
             ForgeIP4(span, &openvpn::IPv4Header::saddr, replace.Host());
             Forge(udp, &openvpn::UDPHeader::source, replace.Port());
-            co_return co_await egress_->Send(beam);
+            co_return co_await egress.Send(beam);
         } break;
 
         case openvpn::IPCommon::ICMPv4: {
             auto &icmp(span.cast<openvpn::ICMPv4>());
             // NOLINTNEXTLINE (cppcoreguidelines-pro-type-union-access)
             const Three source(openvpn::IPCommon::ICMPv4, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(icmp.id));
-            const auto replace(Translate(source));
+            auto &egress(Pick(source));
+            if (const auto worker = egress.Worker())
+                co_await Scheduled(worker);
+            const auto replace(egress.Translate(*this, source));
             ForgeIP4(span, &openvpn::IPv4Header::saddr, replace.Host());
             Forge(icmp, &openvpn::ICMPv4::id, replace.Port());
-            co_return co_await egress_->Send(beam);
+            co_return co_await egress.Send(beam);
         } break;
     }
 }
 
+task<void> Translator::Send(const Buffer &data) {
+    // with one egress there is no worker, so nothing here changes threads
+    if (egresses_.size() == 1)
+        co_return co_await Forward(data);
+
+    std::exception_ptr error;
+    try {
+        co_await Forward(data);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // the rest of Server::Send (whose flow_.Done resumes the next sender) is
+    // for the shared pool, not a worker, whether or not this could be sent
+    co_await Schedule();
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
 
 }
@@ -23,11 +23,16 @@
 #ifndef ORCHID_EGRESS_HPP
 #define ORCHID_EGRESS_HPP
 
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <vector>
 
+#include "ephemeral.hpp"
 #include "link.hpp"
 #include "locked.hpp"
 #include "socket.hpp"
+#include "translations.hpp"
+#include "wheel.hpp"
 
 namespace orc {
 
@@ -38,24 +43,122 @@ class Egress :
     public Pipe<Buffer>,
     public BufferDrain
 {
+  public:
+    // seconds a translation can go unused, by protocol (and for tcp, how far
+    // along the connection is); the defaults are those of rfc 4787, 5382 and 5508
+    struct Timeouts {
+        unsigned icmp_ = 60;
+        unsigned udp_ = 120;
+        // tcp before anything came back
+        unsigned opening_ = 240;
+        unsigned established_ = 7440;
+        // tcp after a fin or rst either way
+        unsigned closing_ = 10;
+        // before a port given back is handed out again
+        unsigned cooldown_ = 30;
+    };
+
+    // translations dropped for being idle
+    struct Expired {
+        uint64_t icmp_ = 0;
+        uint64_t udp_ = 0;
+        uint64_t tcp_ = 0;
+        // of those tcp, how many had closed
+        uint64_t closed_ = 0;
+    };
+
   private:
     const uint32_t local_;
-    const uint16_t ephemeral_base_ = 4096;
+    // this shard's slice of the ephemeral ports, and the thread its packets go out on
+    const uint16_t ephemeral_base_;
+    const uint32_t ephemeral_end_;
+    Pool *const worker_;
+    const Timeouts timeouts_;
+
+    enum State_ : uint8_t { Opening, Established, Closing };
 
-    typedef std::list<const Three> LRU_;
+    // the inside of a translation, by the (protocol and) port it has outside;
+    // stamp tells it apart from any other translation to have had that port
+    struct Inside_ {
+        Translator *translator_;
+        uint32_t host_;
+        uint16_t port_;
+        State_ state_;
+        uint32_t seen_;
+        uint32_t stamp_;
+    };
+
+    // the translation of an inside (ipv4) protocol, address and port, by its translator
+    struct Outside_ {
+        Translator *translator_;
+        uint64_t three_;
+
+        bool operator ==(const Outside_ &rhs) const {
+            return translator_ == rhs.translator_ && three_ == rhs.three_;
+        }
+    };
+
+    struct Pack_ {
+        size_t operator ()(uint32_t value) const {
+            return value;
+        }
+
+        size_t operator ()(const Outside_ &value) const {
+            return Mix(reinterpret_cast<uintptr_t>(value.translator_)) ^ value.three_;
+        }
+    };
 
-    struct Translation_ {
-        const Socket socket_;
-        Translator &translator_;
-        LRU_::iterator lru_iter_;
+    // the outside port of a translation, and when it last sent a packet
+    struct Port_ {
+        uint16_t port_;
+        uint32_t seen_;
     };
 
-    struct Locked_ {
-        std::map<Three, Translation_> translations_;
-        LRU_ lru_;
-    }; Locked<Locked_> locked_;
+    typedef Translations<uint32_t, Inside_, Pack_> Inbound_;
+    typedef Translations<Outside_, Port_, Pack_> Outbound_;
+
+    // each packet coming back locks only a shard of inbound_, and each going out one of outbound_
+    Inbound_ inbound_;
+    Outbound_ outbound_;
+
+    // each protocol has its own ports (as inbound_ is keyed by both)
+    Locked<Ephemeral> icmp_;
+    Locked<Ephemeral> tcp_;
+    Locked<Ephemeral> udp_;
+    std::atomic<size_t> victim_ = 0;
+
+    // time is counted in seconds from epoch_, as of the last Expire
+    const std::chrono::steady_clock::time_point epoch_;
+    std::atomic<uint32_t> tick_ = 0;
+    std::atomic<uint32_t> stamp_ = 0;
+
+    // each translation is filed (by inbound key and stamp) for when it might have been idle too long
+    struct Timer_ {
+        uint32_t key_;
+        uint32_t stamp_;
+    }; Locked<Wheel<Timer_>> wheel_;
+
+    Locked<Expired> expired_;
+
+    Locked<Ephemeral> &Ports(uint8_t protocol);
+
+    unsigned Timeout(uint8_t protocol, State_ state) const;
+    static bool Advance(Inside_ &inside, uint8_t flags, bool inbound);
+    void Schedule(uint32_t key, uint32_t stamp, uint32_t due);
+
+    static uint32_t Inbound(uint8_t protocol, uint16_t port) {
+        return uint32_t(protocol) << 16 | port;
+    }
+
+    static uint64_t Pack(uint8_t protocol, uint32_t host, uint16_t port) {
+        return uint64_t(protocol) << 48 | uint64_t(host) << 16 | port;
+    }
+
+    void Forget(const Inbound_::Entry &entry);
+    uint16_t Allocate(uint8_t protocol);
+    void Free(uint8_t protocol, uint16_t port, bool used = true);
 
-    std::optional<std::pair<const Socket, Translator &>> Find(const Three &target);
+    std::optional<std::pair<const Socket, Translator &>> Find(const Three &target, uint8_t flags);
 
   protected:
     virtual Pump<Buffer> *Inner() noexcept = 0;
@@ -64,10 +167,12 @@ class Egress :
     void Stop(const std::string &error) noexcept override;
 
   public:
-    Egress(uint32_t local) :
-        local_(local)
-    {
-    }
+    // what a translation holds, in and out
+    static const size_t Bytes_ = Inbound_::Bytes_ + Outbound_::Bytes_ + sizeof(std::pair<uint32_t, Timer_>);
+
+    Egress(uint32_t local);
+    // with more than one shard, each has its own worker and ports
+    Egress(uint32_t local, const Timeouts &timeouts, unsigned shard = 0, unsigned shards = 1);
 
     ~Egress() override {
         orc_insist(false);
@@ -82,48 +187,87 @@ class Egress :
         co_await Inner()->Send(data);
     }
 
-    Socket Translate(Translator &translator, const Three &three);
+    // nullptr to stay on whatever thread sends
+    Pool *Worker() const {
+        return worker_;
+    }
+
+    // flags are those of a tcp packet
+    Socket Translate(Translator &translator, const Three &three, uint8_t flags = 0);
+    void Close(Translator &translator);
+
+    // drops the translations idle for too long; called about every second
+    void Expire(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    size_t Size() {
+        return inbound_.Size();
+    }
+
+    Expired Expiries() const {
+        return *expired_();
+    }
+
+    // ports handed out, those cooling down, and how often a protocol ran out of them
+    size_t Used();
+    size_t Cooling();
+    uint64_t Exhausted();
 };
 
 
 class Translator:
     public Link<Buffer>
 {
+    friend class Egress;
+
   private:
-    S<Egress> egress_;
-
-    typedef std::map<Three, Socket> Translations_;
-
-    struct Locked_ {
-        Translations_ translations_;
-    }; Locked<Locked_> locked_;
-
-    Socket Translate(const Three &source) {
-        const auto locked(locked_());
-        const auto translation(locked->translations_.find(source));
-        if (translation != locked->translations_.end())
-            return translation->second;
-        const auto socket(egress_->Translate(*this, source));
-        orc_insist(locked->translations_.emplace(source, socket).second);
-        return socket;
+    // shards of the egress, between which its flows are spread
+    const std::vector<S<Egress>> egresses_;
+
+    // its translations in them
+    std::atomic<size_t> count_ = 0;
+    // as each might stop it
+    std::atomic<bool> stopped_ = false;
+
+    // every packet of a flow goes through the same one, and so one nat table; this
+    // doesn't keep them in order, as they reach its worker through the shared pool
+    // (which runs the latest first) and the session's flow_
+    Egress &Pick(const Three &source) const {
+        if (egresses_.size() == 1)
+            return *egresses_.front();
+        return *egresses_[Mix(uint64_t(source.Protocol()) << 48 | uint64_t(uint32_t(source.Host())) << 16 | source.Port()) % egresses_.size()];
     }
 
+    // translates and sends this on the worker of the egress its flow picks
+    task<void> Forward(const Buffer &data);
+
   public:
-    Translator(BufferDrain *drain, S<Egress> egress) :
+    Translator(BufferDrain *drain, std::vector<S<Egress>> egresses) :
         Link(drain),
-        egress_(std::move(egress))
+        egresses_(std::move(egresses))
+    {
+        orc_assert(!egresses_.empty());
+    }
+
+    Translator(BufferDrain *drain, S<Egress> egress) :
+        Translator(drain, std::vector<S<Egress>>{std::move(egress)})
     {
     }
 
+    ~Translator() override {
+        for (const auto &egress : egresses_)
+            egress->Close(*this);
+    }
+
     task<void> Send(const Buffer &data) override;
-    using Link::Stop;
     using Link::Land;
 
-    void Remove(const Three &source) {
-        const auto locked(locked_());
-        auto &translations(locked->translations_);
-        orc_insist(translations.find(source) != translations.end());
-        translations.erase(source);
+    void Stop(const std::string &error = std::string()) noexcept override {
+        if (!stopped_.exchange(true))
+            Link::Stop(error);
+    }
+
+    size_t Memory() const {
+        return count_.load(std::memory_order_relaxed) * Egress::Bytes_;
     }
 };
 
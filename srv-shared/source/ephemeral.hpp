@@ -0,0 +1,158 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_EPHEMERAL_HPP
+#define ORCHID_EPHEMERAL_HPP
+
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "error.hpp"
+#include "mix.hpp"
+
+namespace orc {
+
+// the ephemeral ports (from base up to end) of one protocol on one address, as a bitmap of those free
+// and a bitmap of which of its words have any, so finding one is constant time.
+// each search starts somewhere random, so which port a flow gets can't be guessed
+// from the one before; a port given back cools down before it is handed out again
+// (so a straggler of the old flow isn't taken for the new one), unless every port
+// is taken, in which case (counted as exhausted) the one cooling longest is reused
+class Ephemeral {
+  public:
+    typedef std::chrono::steady_clock Clock_;
+
+  private:
+    const uint16_t base_;
+    const uint32_t count_;
+    const Clock_::duration cooldown_;
+
+    std::vector<uint64_t> free_;
+    std::vector<uint64_t> words_;
+    size_t available_;
+
+    std::deque<std::pair<Clock_::time_point, uint16_t>> cooling_;
+
+    uint64_t seed_;
+    uint64_t drawn_ = 0;
+
+    uint64_t exhausted_ = 0;
+
+    // a set bit of bits, starting at a random one
+    static unsigned Pick(uint64_t bits, unsigned start) {
+        const auto rotated(start == 0 ? bits : bits >> start | bits << (64 - start));
+        return (__builtin_ctzll(rotated) + start) & 63;
+    }
+
+    void Set(uint32_t index) {
+        free_[index / 64] |= uint64_t(1) << index % 64;
+        words_[index / 4096] |= uint64_t(1) << index / 64 % 64;
+        ++available_;
+    }
+
+    void Clear(uint32_t index) {
+        auto &word(free_[index / 64]);
+        word &= ~(uint64_t(1) << index % 64);
+        if (word == 0)
+            words_[index / 4096] &= ~(uint64_t(1) << index / 64 % 64);
+        --available_;
+    }
+
+    void Release(Clock_::time_point now) {
+        while (!cooling_.empty() && cooling_.front().first <= now) {
+            Set(cooling_.front().second - base_);
+            cooling_.pop_front();
+        }
+    }
+
+  public:
+    Ephemeral(uint16_t base, Clock_::duration cooldown, uint32_t end = 65536) :
+        base_(base),
+        count_(end - base),
+        cooldown_(cooldown),
+        free_((count_ + 63) / 64),
+        words_((free_.size() + 63) / 64),
+        available_(0),
+        seed_(std::random_device()())
+    {
+        orc_assert(base != 0 && end > base && end <= 65536);
+        for (uint32_t index(0); index != count_; ++index)
+            Set(index);
+    }
+
+    std::optional<uint16_t> Allocate(Clock_::time_point now) {
+        Release(now);
+
+        if (available_ == 0) {
+            ++exhausted_;
+            if (cooling_.empty())
+                return std::nullopt;
+            const auto port(cooling_.front().second);
+            cooling_.pop_front();
+            return port;
+        }
+
+        const auto random(Mix(seed_ + ++drawn_));
+        for (size_t i(0); ; ++i) {
+            orc_insist(i != words_.size());
+            const auto group((random + i) % words_.size());
+            const auto bits(words_[group]);
+            if (bits == 0)
+                continue;
+            const auto word(group * 64 + Pick(bits, random >> 16 & 63));
+            const auto index(uint32_t(word * 64 + Pick(free_[word], random >> 24 & 63)));
+            Clear(index);
+            return uint16_t(base_ + index);
+        }
+    }
+
+    // a port that was never used can be handed out again right away
+    void Free(uint16_t port, Clock_::time_point now, bool used = true) {
+        orc_assert(port >= base_ && uint32_t(port - base_) < count_);
+        if (used)
+            cooling_.emplace_back(now + cooldown_, port);
+        else
+            Set(port - base_);
+    }
+
+    // handed out, and not yet given back
+    size_t Used() const {
+        return count_ - available_ - cooling_.size();
+    }
+
+    size_t Cooling() const {
+        return cooling_.size();
+    }
+
+    // how often no port had cooled down (so one was taken early, or none was left)
+    uint64_t Exhausted() const {
+        return exhausted_;
+    }
+};
+
+}
+
+#endif//ORCHID_EPHEMERAL_HPP
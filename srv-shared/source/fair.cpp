@@ -0,0 +1,172 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+
+#include "error.hpp"
+#include "fair.hpp"
+
+namespace orc {
+
+void Fair::Grant(std::vector<Waiter *> &ready) {
+    while (busy_ != width_ && !round_.empty()) {
+        const auto flow(round_.front());
+        const auto waiter(flow->waiters_.front());
+
+        if (flow->deficit_ < waiter->size_) {
+            flow->deficit_ += quantum_;
+            round_.splice(round_.end(), round_, round_.begin());
+            continue;
+        }
+
+        flow->deficit_ -= waiter->size_;
+        flow->queued_ -= waiter->size_;
+        queued_ -= waiter->size_;
+        flow->waiters_.pop_front();
+        ++flow->packets_;
+        flow->bytes_ += waiter->size_;
+
+        // an idle flow doesn't get to save up its deficit
+        if (flow->waiters_.empty()) {
+            flow->deficit_ = 0;
+            flow->active_ = false;
+            round_.pop_front();
+        }
+
+        ++busy_;
+        ready.push_back(waiter);
+    }
+}
+
+void Fair::Done() {
+    std::vector<Waiter *> ready;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        orc_insist(busy_ != 0);
+        --busy_;
+        Grant(ready);
+    }
+
+    // the waiter lives in the waiting coroutine, which may be gone after this
+    for (const auto waiter : ready)
+        waiter->ready_();
+}
+
+Fair::Fair(unsigned width, size_t quantum, size_t backlog, unsigned horizon, uint64_t floor) :
+    width_(width),
+    quantum_(quantum),
+    backlog_(backlog),
+    horizon_(horizon),
+    floor_(floor)
+{
+    orc_assert(width_ != 0);
+    orc_assert(quantum_ != 0);
+}
+
+size_t Fair::Queued() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+bool Fair::Flow::Admit(size_t size, bool control) {
+    // a session in arrears can only catch up if it hears what it owes
+    if (control)
+        return true;
+    if (queued_ + size > fair_->backlog_)
+        return false;
+    if (owing_.load(std::memory_order_relaxed) && fair_->shedding_.load(std::memory_order_relaxed))
+        return false;
+
+    const auto rate(rate_.load(std::memory_order_relaxed));
+    if (rate == 0)
+        return true;
+
+    // a second's worth of burst, but always enough for a few packets
+    const auto now(Clock_::now());
+    const auto burst(double(std::max<uint64_t>(rate, 64 * 1024)));
+    tokens_ = std::min(burst, tokens_ + std::chrono::duration<double>(now - filled_).count() * rate);
+    filled_ = now;
+
+    if (tokens_ < size)
+        return false;
+    tokens_ -= size;
+    return true;
+}
+
+Fair::Flow::~Flow() {
+    std::unique_lock<std::mutex> lock(fair_->mutex_);
+    orc_insist(waiters_.empty());
+    if (active_)
+        fair_->round_.remove(this);
+}
+
+void Fair::Flow::Fund(Fixed balance) {
+    owing_.store(balance < 0, std::memory_order_relaxed);
+    if (fair_->horizon_ == 0)
+        return;
+    const auto prepaid(balance <= 0 ? 0 : uint64_t(balance >> Fraction_));
+    rate_.store(std::max(fair_->floor_, prepaid / fair_->horizon_), std::memory_order_relaxed);
+}
+
+task<bool> Fair::Flow::Wait(size_t size, bool control) {
+    Waiter waiter{size, Clock_::now()};
+
+    {
+        std::unique_lock<std::mutex> lock(fair_->mutex_);
+
+        if (!Admit(size, control)) {
+            ++dropped_;
+            co_return false;
+        }
+
+        // everyone else has had their turn: no need to queue
+        if (fair_->busy_ != fair_->width_) {
+            orc_insist(fair_->round_.empty());
+            ++fair_->busy_;
+            ++packets_;
+            bytes_ += size;
+            co_return true;
+        }
+
+        waiters_.push_back(&waiter);
+        queued_ += size;
+        fair_->queued_ += size;
+        if (!active_) {
+            active_ = true;
+            fair_->round_.push_back(this);
+        }
+    }
+
+    co_await waiter.ready_.Wait();
+
+    const auto delay(Clock_::now() - waiter.queued_);
+    std::unique_lock<std::mutex> lock(fair_->mutex_);
+    delay_ += delay;
+    co_return true;
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t, Fair::Clock_::duration> Fair::Flow::Stats() {
+    std::unique_lock<std::mutex> lock(fair_->mutex_);
+    return {packets_, bytes_, dropped_, delay_};
+}
+
+}
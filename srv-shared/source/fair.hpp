@@ -0,0 +1,139 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_FAIR_HPP
+#define ORCHID_FAIR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "balance.hpp"
+#include "event.hpp"
+#include "shared.hpp"
+#include "task.hpp"
+
+namespace orc {
+
+// deficit round robin between sessions for the right to send a packet: at most
+// width packets are in flight, and as each completes the next goes to whichever
+// session's turn it is, quantum bytes at a time; so a heavy downloader only ever
+// delays others by its share, and past its backlog it drops rather than queues
+class Fair {
+  public:
+    class Flow;
+
+  private:
+    typedef std::chrono::steady_clock Clock_;
+
+    struct Waiter {
+        const size_t size_;
+        const Clock_::time_point queued_;
+        Event ready_;
+    };
+
+    const unsigned width_;
+    const size_t quantum_;
+    const size_t backlog_;
+    const unsigned horizon_;
+    const uint64_t floor_;
+
+    std::mutex mutex_;
+    // flows with a packet waiting, in the order of their turns
+    std::list<Flow *> round_;
+    unsigned busy_ = 0;
+    size_t queued_ = 0;
+
+    // when overloaded, sessions in arrears are the first to lose packets
+    std::atomic<bool> shedding_ = false;
+
+    void Grant(std::vector<Waiter *> &ready);
+    void Done();
+
+  public:
+    class Flow {
+        friend class Fair;
+
+      private:
+        const S<Fair> fair_;
+
+        std::deque<Waiter *> waiters_;
+        size_t queued_ = 0;
+        size_t deficit_ = 0;
+        bool active_ = false;
+
+        // bytes per second, or 0 if uncapped; set from the session's balance
+        std::atomic<uint64_t> rate_ = 0;
+        std::atomic<bool> owing_ = false;
+        double tokens_ = 0;
+        Clock_::time_point filled_ = Clock_::now();
+
+        uint64_t packets_ = 0;
+        uint64_t bytes_ = 0;
+        uint64_t dropped_ = 0;
+        Clock_::duration delay_ = {};
+
+        bool Admit(size_t size, bool control);
+
+      public:
+        Flow(S<Fair> fair) :
+            fair_(std::move(fair))
+        {
+        }
+
+        Flow(const Flow &flow) = delete;
+        ~Flow();
+
+        // called with the balance after each debit: what is prepaid buys a rate at which
+        // it would last the horizon; a session in arrears gets the floor, and is shed first
+        void Fund(Fixed balance);
+
+        // false if the packet should be dropped; otherwise call Done once it is sent.
+        // a control packet (such as an invoice) still takes its turn, but is never dropped
+        task<bool> Wait(size_t size, bool control = false);
+
+        void Done() {
+            fair_->Done();
+        }
+
+        // packets and bytes sent, packets dropped, and the time packets spent waiting their turn
+        std::tuple<uint64_t, uint64_t, uint64_t, Clock_::duration> Stats();
+    };
+
+    // horizon is 0 to leave sessions uncapped
+    Fair(unsigned width = 32, size_t quantum = 1500, size_t backlog = 256 * 1024, unsigned horizon = 0, uint64_t floor = 64 * 1024);
+
+    // bytes waiting for their turn, across all sessions
+    size_t Queued();
+
+    void Shed(bool shedding) {
+        shedding_.store(shedding, std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_FAIR_HPP
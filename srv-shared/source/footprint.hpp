@@ -0,0 +1,118 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_FOOTPRINT_HPP
+#define ORCHID_FOOTPRINT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace orc {
+
+// the bytes a session has on the datapath (packets and commands copied for a
+// task in its Nest, with the task itself), held against a budget: what would
+// take it past the budget is refused, so the packet is dropped as a full queue
+// drops it. Server counts the rest (what it remembers of tickets, its nat
+// entries) in Memory, which Node holds against a larger budget by disconnecting
+class Footprint {
+  public:
+    // about what a coroutine frame (with its Beam) costs beyond the data
+    static const size_t Task_ = 512;
+
+  private:
+    const size_t budget_;
+    std::atomic<size_t> held_ = 0;
+    std::atomic<size_t> peak_ = 0;
+    std::atomic<uint64_t> refused_ = 0;
+
+  public:
+    class Hold {
+      private:
+        Footprint *footprint_;
+        size_t size_;
+
+      public:
+        Hold(Footprint *footprint, size_t size) noexcept :
+            footprint_(footprint),
+            size_(size)
+        {
+        }
+
+        Hold(Hold &&hold) noexcept :
+            footprint_(hold.footprint_),
+            size_(hold.size_)
+        {
+            hold.footprint_ = nullptr;
+        }
+
+        Hold(const Hold &) = delete;
+        Hold &operator =(const Hold &) = delete;
+
+        ~Hold() {
+            if (footprint_ != nullptr)
+                footprint_->held_.fetch_sub(size_, std::memory_order_relaxed);
+        }
+
+        operator bool() const noexcept {
+            return footprint_ != nullptr;
+        }
+    };
+
+    // a budget of 0 is unchecked
+    Footprint(size_t budget) :
+        budget_(budget)
+    {
+    }
+
+    // false (and holding nothing) when that would be over budget
+    Hold Take(size_t size) noexcept {
+        size += Task_;
+        const auto held(held_.fetch_add(size, std::memory_order_relaxed) + size);
+        if (budget_ != 0 && held > budget_) {
+            held_.fetch_sub(size, std::memory_order_relaxed);
+            refused_.fetch_add(1, std::memory_order_relaxed);
+            return Hold(nullptr, 0);
+        }
+
+        for (auto peak(peak_.load(std::memory_order_relaxed)); peak < held; )
+            if (peak_.compare_exchange_weak(peak, held, std::memory_order_relaxed))
+                break;
+        return Hold(this, size);
+    }
+
+    size_t Held() const {
+        return held_.load(std::memory_order_relaxed);
+    }
+
+    size_t Peak() const {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Refused() const {
+        return refused_.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_FOOTPRINT_HPP
@@ -0,0 +1,152 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "error.hpp"
+#include "governor.hpp"
+#include "log.hpp"
+#include "sleep.hpp"
+
+namespace orc {
+
+static Governor::Clock_::duration Used() {
+    struct rusage usage;
+    orc_assert(getrusage(RUSAGE_SELF, &usage) == 0);
+    const auto time([](const timeval &value) {
+        return std::chrono::seconds(value.tv_sec) + std::chrono::microseconds(value.tv_usec);
+    });
+    return std::chrono::duration_cast<Governor::Clock_::duration>(time(usage.ru_utime) + time(usage.ru_stime));
+}
+
+// 0 where there is no /proc
+static size_t Resident() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size(0), resident(0);
+    if (!(statm >> size >> resident))
+        return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+Governor::Governor(const Load &budget, S<Fair> fair) :
+    budget_(budget),
+    fair_(std::move(fair)),
+    sampled_(Clock_::now()),
+    used_(Used())
+{
+}
+
+task<Governor::Load> Governor::Sample() {
+    Load load;
+
+    const auto asked(Clock_::now());
+    co_await Schedule();
+    const auto now(Clock_::now());
+    load.lag_ = std::chrono::duration_cast<std::chrono::microseconds>(now - asked);
+
+    const auto used(Used());
+    const auto elapsed(now - sampled_);
+    if (elapsed.count() > 0)
+        load.cpu_ = std::chrono::duration<double>(used - used_) / elapsed / std::max(std::thread::hardware_concurrency(), 1u);
+    sampled_ = now;
+    used_ = used;
+
+    load.memory_ = Resident();
+    if (fair_ != nullptr)
+        load.egress_ = fair_->Queued();
+
+    co_return load;
+}
+
+void Governor::Update(const Load &load) {
+    double ratio(0);
+    const char *reason("");
+    const auto check([&](const char *name, double value, double budget) {
+        if (budget == 0 || value / budget <= ratio)
+            return;
+        ratio = value / budget;
+        reason = name;
+    });
+
+    check("cpu", load.cpu_, budget_.cpu_);
+    check("lag", load.lag_.count(), budget_.lag_.count());
+    check("memory", load.memory_, budget_.memory_);
+    check("egress", load.egress_, budget_.egress_);
+
+    // up as soon as a threshold is crossed, but only down once well under it
+    static const double Thresholds_[] = {0, 1, 1.5};
+    auto level(level_.load(std::memory_order_relaxed));
+    while (level != Overloaded && ratio >= Thresholds_[level + 1])
+        level = Level(level + 1);
+    while (level != Normal && ratio < Thresholds_[level] * 0.8)
+        level = Level(level - 1);
+
+    {
+        const auto locked(locked_());
+        locked->load_ = load;
+        locked->ratio_ = ratio;
+        locked->reason_ = reason;
+    }
+
+    if (level_.exchange(level, std::memory_order_relaxed) != level) {
+        Log() << "governor: " << (level == Normal ? "normal" : level == Busy ? "busy" : "overloaded") << " (" << reason << " at " << ratio << "x budget)" << std::endl;
+        if (fair_ != nullptr)
+            fair_->Shed(level == Overloaded);
+    }
+}
+
+void Governor::Open(std::chrono::milliseconds period) {
+    Spawn([this, period]() noexcept -> task<void> {
+        while (!stopping_.load(std::memory_order_relaxed)) {
+            co_await Sleep(period);
+            orc_ignore({ Update(co_await Sample()); });
+        }
+        stopped_();
+    });
+}
+
+task<void> Governor::Shut() noexcept {
+    stopping_.store(true, std::memory_order_relaxed);
+    co_await stopped_.Wait();
+}
+
+bool Governor::Admit() {
+    if (level_.load(std::memory_order_relaxed) == Normal)
+        return true;
+    refused_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::string Governor::Reason() const {
+    const auto locked(locked_());
+    std::ostringstream reason;
+    reason << "overloaded (" << locked->reason_ << " at " << locked->ratio_ << "x budget); try again later";
+    return reason.str();
+}
+
+}
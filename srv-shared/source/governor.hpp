@@ -0,0 +1,108 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_GOVERNOR_HPP
+#define ORCHID_GOVERNOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "fair.hpp"
+#include "event.hpp"
+#include "locked.hpp"
+#include "shared.hpp"
+#include "task.hpp"
+
+namespace orc {
+
+// samples how loaded this server is against a budget: when over it (Busy), new
+// sessions are refused before they cost a negotiation; well over it (Overloaded),
+// the sessions in arrears also lose their packets, so those that pay keep theirs.
+// it backs off only once the load is well under, so it doesn't flap at the edge
+class Governor {
+  public:
+    enum Level : unsigned { Normal, Busy, Overloaded };
+
+    typedef std::chrono::steady_clock Clock_;
+
+    // a zero in the budget leaves that measure unchecked
+    struct Load {
+        // of the whole machine, 0 to 1
+        double cpu_ = 0;
+        // from asking for the Pool thread to getting it
+        std::chrono::microseconds lag_ = {};
+        // resident bytes
+        size_t memory_ = 0;
+        // bytes waiting for a turn at the egress
+        size_t egress_ = 0;
+    };
+
+  private:
+    const Load budget_;
+    const S<Fair> fair_;
+
+    std::atomic<Level> level_ = Normal;
+    std::atomic<uint64_t> refused_ = 0;
+
+    struct Locked_ {
+        Load load_;
+        // the worst measure, as a multiple of its budget
+        double ratio_ = 0;
+        const char *reason_ = "";
+    }; Locked<Locked_> locked_;
+
+    Clock_::time_point sampled_;
+    Clock_::duration used_ = {};
+
+    std::atomic<bool> stopping_ = false;
+    Event stopped_;
+
+  public:
+    Governor(const Load &budget, S<Fair> fair);
+
+    // the load now; cpu is averaged since the previous Sample
+    task<Load> Sample();
+    void Update(const Load &load);
+
+    // samples every period until Shut
+    void Open(std::chrono::milliseconds period = std::chrono::milliseconds(250));
+    task<void> Shut() noexcept;
+
+    Level operator ()() const {
+        return level_.load(std::memory_order_relaxed);
+    }
+
+    // for a new session: false (counted) if it should be refused
+    bool Admit();
+
+    // why sessions are being refused, for telling their clients
+    std::string Reason() const;
+
+    uint64_t Refused() const {
+        return refused_.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_GOVERNOR_HPP
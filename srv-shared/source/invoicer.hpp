@@ -0,0 +1,135 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_INVOICER_HPP
+#define ORCHID_INVOICER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <tuple>
+
+#include "balance.hpp"
+
+namespace orc {
+
+// decides when a session's balance is worth telling its client about. a
+// ticket's acknowledgement, or a balance under the threshold (a client running
+// low must see every change, or it pays late), always goes at once; otherwise
+// an invoice waits until the balance has moved by the threshold, and then for
+// the interval since the last one; and whatever is left unsaid goes out within
+// the budget. the threshold follows the tickets: a quarter of the last credit
+class Invoicer {
+  public:
+    typedef std::chrono::steady_clock Clock_;
+
+    struct Policy {
+        // bytes (as billed)
+        size_t threshold_ = 64 * 1024;
+        Clock_::duration interval_ = std::chrono::milliseconds(100);
+        Clock_::duration budget_ = std::chrono::seconds(1);
+    };
+
+    enum Action { Send, Defer, Skip };
+
+  private:
+    const Fixed floor_;
+    const Clock_::duration interval_;
+    const Clock_::duration budget_;
+
+    std::mutex mutex_;
+    Fixed threshold_;
+    bool sent_ = false;
+    Clock_::time_point last_;
+    uint64_t serial_ = 0;
+    Fixed balance_ = 0;
+    bool deferred_ = false;
+
+    std::atomic<uint64_t> requests_ = 0;
+    std::atomic<uint64_t> invoices_ = 0;
+    std::atomic<uint64_t> bytes_ = 0;
+
+  public:
+    Invoicer(const Policy &policy) :
+        floor_(Balance::Cost(policy.threshold_)),
+        interval_(policy.interval_),
+        budget_(policy.budget_),
+        threshold_(floor_)
+    {
+    }
+
+    // on Defer, call Flush after delay; on Send, call Sent once it's been sent
+    Action operator ()(Clock_::time_point now, uint64_t serial, Fixed balance, bool ack, Clock_::duration &delay) {
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        const auto since(now - last_);
+        const auto due(!sent_ || std::abs(balance - balance_) >= threshold_);
+        if (ack || balance < threshold_ || (due && since >= interval_))
+            return Send;
+        if (deferred_ || serial == serial_)
+            return Skip;
+
+        deferred_ = true;
+        delay = std::max(Clock_::duration(), (due ? interval_ : budget_) - since);
+        return Defer;
+    }
+
+    // false if what was deferred has been sent since
+    bool Flush(uint64_t serial) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        deferred_ = false;
+        return serial != serial_;
+    }
+
+    void Sent(Clock_::time_point now, uint64_t serial, Fixed balance, size_t size) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            sent_ = true;
+            last_ = now;
+            // invoices can be built out of order; the client only keeps the latest
+            if (serial > serial_) {
+                serial_ = serial;
+                balance_ = balance;
+            }
+        }
+
+        invoices_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void Credited(Fixed credit) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        threshold_ = std::max(floor_, credit / 4);
+    }
+
+    // times an invoice was called for, invoices sent, and their bytes
+    std::tuple<uint64_t, uint64_t, uint64_t> Stats() const {
+        return {requests_.load(std::memory_order_relaxed), invoices_.load(std::memory_order_relaxed), bytes_.load(std::memory_order_relaxed)};
+    }
+};
+
+}
+
+#endif//ORCHID_INVOICER_HPP
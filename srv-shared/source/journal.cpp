@@ -0,0 +1,295 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/endian/conversion.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "crypto.hpp"
+#include "error.hpp"
+#include "journal.hpp"
+#include "log.hpp"
+#include "syscall.hpp"
+
+namespace orc {
+
+static const uint8_t Pending_('P');
+static const uint8_t Settled_('S');
+// written first by a compaction, so ids are never reused
+static const uint8_t Next_('N');
+
+static const size_t Header_(4 + 4);
+static const size_t Body_(1 + 8);
+
+void Journal::Write(int file, const uint8_t *data, size_t size) {
+    while (size != 0) {
+        const auto writ(orc_syscall(write(file, data, size)));
+        data += writ;
+        size -= writ;
+    }
+}
+
+void Journal::Record(std::vector<uint8_t> &batch, uint8_t kind, Id id, const Buffer &data) {
+    const Beam body(Tie(Number<uint8_t>(kind), Number<uint64_t>(id), data));
+    const auto check(Hash(body));
+    const auto size(boost::endian::native_to_big(uint32_t(body.size())));
+    const auto start(reinterpret_cast<const uint8_t *>(&size));
+    batch.insert(batch.end(), start, start + sizeof(size));
+    batch.insert(batch.end(), check.data(), check.data() + 4);
+    batch.insert(batch.end(), body.data(), body.data() + body.size());
+}
+
+void Journal::Replay() {
+    const size_t end(orc_syscall(lseek(file_, 0, SEEK_END)));
+    Beam data(end);
+    orc_syscall(lseek(file_, 0, SEEK_SET));
+    for (size_t offset(0); offset != end; ) {
+        const auto writ(orc_syscall(read(file_, data.data() + offset, end - offset)));
+        orc_assert(writ != 0);
+        offset += writ;
+    }
+
+    size_t valid(0);
+    for (;;) {
+        if (end - valid < Header_ + Body_)
+            break;
+        const auto record(data.data() + valid);
+
+        uint32_t size;
+        memcpy(&size, record, sizeof(size));
+        size = boost::endian::big_to_native(size);
+        if (size < Body_ || end - valid - Header_ < size)
+            break;
+
+        const Subset body(record + Header_, size);
+        if (memcmp(Hash(body).data(), record + 4, 4) != 0)
+            break;
+
+        const auto kind(body.data()[0]);
+        Id id;
+        memcpy(&id, body.data() + 1, sizeof(id));
+        id = boost::endian::big_to_native(id);
+
+        if (kind == Pending_)
+            live_.try_emplace(id, body.data() + Body_, size - Body_);
+        else if (kind == Settled_)
+            live_.erase(id);
+        else if (kind != Next_)
+            break;
+
+        if (next_ <= id)
+            next_ = kind == Next_ ? id : id + 1;
+        ++records_;
+        valid += Header_ + size;
+    }
+
+    // whatever follows the last good record was being written during a crash
+    if (valid != end) {
+        Log() << "journal " << path_ << " discarding " << (end - valid) << " bytes of torn records" << std::endl;
+        orc_syscall(ftruncate(file_, valid));
+        orc_syscall(fdatasync(file_));
+    }
+}
+
+// only the thread running Run uses file_, so all this needs the lock for is reading what is live;
+// anything appended meanwhile is in batch_, and is written (after this) to the new file
+void Journal::Compact() {
+    std::vector<uint8_t> batch;
+    size_t records;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Record(batch, Next_, next_, Nothing());
+        for (const auto &[id, data] : live_)
+            Record(batch, Pending_, id, data);
+        records = live_.size() + 1;
+    }
+
+    const auto temporary(path_ + ".tmp");
+    const auto file(orc_syscall(open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+
+    try {
+        Write(file, batch.data(), batch.size());
+        orc_syscall(fdatasync(file));
+    } catch (...) {
+        close(file);
+        unlink(temporary.c_str());
+        throw;
+    }
+
+    orc_syscall(close(file));
+    orc_syscall(rename(temporary.c_str(), path_.c_str()));
+
+    // the rename is only durable once the directory is synced
+    auto directory(boost::filesystem::path(path_).parent_path().string());
+    if (directory.empty())
+        directory = ".";
+    const auto parent(orc_syscall(open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+    fsync(parent);
+    close(parent);
+
+    const auto reopened(orc_syscall(open(path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC)));
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    close(file_);
+    file_ = reopened;
+    records_ = records;
+    ++compactions_;
+}
+
+void Journal::Run() {
+    for (;;) {
+        std::vector<uint8_t> batch;
+        std::vector<Waiter *> waiters;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&]() { return stopping_ || !batch_.empty(); });
+            if (batch_.empty())
+                return;
+            std::swap(batch, batch_);
+            std::swap(waiters, waiters_);
+        }
+
+        std::exception_ptr error;
+        const auto before(lseek(file_, 0, SEEK_END));
+        try {
+            Write(file_, batch.data(), batch.size());
+            orc_syscall(fdatasync(file_));
+        } catch (...) {
+            error = std::current_exception();
+            // don't leave a partial record for later ones to follow
+            if (before != -1)
+                ftruncate(file_, before);
+        }
+
+        bool compact(false);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ++syncs_;
+            if (!error) {
+                records_ += waiters.size();
+                compact = records_ >= Compact_ && live_.size() * 4 < records_;
+            }
+        }
+
+        // the waiter lives in the waiting coroutine, which may be gone after this
+        for (const auto waiter : waiters) {
+            waiter->error_ = error;
+            waiter->ready_();
+        }
+
+        // Append and Settle (on the Pool thread) aren't held up by the disk while this runs
+        if (compact)
+            orc_ignore({ Compact(); });
+    }
+}
+
+task<void> Journal::Sync(Waiter &waiter) {
+    ready_.notify_one();
+    co_await waiter.ready_.Wait();
+    if (waiter.error_)
+        std::rethrow_exception(waiter.error_);
+}
+
+Journal::Journal(std::string path) :
+    path_(std::move(path)),
+    file_(orc_syscall(open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600)))
+{
+    try {
+        Replay();
+    } catch (...) {
+        close(file_);
+        throw;
+    }
+
+    thread_ = std::thread([this]() { Run(); });
+}
+
+Journal::~Journal() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+
+    ready_.notify_all();
+    thread_.join();
+    close(file_);
+}
+
+std::map<Journal::Id, Beam> Journal::Pending() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::map<Id, Beam> pending;
+    for (const auto &[id, data] : live_)
+        pending.try_emplace(id, data);
+    return pending;
+}
+
+task<Journal::Id> Journal::Append(const Buffer &data) {
+    Waiter waiter;
+    const auto id([&]() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto id(next_++);
+        live_.try_emplace(id, data);
+        Record(batch_, Pending_, id, data);
+        waiters_.push_back(&waiter);
+        return id;
+    }());
+
+    if (orc_ignore({ co_await Sync(waiter); })) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        live_.erase(id);
+        std::rethrow_exception(waiter.error_);
+    }
+
+    co_return id;
+}
+
+task<void> Journal::Settle(Id id) {
+    Waiter waiter;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        live_.erase(id);
+        Record(batch_, Settled_, id, Nothing());
+        waiters_.push_back(&waiter);
+    }
+
+    co_await Sync(waiter);
+}
+
+size_t Journal::Records() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return records_;
+}
+
+uint64_t Journal::Syncs() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return syncs_;
+}
+
+uint64_t Journal::Compactions() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return compactions_;
+}
+
+}
@@ -0,0 +1,104 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_JOURNAL_HPP
+#define ORCHID_JOURNAL_HPP
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer.hpp"
+#include "event.hpp"
+#include "task.hpp"
+
+namespace orc {
+
+// an append-only file of entries that must survive a crash until settled;
+// each record is [size:4][check:4][kind:1][id:8][data], check being the
+// start of the keccak of everything after it, so a torn or partial write at
+// the end of the file is detected (and discarded) by the replay
+class Journal {
+  public:
+    typedef uint64_t Id;
+
+    // compacted when there are at least this many records, mostly settled
+    static const size_t Compact_ = 1024;
+
+  private:
+    struct Waiter {
+        std::exception_ptr error_;
+        Event ready_;
+    };
+
+    const std::string path_;
+    int file_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+
+    // records not yet written, and who is waiting for them to be synced
+    std::vector<uint8_t> batch_;
+    std::vector<Waiter *> waiters_;
+
+    Id next_ = 0;
+    std::map<Id, Beam> live_;
+    size_t records_ = 0;
+
+    uint64_t syncs_ = 0;
+    uint64_t compactions_ = 0;
+
+    std::thread thread_;
+
+    static void Write(int file, const uint8_t *data, size_t size);
+    void Record(std::vector<uint8_t> &batch, uint8_t kind, Id id, const Buffer &data);
+
+    void Replay();
+    void Compact();
+    void Run();
+
+    task<void> Sync(Waiter &waiter);
+
+  public:
+    Journal(std::string path);
+    ~Journal();
+
+    // everything appended and not settled; on startup, what the replay found
+    std::map<Id, Beam> Pending();
+
+    // these each return only once the record is on disk; concurrent calls
+    // are written together and share the cost of a single fdatasync
+    task<Id> Append(const Buffer &data);
+    task<void> Settle(Id id);
+
+    size_t Records();
+    uint64_t Syncs();
+    uint64_t Compactions();
+};
+
+}
+
+#endif//ORCHID_JOURNAL_HPP
@@ -42,6 +42,7 @@
 #include <rtc_base/openssl_identity.h>
 #include <rtc_base/ssl_fingerprint.h>
 
+#include "aqm.hpp"
 #include "baton.hpp"
 #include "cashier.hpp"
 #include "channel.hpp"
@@ -115,12 +116,44 @@ int Main(int argc, const char *const argv[]) {
         ("tls", po::value<std::string>(), "tls keys and chain (pkcs#12 encoded)")
         ("dh", po::value<std::string>(), "diffie hellman params (pem encoded)")
         ("network", po::value<std::string>(), "local interface for ICE candidates")
+        ("early", "answer before ICE gathering completes and trickle the rest")
+        ("negotiations", po::value<unsigned>()->default_value(64), "offers answered at once; more are refused (503)")
+        ("direct", "send tunnel packets directly to the SCTP socket")
+        ("dtls", po::value<uint16_t>(), "udp port for plain dtls sessions (advertised instead of https)")
+        ("utp", po::value<uint16_t>(), "udp port for dtls over utp (ledbat) sessions (advertised instead of https)")
+        ("udp-idle", po::value<unsigned>()->default_value(120), "seconds after which a silent dtls or utp session is let go (0 = never)")
     ; options.add(group); }
 
     { po::options_description group("bandwidth pricing");
     group.add_options()
         ("currency", po::value<std::string>()->default_value("USD"), "currency used for price conversions")
+        ("oracle", po::value<std::string>()->default_value("https://api.coinbase.com/"), "where currency prices come from (coinbase's api, or anything serving its /v2/prices)")
         ("price", po::value<std::string>()->default_value("0.03"), "price of bandwidth in currency / GB")
+        ("journal", po::value<std::string>()->default_value("orchid-tickets.log"), "file of winning tickets not yet redeemed")
+        ("replay-window", po::value<unsigned>()->default_value(60), "seconds a ticket can be late and still be checked for replay")
+        ("invoice-threshold", po::value<size_t>()->default_value(64 * 1024), "bytes the balance must move by before a new invoice (at least)")
+        ("invoice-interval", po::value<unsigned>()->default_value(100), "milliseconds between invoices, unless acknowledging a ticket or the client is low")
+        ("invoice-budget", po::value<unsigned>()->default_value(1000), "milliseconds within which any change to the balance is invoiced")
+    ; options.add(group); }
+
+    { po::options_description group("fair queuing");
+    group.add_options()
+        ("egress-width", po::value<unsigned>()->default_value(32), "packets sent at once; the rest wait their session's turn")
+        ("egress-quantum", po::value<size_t>()->default_value(1500), "bytes a session sends per turn")
+        ("session-backlog", po::value<size_t>()->default_value(256 * 1024), "bytes a session can have waiting; more are dropped")
+        ("rate-horizon", po::value<unsigned>()->default_value(0), "cap a session's rate so its balance lasts this many seconds (0 = uncapped)")
+        ("rate-floor", po::value<uint64_t>()->default_value(64 * 1024), "bytes/s a capped session gets however low its balance")
+        ("egress-rate", po::value<uint64_t>()->default_value(0), "bytes/s to pace the egress to, queueing with fq-codel ahead of it (0 = off)")
+    ; options.add(group); }
+
+    { po::options_description group("load governor");
+    group.add_options()
+        ("max-cpu", po::value<double>()->default_value(0.9), "share of all cores past which new sessions are refused (0 = unchecked)")
+        ("max-lag", po::value<unsigned>()->default_value(20), "milliseconds waiting for the packet thread past which new sessions are refused (0 = unchecked)")
+        ("max-memory", po::value<size_t>()->default_value(0), "resident megabytes past which new sessions are refused (0 = unchecked)")
+        ("max-egress", po::value<size_t>()->default_value(8 * 1024 * 1024), "bytes queued for the egress past which new sessions are refused (0 = unchecked)")
+        ("session-memory", po::value<size_t>()->default_value(16 * 1024), "kilobytes a session can hold: past half, its packets are dropped; past all, it is disconnected (0 = unchecked)")
+        ("memory-report", po::value<unsigned>()->default_value(60), "seconds between logs of the sessions holding the most memory (0 = never)")
     ; options.add(group); }
 
     { po::options_description group("openpvn egress");
@@ -128,6 +161,7 @@ int Main(int argc, const char *const argv[]) {
         ("ovpn-file", po::value<std::string>(), "openvpn .ovpn configuration file")
         ("ovpn-user", po::value<std::string>()->default_value(""), "openvpn client credential (username)")
         ("ovpn-pass", po::value<std::string>()->default_value(""), "openvpn client credential (password)")
+        ("egress-shards", po::value<unsigned>()->default_value(1), "openvpn connections flows are spread across, each with its own thread and slice of ports")
     ; options.add(group); }
 
     po::positional_options_description positional;
@@ -158,8 +192,9 @@ int Main(int argc, const char *const argv[]) {
 
     Initialize();
 
-    std::vector<std::string> ice;
-    ice.emplace_back("stun:" + args["stun"].as<std::string>());
+    Configuration configuration;
+    configuration.ice_.emplace_back("stun:" + args["stun"].as<std::string>());
+    configuration.direct_ = args.count("direct") != 0;
 
 
     std::string params;
@@ -263,7 +298,13 @@ int Main(int argc, const char *const argv[]) {
     const auto port(args["port"].as<uint16_t>());
     auto path(args["path"].as<std::string>());
 
-    const Strung url("https://" + host + ":" + std::to_string(port) + path);
+    const Strung url([&]() -> std::string {
+        if (args.count("utp") != 0)
+            return "utp://" + host + ":" + std::to_string(args["utp"].as<uint16_t>()) + "/";
+        if (args.count("dtls") != 0)
+            return "dtls://" + host + ":" + std::to_string(args["dtls"].as<uint16_t>()) + "/";
+        return "https://" + host + ":" + std::to_string(port) + path;
+    }());
     Bytes gpg;
 
     Builder tls;
@@ -338,29 +379,62 @@ int Main(int argc, const char *const argv[]) {
             return nullptr;
         const Address personal(args["personal"].as<std::string>());
         return Make<Cashier>(origin, std::move(endpoint), Locator::Parse(args["ws"].as<std::string>()),
-            price, args["currency"].as<std::string>(),
+            price, args["currency"].as<std::string>(), Locator::Parse(args["oracle"].as<std::string>()),
             personal, password,
-            Address(args["lottery"].as<std::string>()), args["chainid"].as<unsigned>(), recipient
+            Address(args["lottery"].as<std::string>()), args["chainid"].as<unsigned>(), recipient,
+            args["journal"].as<std::string>()
         );
     }());
 
-    auto egress([&]() -> S<Egress> {
+    auto egresses([&]() -> std::vector<S<Egress>> {
         if (args.count("ovpn-file") != 0) {
             std::string ovpnfile;
             boost::filesystem::load_string_file(args["ovpn-file"].as<std::string>(), ovpnfile);
 
-            auto username(args["ovpn-user"].as<std::string>());
-            auto password(args["ovpn-pass"].as<std::string>());
-
-            return Wait([origin, ovpnfile = std::move(ovpnfile), username = std::move(username), password = std::move(password)]() mutable -> task<S<Egress>> {
-                auto egress(Make<Sink<Egress>>(0));
-                co_await Connect(egress.get(), std::move(origin), 0, ovpnfile, username, password);
-                co_return egress;
-            }());
+            const auto username(args["ovpn-user"].as<std::string>());
+            const auto password(args["ovpn-pass"].as<std::string>());
+
+            const auto shards(args["egress-shards"].as<unsigned>());
+            orc_assert(shards != 0);
+            // the pace is shared out evenly, as are the flows
+            const auto rate(args["egress-rate"].as<uint64_t>() / shards);
+
+            std::vector<S<Egress>> egresses;
+            for (unsigned shard(0); shard != shards; ++shard)
+                egresses.emplace_back(Wait([&, shard]() -> task<S<Egress>> {
+                    auto egress(Make<Sink<Egress>>(0, Egress::Timeouts(), shard, shards));
+                    Sunk<> *sunk(egress.get());
+                    if (rate != 0)
+                        sunk = egress->Wire<Sink<Aqm>>(rate);
+                    co_await Connect(sunk, origin, 0, ovpnfile, username, password);
+                    co_return egress;
+                }()));
+            return egresses;
         } else orc_assert(false);
     }());
 
-    const auto node(Make<Node>(std::move(origin), std::move(cashier), std::move(egress), std::move(ice)));
+    auto fair(Make<Fair>(args["egress-width"].as<unsigned>(), args["egress-quantum"].as<size_t>(), args["session-backlog"].as<size_t>(), args["rate-horizon"].as<unsigned>(), args["rate-floor"].as<uint64_t>()));
+
+    Governor::Load budget;
+    budget.cpu_ = args["max-cpu"].as<double>();
+    budget.lag_ = std::chrono::milliseconds(args["max-lag"].as<unsigned>());
+    budget.memory_ = args["max-memory"].as<size_t>() * 1024 * 1024;
+    budget.egress_ = args["max-egress"].as<size_t>();
+    auto governor(Make<Governor>(budget, fair));
+    governor->Open();
+
+    Invoicer::Policy invoicing;
+    invoicing.threshold_ = args["invoice-threshold"].as<size_t>();
+    invoicing.interval_ = std::chrono::milliseconds(args["invoice-interval"].as<unsigned>());
+    invoicing.budget_ = std::chrono::milliseconds(args["invoice-budget"].as<unsigned>());
+
+    const auto node(Make<Node>(std::move(origin), std::move(cashier), std::move(egresses), std::move(fair), std::move(governor), std::move(configuration), args.count("early") != 0, args["negotiations"].as<unsigned>(), args["replay-window"].as<unsigned>(), invoicing, args["session-memory"].as<size_t>() * 1024));
+    // Watch reaps the gateways that Listen adds, so they must all be there first
+    if (args.count("dtls") != 0)
+        node->Listen(Socket(asio::ip::make_address(args["bind"].as<std::string>()), args["dtls"].as<uint16_t>()), certificate, false, args["udp-idle"].as<unsigned>());
+    if (args.count("utp") != 0)
+        node->Listen(Socket(asio::ip::make_address(args["bind"].as<std::string>()), args["utp"].as<uint16_t>()), certificate, true, args["udp-idle"].as<unsigned>());
+    node->Watch(args["memory-report"].as<unsigned>());
     node->Run(asio::ip::make_address(args["bind"].as<std::string>()), port, path, key, chain, params);
     return 0;
 }
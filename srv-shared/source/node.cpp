@@ -20,12 +20,174 @@
 /* }}} */
 
 
+#include <algorithm>
+
 #include "baton.hpp"
 #include "beast.hpp"
+#include "channel.hpp"
+#include "dtls.hpp"
 #include "node.hpp"
+#include "sleep.hpp"
+#include "utp.hpp"
 
 namespace orc {
 
+// code runs on the Pool, and the response is sent from the asio thread; so an
+// http handler returns at once, however long the negotiation takes
+template <typename Request_, typename Context_, typename Code_>
+static void Defer(Request_ request, Context_ context, Code_ code) {
+    Spawn([request = std::move(request), context = std::move(context), code = std::move(code)]() mutable noexcept -> task<void> {
+        std::string body;
+        const auto failed(orc_ignore({ body = co_await code(); }));
+        asio::post(Context(), [request = std::move(request), context = std::move(context), body = std::move(body), failed]() mutable {
+            if (failed)
+                Respond(context, request, "text/plain", "", boost::beast::http::status::not_found);
+            else
+                Respond(context, request, "text/plain", std::move(body));
+        });
+    });
+}
+
+task<std::string> Node::Answer(const std::string &offer) {
+    // XXX: look up fingerprint
+    const auto fingerprint(std::to_string(fingerprint_++));
+    const auto server(Find(fingerprint));
+    auto answer(co_await server->Respond(offer, configuration_, early_));
+
+    // a complete answer says so, and the client then doesn't ask for the rest
+    if (!early_)
+        answer += "a=end-of-candidates\r\n";
+    else {
+        const auto locked(locked_());
+        auto &trickles(locked->trickles_);
+        for (auto trickle(trickles.begin()); trickle != trickles.end(); )
+            if (trickle->second.expired())
+                trickle = trickles.erase(trickle);
+            else
+                ++trickle;
+        trickles[Fragment(answer)] = server;
+    }
+
+    Log() << std::endl;
+    Log() << "^^^^^^^^^^^^^^^^" << std::endl;
+    Log() << offer << std::endl;
+    Log() << "================" << std::endl;
+    Log() << answer << std::endl;
+    Log() << "vvvvvvvvvvvvvvvv" << std::endl;
+    Log() << std::endl;
+
+    co_return answer;
+}
+
+void Node::Audit(size_t top) {
+    std::vector<std::tuple<size_t, std::string, S<Server>>> sessions;
+    servers_.Each([&](const std::string &fingerprint, const S<Server> &server) {
+        sessions.emplace_back(server->Memory(), fingerprint, server);
+    });
+
+    size_t total(0);
+    for (const auto &[memory, fingerprint, server] : sessions) {
+        total += memory;
+        if (memory_ != 0 && memory > memory_) {
+            Log() << "session " << fingerprint << " evicted holding " << memory << " bytes" << std::endl;
+            server->Evict();
+        }
+    }
+
+    if (top == 0)
+        return;
+
+    top = std::min(top, sessions.size());
+    std::partial_sort(sessions.begin(), sessions.begin() + top, sessions.end(), [](const auto &lhs, const auto &rhs) {
+        return std::get<0>(lhs) > std::get<0>(rhs);
+    });
+
+    Log() << "memory: " << total << " bytes in " << sessions.size() << " sessions" << std::endl;
+    for (size_t i(0); i != top; ++i) {
+        const auto &[memory, fingerprint, server] = sessions[i];
+        Log() << "  " << fingerprint << ": " << memory << " bytes, " << server->Refused() << " packets refused" << std::endl;
+    }
+
+    for (size_t i(0); i != egresses_.size(); ++i) {
+        const auto &egress(egresses_[i]);
+        Log() << "egress " << i << " ports: " << egress->Used() << " in use, " << egress->Cooling() << " cooling down, " << egress->Exhausted() << " times exhausted" << std::endl;
+        const auto expired(egress->Expiries());
+        Log() << "egress " << i << " translations: " << egress->Size() << ", " << expired.udp_ << " udp, " << expired.icmp_ << " icmp and " << expired.tcp_ << " tcp (" << expired.closed_ << " closed) expired" << std::endl;
+    }
+}
+
+void Node::Watch(unsigned report, size_t top) {
+    Spawn([this, report, top]() noexcept -> task<void> {
+        for (unsigned second(1); ; ++second) {
+            co_await Sleep(1);
+            for (const auto &egress : egresses_)
+                orc_ignore({ egress->Expire(); });
+            for (const auto &gateway : gateways_)
+                orc_ignore({ gateway->Reap(); });
+            orc_ignore({ Audit(report != 0 && second % report == 0 ? top : 0); });
+        }
+    });
+}
+
+void Node::Listen(const Socket &local, const rtc::scoped_refptr<rtc::RTCCertificate> &certificate, bool utp, unsigned idle) {
+    auto gateway(std::make_unique<Gateway>([this, certificate, utp](Gateway *gateway, const Socket &remote, Beam &beam) -> Lane * {
+        // only a ClientHello (a dtls handshake record) or a utp ST_SYN gets to create a server
+        if (beam.size() == 0 || beam.data()[0] != (utp ? 0x41 : 22))
+            return nullptr;
+
+        // a ClientHello must first prove it comes from remote, by sending back a cookie
+        if (!utp) {
+            Beam reply;
+            if (!cookies_.Check(remote, beam, reply)) {
+                if (reply.size() != 0)
+                    Spawn([gateway, remote, reply = std::move(reply)]() noexcept -> task<void> {
+                        orc_ignore({ co_await gateway->Send(reply, remote); });
+                    });
+                return nullptr;
+            }
+        }
+
+        // there is no way to say why over dtls; the client will retry as if it were lost
+        if (!governor_->Admit())
+            return nullptr;
+
+        std::ostringstream fingerprint;
+        fingerprint << (utp ? "utp " : "dtls ") << remote;
+        const auto server(Find(fingerprint.str()));
+        remotes_.Insert(remote, server);
+
+        const auto bonding(server->Bond());
+        const auto dtls(bonding->Wire<Sink<Dtls>>(certificate));
+
+        const auto reap([weak = W<Server>(server)]() {
+            if (const auto server = weak.lock())
+                server->Evict();
+        });
+
+        if (!utp) {
+            const auto lane(dtls->Wire<Lane>(gateway, remote));
+            lane->reap_ = reap;
+            Spawn([server, bonding, dtls]() noexcept -> task<void> {
+                if (!orc_ignore({ co_await dtls->Open(); }))
+                    co_await server->Open(bonding);
+            });
+            return lane;
+        }
+
+        const auto stream(dtls->Wire<Sink<Utp>>(true));
+        const auto lane(stream->Wire<Lane>(gateway, remote));
+        lane->reap_ = reap;
+        Spawn([server, bonding, dtls, stream]() noexcept -> task<void> {
+            if (!orc_ignore({ co_await stream->Open(); co_await dtls->Open(); }))
+                co_await server->Open(bonding);
+        });
+        return lane;
+    }, idle));
+
+    gateway->Open(local);
+    gateways_.emplace_back(std::move(gateway));
+}
+
 void Node::Run(const asio::ip::address &bind, uint16_t port, const std::string &path, const std::string &key, const std::string &chain, const std::string &params) {
     boost::asio::ssl::context context{boost::asio::ssl::context::tlsv12};
 
@@ -45,24 +207,51 @@ void Node::Run(const asio::ip::address &bind, uint16_t port, const std::string &
     router.post(path, [&](auto request, auto context) {
         Log() << request << std::endl;
 
+        // over budget, an offer is refused (saying why) before it costs a negotiation
+        if (!governor_->Admit()) {
+            Respond(context, request, "text/plain", governor_->Reason(), boost::beast::http::status::service_unavailable);
+            return;
+        }
+
+        // past the limit, a slow or malicious burst of offers is turned away instead of queued
+        if (negotiating_.fetch_add(1) >= limit_) {
+            --negotiating_;
+            Respond(context, request, "text/plain", "", boost::beast::http::status::service_unavailable);
+            return;
+        }
+
+        std::string offer(request.body());
+        Defer(std::move(request), std::move(context), [this, offer = std::move(offer)]() -> task<std::string> {
+            try {
+                auto answer(co_await Answer(offer));
+                --negotiating_;
+                co_return answer;
+            } catch (...) {
+                --negotiating_;
+                throw;
+            }
+        });
+    });
+
+    // the remaining candidates of an early answer: GET <path>?ice=<ice-ufrag>
+    router.get(path + R"(\?ice=.*)", [&](auto request, auto context) {
         try {
-            const auto offer(request.body());
-            // XXX: look up fingerprint
-
-            static int fingerprint_(0);
-            std::string fingerprint(std::to_string(fingerprint_++));
-            const auto server(Find(fingerprint));
-            const auto answer(Wait(server->Respond(offer, ice_)));
-
-            Log() << std::endl;
-            Log() << "^^^^^^^^^^^^^^^^" << std::endl;
-            Log() << offer << std::endl;
-            Log() << "================" << std::endl;
-            Log() << answer << std::endl;
-            Log() << "vvvvvvvvvvvvvvvv" << std::endl;
-            Log() << std::endl;
-
-            Respond(context, request, "text/plain", answer);
+            const std::string target(request.target());
+            const auto fragment(target.substr(target.find("?ice=") + 5));
+
+            const auto server([&]() {
+                const auto locked(locked_());
+                const auto trickle(locked->trickles_.find(fragment));
+                orc_assert(trickle != locked->trickles_.end());
+                auto server(trickle->second.lock());
+                locked->trickles_.erase(trickle);
+                return server;
+            }());
+
+            orc_assert(server != nullptr);
+            Defer(std::move(request), std::move(context), [server]() -> task<std::string> {
+                co_return co_await server->Trickle();
+            });
         } catch (...) {
             Respond(context, request, "text/plain", "", boost::beast::http::status::not_found);
         }
@@ -23,13 +23,18 @@
 #ifndef ORCHID_NODE_HPP
 #define ORCHID_NODE_HPP
 
+#include <atomic>
 #include <vector>
 
 #include "cashier.hpp"
+#include "dtls.hpp"
 #include "egress.hpp"
+#include "gateway.hpp"
+#include "governor.hpp"
 #include "jsonrpc.hpp"
 #include "locator.hpp"
 #include "server.hpp"
+#include "sessions.hpp"
 
 namespace orc {
 
@@ -37,34 +42,92 @@ class Node final {
   private:
     const S<Origin> origin_;
     const S<Cashier> cashier_;
-    const S<Egress> egress_;
-    const std::vector<std::string> ice_;
+    // shards of the egress, each with a thread of its own
+    const std::vector<S<Egress>> egresses_;
+    const S<Fair> fair_;
+    const S<Governor> governor_;
+    const Configuration configuration_;
+    const bool early_;
+
+    // offers currently being answered, including their ICE gathering
+    const unsigned limit_;
+    std::atomic<unsigned> negotiating_ = 0;
+
+    // seconds for which each session remembers the tickets it accepted
+    const unsigned window_;
+    const Invoicer::Policy invoicing_;
+    // bytes each session can hold before it is let go (0 = unchecked)
+    const size_t memory_;
+
+    std::atomic<uint64_t> fingerprint_ = 0;
+    Sessions<std::string, Server> servers_;
+    // the same sessions, by where a dtls/utp one comes from, and by who pays for it
+    Sessions<Socket, Server> remotes_;
+    Sessions<Address, Server> payers_;
 
     struct Locked_ {
-        std::map<std::string, W<Server>> servers_;
+        // keyed by the ice-ufrag of an early answer
+        std::map<std::string, W<Server>> trickles_;
     }; Locked<Locked_> locked_;
 
+    std::vector<U<Gateway>> gateways_;
+    const Cookies cookies_;
+
+    task<std::string> Answer(const std::string &offer);
+
   public:
-    Node(S<Origin> origin, S<Cashier> cashier, S<Egress> egress, std::vector<std::string> ice) :
+    Node(S<Origin> origin, S<Cashier> cashier, std::vector<S<Egress>> egresses, S<Fair> fair, S<Governor> governor, Configuration configuration, bool early = false, unsigned limit = 64, unsigned window = 60, const Invoicer::Policy &invoicing = {}, size_t memory = 0) :
         origin_(std::move(origin)),
         cashier_(std::move(cashier)),
-        egress_(std::move(egress)),
-        ice_(std::move(ice))
+        egresses_(std::move(egresses)),
+        fair_(std::move(fair)),
+        governor_(std::move(governor)),
+        configuration_(std::move(configuration)),
+        early_(early),
+        limit_(limit),
+        window_(window),
+        invoicing_(invoicing),
+        memory_(memory)
     {
     }
 
     S<Server> Find(const std::string &fingerprint) {
-        const auto locked(locked_());
-        auto &cache(locked->servers_[fingerprint]);
-        if (auto server = cache.lock())
+        return servers_.Find(fingerprint, [&]() {
+            const auto server(Break<Sink<Server>>(origin_, cashier_, fair_, window_, invoicing_, memory_));
+            const auto translator(server->Wire<Translator>(egresses_));
+            server->wired_ = [translator]() { return translator->Memory(); };
+            server->self_ = server;
+            server->payer_ = [this, weak = W<Server>(server)](const Address &signer) {
+                if (const auto server = weak.lock())
+                    payers_.Insert(signer, server);
+            };
             return server;
-        const auto server(Break<Sink<Server>>(origin_, cashier_));
-        server->Wire<Translator>(egress_);
-        server->self_ = server;
-        cache = server;
-        return server;
+        });
+    }
+
+    S<Server> Remote(const Socket &remote) {
+        return remotes_.Find(remote);
+    }
+
+    std::vector<S<Server>> Paid(const Address &signer) {
+        return payers_.All(signer);
     }
 
+    template <typename Code_>
+    void Each(Code_ &&code) {
+        servers_.Each([&](const std::string &fingerprint, const S<Server> &server) {
+            code(server);
+        });
+    }
+
+    // lets go of sessions over their memory budget, and every report (0 = never) seconds logs the top ones by it;
+    // Watch also expires the idle translations of the egresses (and reaps the idle lanes of the gateways) each second
+    void Audit(size_t top);
+    void Watch(unsigned report, size_t top = 8);
+
+    // plain dtls sessions on a udp port; with utp, dtls is carried over a utp connection; sessions
+    // that receive nothing for idle (if not 0) seconds are let go
+    void Listen(const Socket &local, const rtc::scoped_refptr<rtc::RTCCertificate> &certificate, bool utp = false, unsigned idle = 120);
     void Run(const asio::ip::address &bind, uint16_t port, const std::string &path, const std::string &key, const std::string &chain, const std::string &params);
 };
 
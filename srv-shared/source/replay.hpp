@@ -0,0 +1,107 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_REPLAY_HPP
+#define ORCHID_REPLAY_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace orc {
+
+// remembers which tickets a session accepted in the last window seconds (by
+// their issued timestamp) in fixed memory: older or future tickets are refused
+// outright, and recent ones are kept as 32-bit fingerprints in an open-addressed
+// table, where a slot whose ticket has aged out of the window is free again.
+// as many tickets share a second, the window is over time, not a sequence.
+template <size_t Slots_ = 4096, size_t Probes_ = 32>
+class Replay {
+  private:
+    struct Slot {
+        uint32_t fingerprint_;
+        uint32_t issued_;
+    };
+
+    static_assert((Slots_ & (Slots_ - 1)) == 0);
+    std::array<Slot, Slots_> slots_{};
+
+    const uint32_t window_;
+
+    uint64_t refused_ = 0;
+    uint64_t saturated_ = 0;
+
+    bool Expired(const Slot &slot, uint32_t now) const {
+        return slot.fingerprint_ == 0 || slot.issued_ + window_ < now;
+    }
+
+  public:
+    Replay(uint32_t window) :
+        window_(window)
+    {
+    }
+
+    // true (and remembered) for a ticket that is in the window and wasn't seen before
+    bool operator ()(uint32_t now, uint32_t issued, uint64_t fingerprint) {
+        if (issued + window_ < now || issued > now + window_) {
+            ++refused_;
+            return false;
+        }
+
+        fingerprint = (fingerprint ^ fingerprint >> 29) * 0xbf58476d1ce4e5b9ULL;
+        // zero marks an empty slot
+        const auto check(uint32_t(fingerprint >> 32) | 1);
+
+        Slot *free(nullptr);
+        for (size_t i(0); i != Probes_; ++i) {
+            auto &slot(slots_[(fingerprint + i) & (Slots_ - 1)]);
+            if (Expired(slot, now)) {
+                if (free == nullptr)
+                    free = &slot;
+            } else if (slot.fingerprint_ == check && slot.issued_ == issued) {
+                ++refused_;
+                return false;
+            }
+        }
+
+        // can't prove it's new, so it's refused; the client pays again later
+        if (free == nullptr) {
+            ++saturated_;
+            return false;
+        }
+
+        free->fingerprint_ = check;
+        free->issued_ = issued;
+        return true;
+    }
+
+    uint64_t Refused() const {
+        return refused_;
+    }
+
+    uint64_t Saturated() const {
+        return saturated_;
+    }
+};
+
+}
+
+#endif//ORCHID_REPLAY_HPP
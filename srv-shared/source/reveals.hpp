@@ -0,0 +1,117 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_REVEALS_HPP
+#define ORCHID_REVEALS_HPP
+
+#include <deque>
+#include <unordered_map>
+
+#include "crypto.hpp"
+#include "jsonrpc.hpp"
+
+namespace orc {
+
+// the reveals behind a session's commitments: the current one, and those it
+// replaced within the last retention seconds (for tickets that were already on
+// their way); anything older is dropped as commitments are made, so this stays
+// the size of a few commitments however long the session lives
+class Reveals {
+  private:
+    struct Spread {
+        size_t operator ()(const Bytes32 &commit) const {
+            // commitments are hashes already
+            return Subset(commit.data(), sizeof(size_t)).num<size_t>();
+        }
+    };
+
+    struct Reveal {
+        Bytes32 reveal_;
+        // zero for the current commitment; otherwise when it was replaced
+        uint64_t retired_;
+    };
+
+    const uint64_t retention_;
+
+    std::unordered_map<Bytes32, Reveal, Spread> reveals_;
+    std::deque<Bytes32> retired_;
+    Bytes32 current_;
+
+    void Expire(uint64_t now) {
+        while (!retired_.empty()) {
+            const auto reveal(reveals_.find(retired_.front()));
+            if (reveal != reveals_.end()) {
+                if (reveal->second.retired_ + retention_ > now)
+                    break;
+                reveals_.erase(reveal);
+            }
+            retired_.pop_front();
+        }
+    }
+
+  public:
+    Reveals(uint64_t retention) :
+        retention_(retention)
+    {
+    }
+
+    void Commit(uint64_t now, const Bytes32 &reveal) {
+        Expire(now);
+        if (!reveals_.empty()) {
+            reveals_.at(current_).retired_ = now;
+            retired_.push_back(current_);
+        }
+        current_ = Hash(reveal);
+        reveals_.try_emplace(current_, Reveal{reveal, 0});
+    }
+
+    const Bytes32 &Current() const {
+        return current_;
+    }
+
+    // nullptr if commit is unknown or expired
+    const Bytes32 *Find(const Bytes32 &commit, uint64_t now) const {
+        const auto reveal(reveals_.find(commit));
+        if (reveal == reveals_.end())
+            return nullptr;
+        const auto retired(reveal->second.retired_);
+        if (retired != 0 && retired + retention_ <= now)
+            return nullptr;
+        return &reveal->second.reveal_;
+    }
+
+    size_t Size() const {
+        return reveals_.size();
+    }
+
+    // roughly, in bytes, including the hash table's buckets
+    size_t Memory() const {
+        return sizeof(*this) +
+            reveals_.size() * (sizeof(Bytes32) + sizeof(Reveal) + 2 * sizeof(void *)) +
+            reveals_.bucket_count() * sizeof(void *) +
+            retired_.size() * sizeof(Bytes32);
+    }
+};
+
+}
+
+#endif//ORCHID_REVEALS_HPP
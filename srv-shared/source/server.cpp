@@ -32,6 +32,8 @@
 #include "local.hpp"
 #include "protocol.hpp"
 #include "server.hpp"
+#include "sleep.hpp"
+#include "verifier.hpp"
 
 namespace orc {
 
@@ -41,17 +43,25 @@ class Incoming final :
   private:
     S<Incoming> self_;
   private:
-    S<Server> server_;
+    // the server's bondings hold the channels, which hold this
+    W<Server> server_;
 
   protected:
     void Land(rtc::scoped_refptr<webrtc::DataChannelInterface> interface) override {
-        auto bonding(server_->Bond());
+        const auto server(server_.lock());
+        if (server == nullptr)
+            return;
+
+        // a client opens a data channel and then a control one
+        const auto control(interface->label() == Control_);
+        auto bonding(server->Bond(control));
         auto channel(bonding->Wire<Channel>(shared_from_this(), interface));
 
-        Spawn([bonding, channel = std::move(channel), server = std::move(server_)]() noexcept -> task<void> {
+        Spawn([bonding, channel = std::move(channel), server, control]() noexcept -> task<void> {
             co_await channel->Open();
             // XXX: this could fail; then what?
-            co_await server->Open(bonding);
+            if (control)
+                co_await server->Open(bonding);
         });
     }
 
@@ -60,12 +70,10 @@ class Incoming final :
     }
 
   public:
-    Incoming(S<Server> server, const S<Origin> &origin, rtc::scoped_refptr<rtc::RTCCertificate> local, std::vector<std::string> ice) :
+    Incoming(S<Server> server, const S<Origin> &origin, rtc::scoped_refptr<rtc::RTCCertificate> local, Configuration configuration) :
         Peer(origin, [&]() {
-            Configuration configuration;
             configuration.tls_ = std::move(local);
-            configuration.ice_ = std::move(ice);
-            return configuration;
+            return std::move(configuration);
         }()),
         server_(std::move(server))
     {
@@ -88,33 +96,61 @@ bool Server::Bill(const Buffer &data, bool force) {
     if (cashier_ == nullptr)
         return true;
 
-    const auto amount(cashier_->Bill(data.size()));
-    const auto floor(cashier_->Bill(128*1024));
-
-    S<Server> self;
+    static const auto floor(Balance::Cost(128*1024));
 
-    const auto locked(locked_());
-    if (!force && locked->balance_ < amount)
+    Fixed balance;
+    if (!balance_.Debit(Balance::Cost(data.size()), force, balance))
         return false;
+    billed_.fetch_add(data.size(), std::memory_order_relaxed);
+    flow_.Fund(balance);
 
-    locked->balance_ -= amount;
-    ++locked->serial_;
+    //Log() << "balance- = " << balance << " [floor: " << floor << "]" << std::endl;
 
-    //Log() << "balance- = " << locked->balance_ << " [floor: " << floor << "]" << std::endl;
-
-    if (locked->balance_ >= -floor)
+    if (balance >= -floor)
         return true;
-    std::swap(self, self_);
+
+    Evict();
     return false;
 }
 
+void Server::Evict() {
+    S<Server> self;
+    {
+        const auto locked(locked_());
+        std::swap(self, self_);
+    }
+}
+
+void Server::Refund(const Buffer &data) {
+    if (cashier_ == nullptr)
+        return;
+    flow_.Fund(balance_.Credit(Balance::Cost(data.size())));
+    billed_.fetch_sub(data.size(), std::memory_order_relaxed);
+}
+
+// a packet is only billed once it has its turn, and is refunded if it then isn't sent;
+// one that is forced (as control traffic is) is never shed by flow_ either
 task<void> Server::Send(Pipe *pipe, const Buffer &data, bool force) {
-    if (Bill(data, force))
-        co_return co_await pipe->Send(data);
+    if (!co_await flow_.Wait(data.size(), force))
+        co_return;
+    if (!Bill(data, force))
+        co_return flow_.Done();
+    try {
+        co_await pipe->Send(data);
+    } catch (...) {
+        flow_.Done();
+        Refund(data);
+        throw;
+    }
+    flow_.Done();
 }
 
 void Server::Send(Pipe *pipe, const Buffer &data) {
-    nest_.Hatch([&]() noexcept { return [this, pipe, data = Beam(data)]() -> task<void> {
+    // over budget, this is dropped here as it would be by a full queue
+    auto hold(footprint_.Take(data.size()));
+    if (!hold)
+        return;
+    nest_.Hatch([&]() noexcept { return [this, pipe, data = Beam(data), hold = std::move(hold)]() -> task<void> {
         co_return co_await Send(pipe, data, false); }; });
 }
 
@@ -123,23 +159,42 @@ task<void> Server::Send(const Buffer &data) {
 }
 
 void Server::Commit(const Lock<Locked_> &locked) {
-    const auto reveal(Random<32>());
-    if (locked->commit_ != locked->reveals_.end())
-        locked->commit_->second.second = Timestamp();
-    locked->commit_ = locked->reveals_.try_emplace(Hash(reveal), reveal, 0).first;
+    locked->reveals_.Commit(uint64_t(Timestamp()), Random<32>());
 }
 
-task<void> Server::Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Float &balance, const Bytes32 &commit) {
+task<void> Server::Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, Fixed balance, const Bytes32 &commit) {
     Header header{Magic_, id};
-    co_await Send(pipe, Datagram(Port_, destination, Tie(header,
+    const auto invoice(Datagram(Port_, destination, Tie(header,
         Command(Stamp_, Monotonic()),
         Command(Invoice_, serial, cashier_->Convert(balance), cashier_->Tuple(), commit)
-    )), true);
+    )));
+    // control traffic doesn't wait its turn in (or get shed by) flow_
+    co_await pipe->Send(invoice);
+    // an invoice that failed to go out mustn't make a request for the same serial Skip
+    invoicer_.Sent(Invoicer::Clock_::now(), serial, balance, invoice.size());
+    Bill(invoice, true);
 }
 
 task<void> Server::Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id) {
-    const auto [serial, balance, commit] = [&]() { const auto locked(locked_());
-        return std::make_tuple(locked->serial_, locked->balance_, locked->commit_->first); }();
+    const auto [serial, balance] = balance_.Read();
+
+    Invoicer::Clock_::duration delay;
+    switch (invoicer_(Invoicer::Clock_::now(), serial, balance, !id.zero(), delay)) {
+        case Invoicer::Send:
+            break;
+        case Invoicer::Defer:
+            nest_.Hatch([&]() noexcept { return [this, pipe, destination, delay]() -> task<void> {
+                co_await Sleep(std::chrono::duration_cast<std::chrono::milliseconds>(delay));
+                const auto [serial, balance] = balance_.Read();
+                if (invoicer_.Flush(serial))
+                    co_await Invoice(pipe, destination, Zero<32>(), serial, balance, locked_()->reveals_.Current());
+            }; });
+            co_return;
+        case Invoicer::Skip:
+            co_return;
+    }
+
+    const auto commit(locked_()->reveals_.Current());
     co_await Invoice(pipe, destination, id, serial, balance, commit);
 }
 
@@ -178,44 +233,39 @@ task<void> Server::Submit(Pipe<Buffer> *pipe, const Bytes32 &id, const Buffer &d
     using Ticket = Coder<Bytes32, Bytes32, uint256_t, Bytes32, Address, uint256_t, uint128_t, uint128_t, uint256_t, uint128_t, Address, Address, Bytes>;
     static const auto orchid(Hash("Orchid.grab"));
     const auto ticket(Hash(Ticket::Encode(orchid, commit, issued, nonce, lottery, chain, amount, ratio, start, range, funder, recipient, receipt)));
-    const Address signer(Recover(Hash(Tie(Strung<std::string>("\x19""Ethereum Signed Message:\n32"), ticket)), v, r, s));
+    const auto signer(co_await Verifier::Get().Recover(Hash(Tie(Strung<std::string>("\x19""Ethereum Signed Message:\n32"), ticket)), Signature(r, s, v)));
 
     co_await cashier_->Check(signer, funder, amount, recipient, receipt);
 
     const auto [reveal, balance, winner] = [&, commit = commit, issued = issued, nonce = nonce, ratio = ratio]() {
         const auto locked(locked_());
 
-        orc_assert(issued >= locked->issued_);
-        auto &nonces(locked->nonces_);
-        orc_assert(nonces.emplace(issued, nonce, signer).second);
-        while (nonces.size() > horizon_) {
-            const auto oldest(nonces.begin());
-            orc_assert(oldest != nonces.end());
-            locked->issued_ = std::get<0>(*oldest) + 1;
-            nonces.erase(oldest);
-        }
+        // the nonce is random, so a little of it (and of the signer) tells tickets apart
+        orc_assert(locked->replay_(uint32_t(now), uint32_t(issued), Subset(nonce.data(), 8).num<uint64_t>() ^ uint64_t(signer & uint160_t(~uint64_t(0)))));
 
         const auto reveal([&]() {
-            const auto reveal(locked->reveals_.find(commit));
-            orc_assert(reveal != locked->reveals_.end());
-            const auto expire(reveal->second.second);
-            orc_assert(expire == 0 || reveal->second.second + 60 > now);
-            return reveal->second.first;
+            const auto reveal(locked->reveals_.Find(commit, uint64_t(now)));
+            orc_assert(reveal != nullptr);
+            return *reveal;
         }());
 
-        locked->balance_ += credit;
-        ++locked->serial_;
+        const auto balance(balance_.Credit(credit));
+        credited_.fetch_add(credit, std::memory_order_relaxed);
+        invoicer_.Credited(credit);
 
         // NOLINTNEXTLINE (clang-analyzer-core.UndefinedBinaryOperatorResult)
         const auto winner(Hash(Tie(reveal, issued, nonce)).skip<16>().num<uint128_t>() <= ratio);
-        if (winner && locked->commit_->first == commit)
+        if (winner && locked->reveals_.Current() == commit)
             Commit(locked);
 
-        return std::make_tuple(reveal, locked->balance_, winner);
+        return std::make_tuple(reveal, balance, winner);
     }();
 
     //Log() << "balance+ = " << balance << std::endl;
 
+    if (payer_ != nullptr)
+        payer_(signer);
+
     if (winner) {
         std::vector<Bytes32> old;
 
@@ -248,7 +298,11 @@ void Server::Land(Pipe<Buffer> *pipe, const Buffer &data) {
         if (cashier_ == nullptr)
             return true;
 
-        nest_.Hatch([&]() noexcept { return [this, source, data = Beam(data)]() -> task<void> {
+        auto hold(footprint_.Take(data.size()));
+        if (!hold)
+            return true;
+
+        nest_.Hatch([&]() noexcept { return [this, source, data = Beam(data), hold = std::move(hold)]() -> task<void> {
             const auto [header, window] = Take<Header, Window>(data);
             const auto &[magic, id] = header;
             orc_assert(magic == Magic_);
@@ -259,7 +313,7 @@ void Server::Land(Pipe<Buffer> *pipe, const Buffer &data) {
                     co_await Submit(this, id, window);
             } orc_catch({}) });
 
-            co_await Invoice(this, source, id);
+            co_await Invoice(&control_, source, id);
         }; });
 
         return true;
@@ -278,10 +332,15 @@ void Server::Land(const Buffer &data) {
 void Server::Stop(const std::string &error) noexcept {
 }
 
-Server::Server(S<Origin> origin, S<Cashier> cashier) :
+Server::Server(S<Origin> origin, S<Cashier> cashier, S<Fair> fair, unsigned window, const Invoicer::Policy &invoicing, size_t memory) :
     local_(Certify()),
+    control_(this),
     origin_(std::move(origin)),
-    cashier_(std::move(cashier))
+    cashier_(std::move(cashier)),
+    footprint_(memory / 2),
+    flow_(std::move(fair)),
+    invoicer_(invoicing),
+    locked_(std::in_place, window)
 {
     type_ = typeid(*this).name();
 
@@ -293,9 +352,19 @@ Server::~Server() {
     _trace();
 }
 
+size_t Server::Memory() const {
+    const auto retained([&]() {
+        const auto locked(locked_());
+        return locked->reveals_.Memory();
+    }());
+    // the channels the client reached this over, and what waits in their rings
+    const auto incoming(incoming_.lock());
+    return sizeof(*this) + retained + footprint_.Held() + (wired_ == nullptr ? 0 : wired_()) + (incoming == nullptr ? 0 : incoming->Held());
+}
+
 task<void> Server::Open(Pipe<Buffer> *pipe) {
     if (cashier_ != nullptr)
-        co_await Invoice(pipe, Port_, Zero<32>());
+        co_await Invoice(&control_, Port_, Zero<32>());
 }
 
 task<void> Server::Shut() noexcept {
@@ -304,13 +373,20 @@ task<void> Server::Shut() noexcept {
     co_await nest_.Shut();
 }
 
-task<std::string> Server::Respond(const std::string &offer, std::vector<std::string> ice) {
-    auto incoming(Incoming::Create(self_, origin_, local_, std::move(ice)));
-    auto answer(co_await incoming->Answer(offer));
+task<std::string> Server::Respond(const std::string &offer, Configuration configuration, bool early) {
+    auto incoming(Incoming::Create(self_, origin_, local_, std::move(configuration)));
+    incoming_ = incoming;
+    auto answer(co_await incoming->Answer(offer, early));
     co_return answer;
     co_return Filter(true, answer);
 }
 
+task<std::string> Server::Trickle() {
+    const auto incoming(incoming_.lock());
+    orc_assert(incoming != nullptr);
+    co_return co_await incoming->Trickle();
+}
+
 std::string Filter(bool answer, const std::string &serialized) {
     webrtc::JsepSessionDescription jsep(answer ? webrtc::SdpType::kAnswer : webrtc::SdpType::kOffer);
     webrtc::SdpParseError error;
@@ -23,22 +23,28 @@
 #ifndef ORCHID_SERVER_HPP
 #define ORCHID_SERVER_HPP
 
-#include <map>
-#include <set>
 
 #include <rtc_base/rtc_certificate.h>
 
+#include "balance.hpp"
 #include "bond.hpp"
+#include "channel.hpp"
+#include "fair.hpp"
+#include "footprint.hpp"
+#include "invoicer.hpp"
 #include "jsonrpc.hpp"
 #include "link.hpp"
 #include "locked.hpp"
 #include "nest.hpp"
+#include "replay.hpp"
+#include "reveals.hpp"
 #include "shared.hpp"
 #include "task.hpp"
 
 namespace orc {
 
 class Cashier;
+class Incoming;
 
 class Server :
     public Bonded,
@@ -47,28 +53,61 @@ class Server :
 {
   public:
     S<Server> self_;
+    // told the signer of every ticket that was accepted
+    std::function<void (const Address &)> payer_;
+    // asked how much what this is wired to (its nat entries) holds for it
+    std::function<size_t ()> wired_;
   private:
     const rtc::scoped_refptr<rtc::RTCCertificate> local_;
 
+    class Control :
+        public Pipe<Buffer>
+    {
+      private:
+        Server *const server_;
+
+      public:
+        Control(Server *server) :
+            server_(server)
+        {
+        }
+
+        task<void> Send(const Buffer &data) override {
+            co_return co_await server_->Bonded::Send(data, true);
+        }
+    } control_;
+
     const S<Origin> origin_;
     const S<Cashier> cashier_;
 
     Nest nest_;
+    // packets and commands waiting in nest_
+    Footprint footprint_;
+    // this session's turn at sending, among all of them
+    Fair::Flow flow_;
 
-    static const size_t horizon_ = 10;
+    W<Incoming> incoming_;
 
-    struct Locked_ {
-        uint64_t serial_ = 0;
-        Float balance_ = 0;
+    // updated for every packet, so kept outside of locked_
+    Balance balance_;
+    std::atomic<uint64_t> billed_ = 0;
+    std::atomic<Fixed> credited_ = 0;
+    Invoicer invoicer_;
 
-        std::map<Bytes32, std::pair<Bytes32, uint256_t>> reveals_;
-        decltype(reveals_.end()) commit_ = reveals_.end();
-
-        uint256_t issued_ = 0;
-        std::set<std::tuple<uint256_t, Bytes32, Address>> nonces_;
+    struct Locked_ {
+        // a retired commitment lasts as long as a late ticket is still checked for replay
+        Reveals reveals_;
+        Replay<> replay_;
+
+        Locked_(unsigned window) :
+            reveals_(window),
+            replay_(window)
+        {
+        }
     }; Locked<Locked_> locked_;
 
     bool Bill(const Buffer &data, bool force);
+    void Refund(const Buffer &data);
 
     task<void> Send(Pipe *pipe, const Buffer &data, bool force);
     void Send(Pipe *pipe, const Buffer &data);
@@ -77,7 +116,7 @@ class Server :
 
     void Commit(const Lock<Locked_> &locked);
 
-    task<void> Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Float &balance, const Bytes32 &commit);
+    task<void> Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, Fixed balance, const Bytes32 &commit);
     task<void> Invoice(Pipe<Buffer> *pipe, const Socket &destination, const Bytes32 &id);
 
     task<void> Submit(Pipe<Buffer> *pipe, const Bytes32 &id, const Buffer &data);
@@ -92,13 +131,47 @@ class Server :
     void Stop(const std::string &error) noexcept override;
 
   public:
-    Server(S<Origin> origin, S<Cashier> cashier);
+    // window is how late (in seconds) a ticket can arrive and still be checked for replay;
+    // half of memory (0 = unchecked) is for packets waiting to be sent
+    Server(S<Origin> origin, S<Cashier> cashier, S<Fair> fair, unsigned window = 60, const Invoicer::Policy &invoicing = {}, size_t memory = 0);
     ~Server() override;
 
+    // lets go of this session, which is then shut once nothing else holds it
+    void Evict();
+
+    // bytes this session holds: for checking tickets, packets waiting and nat entries
+    size_t Memory() const;
+
+    // packets dropped as this session was over its budget
+    uint64_t Refused() const {
+        return footprint_.Refused();
+    }
+
+    auto Stats() {
+        return flow_.Stats();
+    }
+
+    // the balance, the bytes billed (net of refunds) and the total of the tickets accepted
+    std::tuple<Fixed, uint64_t, Fixed> Account() const {
+        return {std::get<1>(balance_.Read()), billed_.load(std::memory_order_relaxed), credited_.load(std::memory_order_relaxed)};
+    }
+
+    // invoices sent
+    uint64_t Invoices() const {
+        return std::get<1>(invoicer_.Stats());
+    }
+
+    // bytes of invoices per byte billed
+    double Overhead() const {
+        const auto billed(billed_.load(std::memory_order_relaxed));
+        return billed == 0 ? 0 : double(std::get<2>(invoicer_.Stats())) / billed;
+    }
+
     task<void> Open(Pipe<Buffer> *pipe);
     task<void> Shut() noexcept override;
 
-    task<std::string> Respond(const std::string &offer, std::vector<std::string> ice);
+    task<std::string> Respond(const std::string &offer, Configuration configuration, bool early = false);
+    task<std::string> Trickle();
 };
 
 std::string Filter(bool answer, const std::string &serialized);
@@ -0,0 +1,179 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SESSIONS_HPP
+#define ORCHID_SESSIONS_HPP
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "jsonrpc.hpp"
+#include "mix.hpp"
+#include "shared.hpp"
+#include "socket.hpp"
+
+namespace orc {
+
+// spreads session keys over shards (and their buckets)
+struct Spread {
+    size_t operator ()(const std::string &value) const {
+        return Mix(std::hash<std::string>()(value));
+    }
+
+    size_t operator ()(const Socket &value) const {
+        const in6_addr host(value.Host());
+        uint64_t words[2];
+        memcpy(words, host.s6_addr, sizeof(words));
+        return Mix(words[0] ^ Mix(words[1] ^ value.Port()));
+    }
+
+    size_t operator ()(const Address &value) const {
+        return Mix((value & uint160_t(~uint64_t(0))).convert_to<uint64_t>());
+    }
+};
+
+// sessions (held weakly) filed by key, in independently locked shards; a
+// key can have several sessions, and closed ones are swept out whenever a
+// shard doubles in size, so nothing ever has to unregister them
+template <typename Key_, typename Session_, size_t Shards_ = 16>
+class Sessions {
+  private:
+    struct Shard {
+        std::mutex mutex_;
+        std::unordered_multimap<Key_, W<Session_>, Spread> sessions_;
+        size_t sweep_ = 64;
+    };
+
+    std::array<Shard, Shards_> shards_;
+    std::atomic<uint64_t> swept_ = 0;
+
+    Shard &Get(const Key_ &key) {
+        return shards_[Spread()(key) % Shards_];
+    }
+
+    void Sweep(Shard &shard) {
+        auto &sessions(shard.sessions_);
+        for (auto session(sessions.begin()); session != sessions.end(); )
+            if (!session->second.expired())
+                ++session;
+            else {
+                session = sessions.erase(session);
+                swept_.fetch_add(1, std::memory_order_relaxed);
+            }
+        shard.sweep_ = std::max<size_t>(64, sessions.size() * 2);
+    }
+
+    static S<Session_> Live(Shard &shard, const Key_ &key) {
+        const auto range(shard.sessions_.equal_range(key));
+        for (auto session(range.first); session != range.second; ++session)
+            if (auto live = session->second.lock())
+                return live;
+        return nullptr;
+    }
+
+  public:
+    // the first live session filed under key, if any
+    S<Session_> Find(const Key_ &key) {
+        auto &shard(Get(key));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        return Live(shard, key);
+    }
+
+    // the live session under key, or else the one code makes; code runs under the
+    // shard's lock (so it must not use this table), as a session that lost a race to
+    // be made might already have been set up to keep itself alive
+    template <typename Code_>
+    S<Session_> Find(const Key_ &key, Code_ &&code) {
+        auto &shard(Get(key));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        if (auto session = Live(shard, key))
+            return session;
+        auto made(code());
+        shard.sessions_.emplace(key, made);
+        if (shard.sessions_.size() > shard.sweep_)
+            Sweep(shard);
+        return made;
+    }
+
+    // files session under key as well, unless it already is
+    void Insert(const Key_ &key, const S<Session_> &session) {
+        auto &shard(Get(key));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        const auto range(shard.sessions_.equal_range(key));
+        for (auto other(range.first); other != range.second; ++other)
+            if (other->second.lock() == session)
+                return;
+        shard.sessions_.emplace(key, session);
+        if (shard.sessions_.size() > shard.sweep_)
+            Sweep(shard);
+    }
+
+    std::vector<S<Session_>> All(const Key_ &key) {
+        std::vector<S<Session_>> all;
+        auto &shard(Get(key));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        const auto range(shard.sessions_.equal_range(key));
+        for (auto session(range.first); session != range.second; ++session)
+            if (auto live = session->second.lock())
+                all.emplace_back(std::move(live));
+        return all;
+    }
+
+    // one shard at a time, so this never stops the whole table
+    template <typename Code_>
+    void Each(Code_ &&code) {
+        for (auto &shard : shards_) {
+            std::vector<std::pair<Key_, S<Session_>>> live;
+            {
+                std::unique_lock<std::mutex> lock(shard.mutex_);
+                live.reserve(shard.sessions_.size());
+                for (const auto &[key, session] : shard.sessions_)
+                    if (auto locked = session.lock())
+                        live.emplace_back(key, std::move(locked));
+            }
+            for (const auto &[key, session] : live)
+                code(key, session);
+        }
+    }
+
+    // entries, including closed sessions not swept yet
+    size_t Size() {
+        size_t size(0);
+        for (auto &shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            size += shard.sessions_.size();
+        }
+        return size;
+    }
+
+    uint64_t Swept() const {
+        return swept_.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_SESSIONS_HPP
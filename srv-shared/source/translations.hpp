@@ -0,0 +1,287 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_TRANSLATIONS_HPP
+#define ORCHID_TRANSLATIONS_HPP
+
+#include <array>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "mix.hpp"
+
+namespace orc {
+
+// a fixed-size hash table for small, trivially copyable keys and values (such
+// as nat translations), in independently locked shards. each shard is one array
+// of slots, probed linearly and compacted on removal (so there are no
+// tombstones), through which an lru list is threaded by index; nothing is
+// allocated per entry. a full shard makes room by dropping its least recently
+// used entry, which is handed back so whatever depended on it can be undone
+template <typename Key_, typename Value_, typename Hash_, size_t Shards_ = 16>
+class Translations {
+  private:
+    static const uint32_t None_ = ~uint32_t(0);
+
+    struct Slot {
+        Key_ key_;
+        Value_ value_;
+        uint32_t hash_;
+        uint32_t older_;
+        uint32_t newer_;
+        bool used_;
+    };
+
+    struct Shard {
+        std::mutex mutex_;
+        std::vector<Slot> slots_;
+        uint32_t oldest_ = None_;
+        uint32_t newest_ = None_;
+        uint32_t size_ = 0;
+    };
+
+    const uint32_t mask_;
+    const uint32_t limit_;
+    std::array<Shard, Shards_> shards_;
+
+  public:
+    typedef std::pair<Key_, Value_> Entry;
+
+    // what each entry costs, as the table is sized for twice the entries
+    static const size_t Bytes_ = sizeof(Slot) * 2;
+
+  private:
+    static uint64_t Hash(const Key_ &key) {
+        return Mix(Hash_()(key));
+    }
+
+    Shard &Get(uint64_t hash) {
+        return shards_[(hash >> 32) % Shards_];
+    }
+
+    uint32_t Locate(Shard &shard, const Key_ &key, uint32_t hash) const {
+        for (auto index(hash & mask_); ; index = (index + 1) & mask_) {
+            const auto &slot(shard.slots_[index]);
+            if (!slot.used_)
+                return None_;
+            if (slot.hash_ == hash && slot.key_ == key)
+                return index;
+        }
+    }
+
+    void Unlink(Shard &shard, uint32_t index) {
+        auto &slot(shard.slots_[index]);
+        (slot.older_ == None_ ? shard.oldest_ : shard.slots_[slot.older_].newer_) = slot.newer_;
+        (slot.newer_ == None_ ? shard.newest_ : shard.slots_[slot.newer_].older_) = slot.older_;
+    }
+
+    void Append(Shard &shard, uint32_t index) {
+        auto &slot(shard.slots_[index]);
+        slot.older_ = shard.newest_;
+        slot.newer_ = None_;
+        (shard.newest_ == None_ ? shard.oldest_ : shard.slots_[shard.newest_].newer_) = index;
+        shard.newest_ = index;
+    }
+
+    void Touch(Shard &shard, uint32_t index) {
+        if (shard.newest_ == index)
+            return;
+        Unlink(shard, index);
+        Append(shard, index);
+    }
+
+    // moves the entry in from to the empty slot to, keeping its place in the lru
+    void Move(Shard &shard, uint32_t from, uint32_t to) {
+        auto &slot(shard.slots_[to]);
+        slot = shard.slots_[from];
+        (slot.older_ == None_ ? shard.oldest_ : shard.slots_[slot.older_].newer_) = to;
+        (slot.newer_ == None_ ? shard.newest_ : shard.slots_[slot.newer_].older_) = to;
+    }
+
+    Entry Remove(Shard &shard, uint32_t index) {
+        Entry entry(shard.slots_[index].key_, shard.slots_[index].value_);
+        Unlink(shard, index);
+        --shard.size_;
+
+        // shift back whatever follows that would no longer be found past the hole
+        auto hole(index);
+        for (auto next(index); ; ) {
+            next = (next + 1) & mask_;
+            const auto &slot(shard.slots_[next]);
+            if (!slot.used_)
+                break;
+            const auto home(slot.hash_ & mask_);
+            if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+                Move(shard, next, hole);
+                hole = next;
+            }
+        }
+
+        shard.slots_[hole].used_ = false;
+        return entry;
+    }
+
+  public:
+    // room for about capacity entries, spread evenly
+    Translations(size_t capacity) :
+        mask_([&]() {
+            uint32_t slots(64);
+            while (slots < capacity * 2 / Shards_)
+                slots *= 2;
+            return slots - 1;
+        }()),
+        limit_((mask_ + 1) / 8 * 7)
+    {
+        for (auto &shard : shards_)
+            shard.slots_.resize(mask_ + 1);
+    }
+
+    // code sees (and can change) the value under key, which is then the most recently used
+    template <typename Code_>
+    bool Find(const Key_ &key, Code_ &&code) {
+        const auto hash(Hash(key));
+        auto &shard(Get(hash));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        const auto index(Locate(shard, key, uint32_t(hash)));
+        if (index == None_)
+            return false;
+        Touch(shard, index);
+        code(shard.slots_[index].value_);
+        return true;
+    }
+
+    // files value under key, unless something already is (which is then set in value);
+    // a full shard drops its least recently used entry first, which is set in evicted
+    bool Insert(const Key_ &key, Value_ &value, std::optional<Entry> &evicted) {
+        const auto hash(Hash(key));
+        auto &shard(Get(hash));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+
+        const auto found(Locate(shard, key, uint32_t(hash)));
+        if (found != None_) {
+            Touch(shard, found);
+            value = shard.slots_[found].value_;
+            return false;
+        }
+
+        if (shard.size_ == limit_)
+            evicted.emplace(Remove(shard, shard.oldest_));
+
+        auto index(uint32_t(hash) & mask_);
+        while (shard.slots_[index].used_)
+            index = (index + 1) & mask_;
+        auto &slot(shard.slots_[index]);
+        slot.key_ = key;
+        slot.value_ = value;
+        slot.hash_ = uint32_t(hash);
+        slot.used_ = true;
+        Append(shard, index);
+        ++shard.size_;
+        return true;
+    }
+
+    // as Find, but leaving its place in the lru alone
+    template <typename Code_>
+    bool Peek(const Key_ &key, Code_ &&code) {
+        const auto hash(Hash(key));
+        auto &shard(Get(hash));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        const auto index(Locate(shard, key, uint32_t(hash)));
+        if (index == None_)
+            return false;
+        code(shard.slots_[index].value_);
+        return true;
+    }
+
+    // drops the value under key if code returns true for it
+    template <typename Code_>
+    std::optional<Value_> Erase(const Key_ &key, Code_ &&code) {
+        const auto hash(Hash(key));
+        auto &shard(Get(hash));
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        const auto index(Locate(shard, key, uint32_t(hash)));
+        if (index == None_ || !code(static_cast<const Value_ &>(shard.slots_[index].value_)))
+            return std::nullopt;
+        return Remove(shard, index).second;
+    }
+
+    std::optional<Value_> Erase(const Key_ &key) {
+        return Erase(key, [](const Value_ &) { return true; });
+    }
+
+    // drops the least recently used entry code accepts of one shard (chosen by hint)
+    template <typename Code_>
+    std::optional<Entry> Evict(size_t hint, Code_ &&code) {
+        for (size_t i(0); i != Shards_; ++i) {
+            auto &shard(shards_[(hint + i) % Shards_]);
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            for (auto index(shard.oldest_); index != None_; index = shard.slots_[index].newer_)
+                if (code(shard.slots_[index].key_, shard.slots_[index].value_))
+                    return Remove(shard, index);
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Entry> Evict(size_t hint) {
+        return Evict(hint, [](const Key_ &, const Value_ &) { return true; });
+    }
+
+    // drops every entry code returns true for, a shard at a time
+    template <typename Code_>
+    void Sweep(Code_ &&code) {
+        for (auto &shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            for (uint32_t index(0); index != mask_ + 1; ) {
+                const auto &slot(shard.slots_[index]);
+                // an entry shifted back into this slot is looked at as well
+                if (slot.used_ && code(slot.key_, slot.value_))
+                    Remove(shard, index);
+                else
+                    ++index;
+            }
+        }
+    }
+
+    template <typename Code_>
+    void Each(Code_ &&code) {
+        for (auto &shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            for (const auto &slot : shard.slots_)
+                if (slot.used_)
+                    code(slot.key_, slot.value_);
+        }
+    }
+
+    size_t Size() {
+        size_t size(0);
+        for (auto &shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            size += shard.size_;
+        }
+        return size;
+    }
+};
+
+}
+
+#endif//ORCHID_TRANSLATIONS_HPP
@@ -0,0 +1,128 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include "error.hpp"
+#include "verifier.hpp"
+
+namespace orc {
+
+void Verifier::Run() {
+    std::vector<Job *> batch;
+    batch.reserve(Batch_);
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            // libsecp256k1 has no batched recovery, but taking several jobs per
+            // wakeup at least amortizes the lock and the condition variable
+            while (!queue_.empty() && batch.size() != Batch_) {
+                batch.push_back(queue_.front());
+                queue_.pop_front();
+            }
+        }
+
+        for (const auto job : batch) try {
+            job->signer_ = Address(orc::Recover(job->hash_, job->signature_));
+        } catch (...) {
+            job->error_ = std::current_exception();
+        }
+
+        recovered_.fetch_add(batch.size(), std::memory_order_relaxed);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (const auto job : batch) {
+                if (job->error_)
+                    continue;
+                const auto key(Key(job->hash_, job->signature_));
+                if (!cache_.try_emplace(key, job->signer_).second)
+                    continue;
+                order_.push_back(key);
+                if (order_.size() > Cache_) {
+                    cache_.erase(order_.front());
+                    order_.pop_front();
+                }
+            }
+        }
+
+        // the job lives in the waiting coroutine, which may be gone after this
+        for (const auto job : batch)
+            job->ready_();
+        batch.clear();
+    }
+}
+
+Verifier::Verifier(unsigned threads) {
+    orc_assert(threads != 0);
+    for (unsigned i(0); i != threads; ++i)
+        threads_.emplace_back([this]() { Run(); });
+}
+
+Verifier::~Verifier() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+
+    ready_.notify_all();
+    for (auto &thread : threads_)
+        thread.join();
+}
+
+Verifier &Verifier::Get() {
+    // leave one core for the Pool thread that forwards packets
+    static Verifier verifier(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return verifier;
+}
+
+task<Address> Verifier::Recover(const Brick<32> &hash, const Signature &signature) {
+    Job job{hash, signature};
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        const auto cached(cache_.find(Key(hash, signature)));
+        if (cached != cache_.end()) {
+            cached_.fetch_add(1, std::memory_order_relaxed);
+            co_return cached->second;
+        }
+
+        if (queue_.size() >= Queue_) {
+            refused_.fetch_add(1, std::memory_order_relaxed);
+            orc_throw("verifier queue full");
+        }
+
+        queue_.push_back(&job);
+    }
+
+    ready_.notify_one();
+    co_await job.ready_.Wait();
+
+    if (job.error_)
+        std::rethrow_exception(job.error_);
+    co_return job.signer_;
+}
+
+}
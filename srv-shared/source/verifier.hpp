@@ -0,0 +1,110 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_VERIFIER_HPP
+#define ORCHID_VERIFIER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "crypto.hpp"
+#include "event.hpp"
+#include "jsonrpc.hpp"
+#include "task.hpp"
+
+namespace orc {
+
+// recovers ticket signers on worker threads, so a burst of tickets never
+// monopolizes the Pool thread that is also forwarding packets; results are
+// cached by (hash, signature), so a retransmitted ticket costs a lookup
+class Verifier {
+  public:
+    static const size_t Queue_ = 4096;
+    static const size_t Batch_ = 32;
+    static const size_t Cache_ = 8192;
+
+  private:
+    struct Job {
+        const Brick<32> hash_;
+        const Signature signature_;
+
+        uint160_t signer_;
+        std::exception_ptr error_;
+        Event ready_;
+    };
+
+    typedef std::tuple<Brick<32>, Brick<32>, Brick<32>, uint8_t> Key_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Job *> queue_;
+    bool stopping_ = false;
+
+    std::map<Key_, Address> cache_;
+    std::deque<Key_> order_;
+
+    std::vector<std::thread> threads_;
+
+    std::atomic<uint64_t> recovered_ = 0;
+    std::atomic<uint64_t> cached_ = 0;
+    std::atomic<uint64_t> refused_ = 0;
+
+    static Key_ Key(const Brick<32> &hash, const Signature &signature) {
+        return {hash, signature.r_, signature.s_, signature.v_};
+    }
+
+    void Run();
+
+  public:
+    Verifier(unsigned threads);
+    ~Verifier();
+
+    static Verifier &Get();
+
+    // throws, rather than queueing without bound, when the workers are behind
+    task<Address> Recover(const Brick<32> &hash, const Signature &signature);
+
+    unsigned Threads() const {
+        return threads_.size();
+    }
+
+    uint64_t Recovered() const {
+        return recovered_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Cached() const {
+        return cached_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Refused() const {
+        return refused_.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+#endif//ORCHID_VERIFIER_HPP
@@ -0,0 +1,82 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#ifndef ORCHID_WHEEL_HPP
+#define ORCHID_WHEEL_HPP
+
+#include <vector>
+
+namespace orc {
+
+// a hashed timing wheel, ticked forward by its owner: an item is filed by the
+// tick it is due in the slot that tick falls on, so filing is constant time and
+// advancing a tick only looks at one slot (where anything due a full turn or
+// more later is just filed back). nothing can be taken out: whatever an item
+// stands for must be checked to still be due (or filed again) when it comes up
+template <typename Item_>
+class Wheel {
+  private:
+    std::vector<std::vector<std::pair<uint32_t, Item_>>> slots_;
+    uint32_t now_;
+    size_t size_ = 0;
+
+  public:
+    Wheel(size_t slots, uint32_t now = 0) :
+        slots_(slots),
+        now_(now)
+    {
+    }
+
+    // something already due comes up on the next tick
+    void Add(uint32_t due, const Item_ &item) {
+        if (due <= now_)
+            due = now_ + 1;
+        slots_[due % slots_.size()].emplace_back(due, item);
+        ++size_;
+    }
+
+    template <typename Code_>
+    void Advance(uint32_t now, Code_ &&code) {
+        std::vector<std::pair<uint32_t, Item_>> items;
+        while (now_ < now) {
+            auto &slot(slots_[++now_ % slots_.size()]);
+            items.swap(slot);
+            for (const auto &item : items)
+                if (item.first > now_)
+                    slot.emplace_back(item);
+                else {
+                    --size_;
+                    code(item.second);
+                }
+            items.clear();
+        }
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+};
+
+}
+
+#endif//ORCHID_WHEEL_HPP
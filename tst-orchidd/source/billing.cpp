@@ -0,0 +1,340 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "balance.hpp"
+#include "cashier.hpp"
+#include "client.hpp"
+#include "coinbase.hpp"
+#include "datagram.hpp"
+#include "error.hpp"
+#include "ledger.hpp"
+#include "local.hpp"
+#include "loopback.hpp"
+#include "server.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// what Server::Bill and Server::Submit used to do, for comparison
+class Reference {
+  private:
+    const Float price_;
+    std::mutex mutex_;
+    uint64_t serial_ = 0;
+    Float balance_ = 0;
+
+  public:
+    Reference(const Float &price) :
+        price_(price)
+    {
+    }
+
+    bool Debit(size_t size, bool force) {
+        const auto amount(price_ * size);
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!force && balance_ < amount)
+            return false;
+        balance_ -= amount;
+        ++serial_;
+        return true;
+    }
+
+    // how far (in fixed point units) the balance is from covering size
+    Float Margin(size_t size) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return (balance_ - price_ * size) / price_ * (1 << Fraction_);
+    }
+
+    void Credit(const Float &credit) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        balance_ += credit;
+        ++serial_;
+    }
+
+    std::tuple<uint64_t, Float> Read() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return {serial_, balance_};
+    }
+};
+
+template <typename Code_>
+static uint64_t Time(unsigned threads, uint64_t count, Code_ code) {
+    const auto start(Now());
+    std::vector<std::thread> workers;
+    for (unsigned i(0); i != threads; ++i)
+        workers.emplace_back([&]() {
+            for (uint64_t j(0); j != count; ++j)
+                code(j);
+        });
+    for (auto &worker : workers)
+        worker.join();
+    return (Now() - start) * 1000 / (threads * count);
+}
+
+// one end of an in-process link between a bonding of a Client and one of a Server
+class Cable :
+    public Pump<Buffer>
+{
+  private:
+    Cable *other_ = nullptr;
+
+  public:
+    std::atomic<bool> failing_ = false;
+    // bytes delivered to the other end, and sends that failed
+    std::atomic<uint64_t> bytes_ = 0;
+    std::atomic<uint64_t> failed_ = 0;
+
+    Cable(BufferDrain *drain) :
+        Pump(drain)
+    {
+    }
+
+    void Join(Cable *other) {
+        other_ = other;
+        other->other_ = this;
+    }
+
+    task<void> Shut() noexcept override {
+        Pump::Stop();
+        co_await Pump::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        // a send takes a while, so packets have to wait their turn in Fair
+        co_await Sleep(std::chrono::milliseconds(1));
+        if (failing_) {
+            ++failed_;
+            orc_throw("cable failing");
+        }
+        bytes_ += data.size();
+        other_->Land(data);
+    }
+};
+
+// stands in for the Server's egress: counts what it lands on the Server
+class Far :
+    public Pump<Buffer>
+{
+  public:
+    std::atomic<uint64_t> bytes_ = 0;
+
+    Far(BufferDrain *drain) :
+        Pump(drain)
+    {
+    }
+
+    void Emit(const Buffer &data) {
+        bytes_ += data.size();
+        Land(data);
+    }
+
+    task<void> Shut() noexcept override {
+        Pump::Stop();
+        co_await Pump::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        co_return;
+    }
+};
+
+class Drop :
+    public Valve,
+    public BufferDrain
+{
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+};
+
+// a Client paying (through a Ledger) a Server that sends it bursts Fair can't keep up with, some
+// of them over a failing link: everything the Server landed is billed, plus what it sent, and
+// nothing else; so the balance is exactly the tickets accepted less those bytes
+static int Replay() {
+    const auto ledger(Make<Ledger>());
+    ledger->Open();
+
+    const auto origin(Break<Local>());
+
+    const Address lottery("0xb02396f06CC894834b7934ecF8c8E5Ab5C1d12F1");
+    const uint256_t chain(1);
+    const Address recipient("0x2b1ce95573ec1b927a90cb488db113b40eeb064a");
+    const Address funder("0x405bc10e04e3f487e9925ad5815e4406d78b769e");
+
+    const auto journal((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string());
+    const auto cashier(Make<Cashier>(origin, Endpoint(origin, ledger->Locate("http")), ledger->Locate("ws"),
+        Float("0.03") / (1024 * 1024 * 1024), "USD", ledger->Locate("http"),
+        recipient, "", lottery, chain, recipient, journal));
+
+    const auto code(Wait([&]() -> task<int> {
+        co_await Schedule();
+
+        // one packet in flight, and only a few more waiting
+        const auto server(Make<Sink<Server>>(origin, cashier, Make<Fair>(1, 1500, 8 * 1024)));
+        const auto far(server->Wire<Far>());
+
+        const auto drop(Make<Sink<Drop>>());
+        const auto client(drop->Wire<Client>("", nullptr, lottery, chain, Random<32>(), funder));
+
+        const auto bonding(server->Bond());
+        const auto downstream(bonding->Wire<Cable>());
+        const auto upstream(client->Bond()->Wire<Cable>());
+        downstream->Join(upstream);
+
+        const auto settled([&]() -> task<bool> {
+            for (unsigned i(0); i != 100; ++i) {
+                co_await Sleep(std::chrono::milliseconds(100));
+                const auto [issued, pending, serial] = client->Tickets();
+                if (issued != 0 && pending == 0)
+                    co_return true;
+            }
+            co_return false;
+        });
+
+        co_await server->Open(bonding);
+        orc_assert(co_await settled());
+
+        static const Socket source(asio::ip::make_address("10.0.0.1"), 7);
+        static const Socket target(asio::ip::make_address("10.7.0.2"), 1024);
+        const auto packet(Datagram(source, target, Beam(1000)));
+
+        for (unsigned burst(0); burst != 40; ++burst) {
+            // a quarter of them over a link that fails every send, invoices included
+            downstream->failing_ = burst % 4 == 3;
+            for (unsigned i(0); i != 20; ++i)
+                far->Emit(packet);
+            co_await Sleep(std::chrono::milliseconds(50));
+        }
+
+        downstream->failing_ = false;
+        far->Emit(packet);
+        co_await Sleep(1);
+        orc_assert(co_await settled());
+
+        const auto [balance, billed, credited] = server->Account();
+        const auto [packets, bytes, dropped, delay] = server->Stats();
+        const auto expected(upstream->bytes_ + far->bytes_ + downstream->bytes_);
+
+        std::cout << std::dec << "through a Server: " << billed << " bytes billed (" << expected << " landed or sent), " << dropped << " packets dropped by Fair, " << downstream->failed_ << " failed sends; balance " << balance << " = " << credited << " credited - " << Balance::Cost(billed) << std::endl;
+
+        co_await drop->Shut();
+        co_await server->Shut();
+
+        co_return billed == expected && balance == credited - Balance::Cost(billed) && dropped != 0 && downstream->failed_ != 0 ? 0 : 1;
+    }()));
+
+    boost::filesystem::remove(journal);
+    return code;
+}
+
+// replays a random trace of packets and ticket credits through both
+int TestBilling(int argc, const char *const argv[]) {
+    const uint64_t count(argc == 0 ? 10000000 : std::stoull(argv[0]));
+
+    const auto price(Float("0.03") / (1024 * 1024 * 1024));
+
+    Reference reference(price);
+    Balance balance;
+
+    std::mt19937_64 random(0);
+    uint64_t dropped(0);
+    uint64_t credits(0);
+    uint64_t borderline(0);
+    Float worst(0);
+
+    for (uint64_t i(0); i != count; ++i) {
+        if (random() % 10000 == 0) {
+            // a ticket worth somewhere around a few megabytes
+            const Float credit(Float(random() % 1000000000) / 1000000000 * price * 8 * 1024 * 1024);
+            reference.Credit(credit);
+            // as Cashier::Credit does
+            balance.Credit(Fixed(floor(credit / price * (1 << Fraction_))));
+            ++credits;
+        } else {
+            const size_t size(40 + random() % 1460);
+            const bool force(random() % 2 == 0);
+            const auto margin(reference.Margin(size));
+            Fixed after;
+            const auto fixed(balance.Debit(Balance::Cost(size), force, after));
+            if (!fixed)
+                ++dropped;
+            if (!force && (margin >= 0) != fixed) {
+                // only possible when the balance is within the rounding of the credits so far
+                orc_assert_(margin >= 0 && margin < credits, "decision " << i << " differs by " << margin);
+                ++borderline;
+            }
+            if (fixed)
+                reference.Debit(size, true);
+        }
+
+        const auto [serial, value] = balance.Read();
+        const auto [expected, exact] = reference.Read();
+        orc_assert_(serial == expected, "serial " << serial << " != " << expected);
+
+        // the only difference is rounding credits down, by under a unit each
+        const auto error(exact / price * (1 << Fraction_) - Float(value));
+        orc_assert_(error >= 0, "fixed balance exceeds the exact one at " << i);
+        if (error > worst)
+            worst = error;
+    }
+
+    std::cout << std::dec << count << " events replayed, " << dropped << " refused (" << borderline << " within rounding); identical serials, worst rounding " << worst << " units (1/65536 of a byte)" << std::endl;
+
+    for (const unsigned threads : {1, 4}) {
+        const uint64_t each(1000000);
+        Reference reference(price);
+        Balance balance;
+        const auto before(Time(threads, each, [&](uint64_t i) {
+            reference.Debit(40 + i % 1460, true);
+        }));
+        const auto after(Time(threads, each, [&](uint64_t i) {
+            Fixed after;
+            balance.Debit(Balance::Cost(40 + i % 1460), true, after);
+        }));
+        std::cout << threads << " thread(s): Bill() with Float under a mutex = " << before << "ns, fixed point = " << after << "ns" << std::endl;
+    }
+
+    return Replay();
+}
+
+}
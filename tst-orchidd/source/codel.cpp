@@ -0,0 +1,132 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+#include <map>
+
+#include "codel.hpp"
+#include "error.hpp"
+#include "loopback.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+typedef Codel::Clock_ Clock_;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+// a 10Mbit/s link with 20ms of base rtt, carrying a reno-like bulk flow (a
+// window that grows by a packet per rtt and halves on loss) and a 64 byte ping
+// every 100ms; the queue ahead of the link is fq-codel over that many flows
+static void Simulate(const char *title, unsigned flows, Clock_::duration target, uint64_t seconds, std::vector<uint64_t> &pings, uint64_t &bulk) {
+    const uint64_t rate(10 * 1000 * 1000 / 8);
+    const uint64_t rtt(20000);
+    const size_t mss(1500);
+
+    FqCodel queue(flows, 1000, target, milliseconds(100));
+    const Clock_::time_point epoch;
+    const auto at([&](uint64_t time) { return epoch + microseconds(time); });
+    const auto when([&](const Codel::Packet &packet) { return uint64_t(std::chrono::duration_cast<microseconds>(packet.stamp_ - epoch).count()); });
+
+    // acks and losses of the bulk flow, by when its sender hears of them
+    std::multimap<uint64_t, bool> feedback;
+    double window(2);
+    unsigned flight(0);
+    uint64_t cut(0);
+
+    uint64_t drops(0);
+    uint64_t sojourn(0);
+    uint64_t worst(0);
+    uint64_t sent(0);
+
+    const auto drop([&](uint64_t now) { return [&, now](const Codel::Packet &packet) {
+        ++drops;
+        if (packet.data_.size() == mss)
+            feedback.emplace(now + rtt, false);
+    }; });
+
+    bulk = 0;
+    uint64_t free(0);
+    for (uint64_t now(0); now < seconds * 1000000; now += 100) {
+        for (auto heard(feedback.begin()); heard != feedback.end() && heard->first <= now; heard = feedback.erase(heard)) {
+            --flight;
+            if (heard->second)
+                window += 1 / window;
+            else if (heard->first - cut > rtt) {
+                window = std::max(window / 2, 2.0);
+                cut = heard->first;
+            }
+        }
+
+        for (; flight < unsigned(window); ++flight)
+            queue.Push(Beam(mss), 1, at(now), drop(now));
+        if (now % 100000 == 0)
+            queue.Push(Beam(64), 2, at(now), drop(now));
+
+        while (free <= now) {
+            auto packet(queue.Pop(at(now), drop(now)));
+            if (!packet) {
+                free = now + 100;
+                break;
+            }
+
+            const auto size(packet->data_.size());
+            const auto delay(now - when(*packet));
+            sojourn += delay;
+            worst = std::max(worst, delay);
+            ++sent;
+
+            free = std::max(free, now) + size * 1000000 / rate;
+            if (size == mss) {
+                bulk += size;
+                feedback.emplace(free + rtt, true);
+            } else
+                pings.push_back(free - when(*packet));
+        }
+    }
+
+    bulk /= seconds;
+    std::cout << title << ": bulk at " << std::dec << bulk * 100 / rate << "% of the link, ping " << Percentile(pings, 50) / 1000 << "ms median, " << Percentile(pings, 99) / 1000 << "ms p99; " << drops << " drops, sojourn " << sojourn / sent / 1000 << "ms mean, " << worst / 1000 << "ms worst" << std::endl;
+}
+
+// latency for a ping competing with a bulk flow: behind a tail-drop fifo (as
+// the tunnel's queues were), behind codel, and behind fq-codel
+int TestCodel(int argc, const char *const argv[]) {
+    const uint64_t seconds(argc == 0 ? 60 : std::stoull(argv[0]));
+    const uint64_t rate(10 * 1000 * 1000 / 8);
+
+    std::vector<uint64_t> fifo, codel, fq;
+    uint64_t bulk;
+
+    Simulate("tail-drop fifo", 1, std::chrono::hours(1), seconds, fifo, bulk);
+    Simulate("codel", 1, milliseconds(5), seconds, codel, bulk);
+    orc_assert_(bulk * 10 >= rate * 8, "codel left the link at " << bulk * 100 / rate << "%");
+    Simulate("fq-codel", 1024, milliseconds(5), seconds, fq, bulk);
+    orc_assert_(bulk * 10 >= rate * 8, "fq-codel left the link at " << bulk * 100 / rate << "%");
+
+    orc_assert_(Percentile(codel, 50) * 4 < Percentile(fifo, 50), "codel didn't cut the ping's delay");
+    // a ping only ever waits for the bulk packet already on the wire
+    orc_assert_(Percentile(fq, 99) < 5000, "a ping waited " << Percentile(fq, 99) << "us behind fq-codel");
+    return 0;
+}
+
+}
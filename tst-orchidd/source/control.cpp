@@ -0,0 +1,263 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <atomic>
+#include <iostream>
+#include <random>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <p2p/base/basic_packet_socket_factory.h>
+#include <rtc_base/async_socket.h>
+#include <rtc_base/physical_socket_server.h>
+#include <rtc_base/ssl_fingerprint.h>
+#include <rtc_base/thread.h>
+
+#include "cashier.hpp"
+#include "client.hpp"
+#include "datagram.hpp"
+#include "ledger.hpp"
+#include "local.hpp"
+#include "manager.hpp"
+#include "node.hpp"
+#include "serve.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// a udp socket that loses a fraction of what is sent through it
+class Dropper :
+    public rtc::AsyncSocketAdapter
+{
+  private:
+    const double loss_;
+    std::atomic<uint64_t> &lost_;
+    // only used on the thread of the socket server
+    std::mt19937 random_;
+
+  public:
+    Dropper(rtc::AsyncSocket *socket, double loss, std::atomic<uint64_t> &lost) :
+        rtc::AsyncSocketAdapter(socket),
+        loss_(loss),
+        lost_(lost),
+        random_(std::random_device()())
+    {
+    }
+
+    int SendTo(const void *data, size_t size, const rtc::SocketAddress &address) override {
+        if (std::uniform_real_distribution<double>(0, 1)(random_) >= loss_)
+            return rtc::AsyncSocketAdapter::SendTo(data, size, address);
+        ++lost_;
+        return int(size);
+    }
+};
+
+class Dropping :
+    public rtc::PhysicalSocketServer
+{
+  private:
+    const double loss_;
+
+  public:
+    std::atomic<uint64_t> lost_ = 0;
+
+    Dropping(double loss) :
+        loss_(loss)
+    {
+    }
+
+    rtc::AsyncSocket *CreateAsyncSocket(int family, int type) override {
+        const auto socket(rtc::PhysicalSocketServer::CreateAsyncSocket(family, type));
+        if (socket == nullptr || type != SOCK_DGRAM)
+            return socket;
+        return new Dropper(socket, loss_, lost_);
+    }
+};
+
+// like Local, but every udp socket WebRTC opens (ICE, and so DTLS and SCTP) is lossy
+class Lossy final :
+    public Origin
+{
+  private:
+    const S<Local> local_;
+    Dropping *const dropping_;
+    const U<rtc::Thread> thread_;
+    rtc::BasicPacketSocketFactory factory_;
+
+    Lossy(U<Dropping> dropping) :
+        Origin(std::make_unique<Manager>()),
+        local_(Break<Local>()),
+        dropping_(dropping.get()),
+        thread_(std::make_unique<rtc::Thread>(std::move(dropping))),
+        factory_([&]() {
+            thread_->SetName("Orchid WebRTC Lossy", nullptr);
+            thread_->Start();
+            return thread_.get();
+        }())
+    {
+    }
+
+  public:
+    Lossy(double loss) :
+        Lossy(std::make_unique<Dropping>(loss))
+    {
+    }
+
+    ~Lossy() override {
+        thread_->Stop();
+    }
+
+    uint64_t Lost() const {
+        return dropping_->lost_;
+    }
+
+    class Host Host() override {
+        return local_->Host();
+    }
+
+    rtc::Thread *Thread() override {
+        return thread_.get();
+    }
+
+    rtc::BasicPacketSocketFactory &Factory() override {
+        return factory_;
+    }
+
+    task<Socket> Associate(Sunk<> *sunk, const std::string &host, const std::string &port) override {
+        co_return co_await local_->Associate(sunk, host, port);
+    }
+
+    task<Socket> Connect(U<Stream> &stream, const std::string &host, const std::string &port) override {
+        co_return co_await local_->Connect(stream, host, port);
+    }
+
+    task<Socket> Unlid(Sunk<BufferSewer, Opening> *sunk) override {
+        co_return co_await local_->Unlid(sunk);
+    }
+};
+
+// a client's tunnel: what it sends is echoed back by the egress's Echo, and counted
+class Count :
+    public Valve,
+    public BufferDrain
+{
+  private:
+    std::atomic<uint64_t> landed_ = 0;
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+        ++landed_;
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+
+    task<void> Send(const Buffer &data) {
+        co_return co_await Inner()->Send(data);
+    }
+
+    uint64_t Landed() const {
+        return landed_;
+    }
+};
+
+// a client paying an orchidd (on this box, with a Ledger) while streaming udp through it, with
+// both of their WebRTC sockets losing loss% of datagrams: the unreliable data channel loses
+// packets, but each ticket and invoice goes on the control channel, so every ticket issued is
+// acknowledged by an invoice in the end
+int TestControl(int argc, const char *const argv[]) {
+    orc_assert_(argc <= 2, "usage: control [seconds] [loss%]");
+    const unsigned seconds(argc > 0 ? std::stoul(argv[0]) : 10);
+    const double loss((argc > 1 ? std::stod(argv[1]) : 5) / 100);
+
+    const auto ledger(Make<Ledger>());
+    ledger->Open();
+
+    const auto origin(Break<Local>());
+    const auto lossy(Break<Lossy>(loss));
+
+    const Address lottery("0xb02396f06CC894834b7934ecF8c8E5Ab5C1d12F1");
+    const uint256_t chain(1);
+    const Address recipient("0x2b1ce95573ec1b927a90cb488db113b40eeb064a");
+    const Address funder("0x405bc10e04e3f487e9925ad5815e4406d78b769e");
+
+    const auto journal((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string());
+    const auto cashier(Make<Cashier>(origin, Endpoint(origin, ledger->Locate("http")), ledger->Locate("ws"),
+        Float("0.03") / (1024 * 1024 * 1024), "USD", ledger->Locate("http"),
+        recipient, "", lottery, chain, recipient, journal));
+
+    // Egress is never destroyed
+    const auto egress(Make<Sink<Egress>>(0x0a000002));
+    egress->Wire<Echo>();
+
+    const auto node(Make<Node>(lossy, cashier, std::vector<S<Egress>>{egress}, Make<Fair>(), Make<Governor>(Governor::Load(), nullptr), Configuration()));
+    const auto certificate(Certify());
+    const auto url(Serve(node, certificate, ledger));
+
+    const auto code(Wait([&]() -> task<int> {
+        co_await Schedule();
+        co_await Reach(origin, url);
+
+        const auto count(Make<Sink<Count>>());
+        const auto client(count->Wire<Client>(url, U<rtc::SSLFingerprint>(rtc::SSLFingerprint::CreateFromCertificate(*certificate)), lottery, chain, Random<32>(), funder));
+        co_await client->Open(lossy);
+
+        // about 1MB/s, in bursts of ten packets
+        static const Socket source(asio::ip::make_address("10.7.0.2"), 1024);
+        static const Socket target(asio::ip::make_address("10.0.0.1"), 7);
+        const auto packet(Datagram(source, target, Beam(1200)));
+
+        uint64_t sent(0);
+        const auto end(Now() + seconds * 1000000);
+        while (Now() < end) {
+            for (unsigned i(0); i != 10; ++i)
+                if (!orc_ignore({ co_await count->Send(packet); }))
+                    ++sent;
+            co_await Sleep(std::chrono::milliseconds(10));
+        }
+
+        // let the control channel retransmit what it lost
+        co_await Sleep(5);
+
+        const auto [issued, pending, serial] = client->Tickets();
+        std::cout << std::dec << count->Landed() << "/" << sent << " packets echoed, " << lossy->Lost() << " datagrams lost" << std::endl;
+        std::cout << issued << " tickets issued, " << pending << " unacknowledged; last invoice #" << serial << std::endl;
+
+        co_await count->Shut();
+        co_return serial >= 0 && issued != 0 && pending == 0 && lossy->Lost() != 0 ? 0 : 1;
+    }()));
+
+    boost::filesystem::remove(journal);
+    return code;
+}
+
+}
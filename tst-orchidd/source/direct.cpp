@@ -0,0 +1,75 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+
+#include "local.hpp"
+#include "loopback.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+static task<void> Measure(const S<Origin> &origin, bool direct, unsigned count) {
+    Configuration configuration;
+    configuration.direct_ = direct;
+
+    const auto mirror(Make<Mirror>(origin, configuration));
+    const auto meter(Make<Sink<Meter>>());
+
+    co_await Channel::Wire(meter.get(), origin, configuration, [&](std::string offer) -> task<std::string> {
+        co_return co_await mirror->Answer(offer);
+    });
+
+    const auto start(Now());
+    for (unsigned i(0); i != count; ++i)
+        co_await meter->Stamp<1024>(0);
+    const auto sent(Now() - start);
+
+    // let the last echoes drain back
+    co_await Sleep(2);
+
+    const auto delays(meter->Delays(0));
+    const auto p99(Percentile(delays, 99));
+
+    std::cout << (direct ? "direct" : "channel") << ": "
+        << std::dec << count * 1000000 / std::max<uint64_t>(sent, 1) << " pkt/s sent, "
+        << delays.size() << "/" << count << " echoed, "
+        << "p99 = " << p99 << "us" << std::endl;
+
+    co_await meter->Shut();
+}
+
+// loopback comparison of DataChannel::Send and the direct usrsctp path
+int TestDirect(int argc, const char *const argv[]) {
+    const unsigned count(argc == 0 ? 100000 : std::stoul(argv[0]));
+
+    return Wait([&]() -> task<int> {
+        co_await Schedule();
+        const auto origin(Break<Local>());
+        co_await Measure(origin, false, count);
+        co_await Measure(origin, true, count);
+        co_return 0;
+    }());
+}
+
+}
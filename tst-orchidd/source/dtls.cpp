@@ -0,0 +1,111 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <iostream>
+
+#include <rtc_base/ssl_fingerprint.h>
+
+#include "dtls.hpp"
+#include "gateway.hpp"
+#include "local.hpp"
+#include "loopback.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+static void Report(const char *name, unsigned count, uint64_t sent, const std::vector<uint64_t> &delays) {
+    std::cout << name << ": "
+        << std::dec << count * 1000000 / std::max<uint64_t>(sent, 1) << " pkt/s sent, "
+        << delays.size() << "/" << count << " echoed, "
+        << "p50 = " << Percentile(delays, 50) << "us, "
+        << "p99 = " << Percentile(delays, 99) << "us" << std::endl;
+}
+
+static task<void> Measure(const S<Sink<Meter>> &meter, const char *name, unsigned count) {
+    const auto start(Now());
+    for (unsigned i(0); i != count; ++i)
+        co_await meter->Stamp<1024>(0);
+    const auto sent(Now() - start);
+
+    // let the last echoes drain back
+    co_await Sleep(2);
+
+    Report(name, count, sent, meter->Delays(0));
+    co_await meter->Shut();
+}
+
+// loopback comparison of a plain Dtls session (through a Gateway) and the data channel
+int TestDtls(int argc, const char *const argv[]) {
+    const unsigned count(argc == 0 ? 100000 : std::stoul(argv[0]));
+
+    return Wait([&]() -> task<int> {
+        co_await Schedule();
+        const auto origin(Break<Local>());
+
+        {
+            Configuration configuration;
+            const auto mirror(Make<Mirror>(origin, configuration));
+            const auto meter(Make<Sink<Meter>>());
+            co_await Channel::Wire(meter.get(), origin, configuration, [&](std::string offer) -> task<std::string> {
+                co_return co_await mirror->Answer(offer);
+            });
+            co_await Measure(meter, "channel", count);
+        }
+
+        {
+            const auto certificate(Certify());
+            const U<rtc::SSLFingerprint> fingerprint(rtc::SSLFingerprint::CreateFromCertificate(*certificate));
+
+            std::vector<S<Sink<Reflect>>> reflects;
+            Gateway gateway([&](Gateway *gateway, const Socket &remote, const Buffer &data) -> Lane * {
+                const auto reflect(Break<Sink<Reflect>>());
+                const auto dtls(reflect->Wire<Sink<Dtls>>(certificate));
+                const auto lane(dtls->Wire<Lane>(gateway, remote));
+                reflects.emplace_back(reflect);
+                Spawn([dtls]() noexcept -> task<void> {
+                    orc_ignore({ co_await dtls->Open(); });
+                });
+                return lane;
+            });
+            gateway.Open(Socket(Host(127,0,0,1), 0));
+
+            const auto meter(Make<Sink<Meter>>());
+            const auto dtls(meter->Wire<Sink<Dtls>>(nullptr, [&](const std::list<const rtc::OpenSSLCertificate> &certificates) -> bool {
+                for (const auto &certificate : certificates)
+                    if (*fingerprint == *rtc::SSLFingerprint::Create(fingerprint->algorithm, certificate))
+                        return true;
+                return false;
+            }));
+            co_await origin->Associate(dtls, "127.0.0.1", std::to_string(gateway.Local().Port()));
+            co_await dtls->Open();
+            co_await Measure(meter, "dtls", count);
+
+            co_await gateway.Shut();
+        }
+
+        co_return 0;
+    }());
+}
+
+}
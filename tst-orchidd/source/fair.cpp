@@ -0,0 +1,165 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <atomic>
+#include <iostream>
+
+#include "balance.hpp"
+#include "error.hpp"
+#include "fair.hpp"
+#include "locked.hpp"
+#include "loopback.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// a client keeps depth packets of size outstanding, pausing gap after each; the
+// shared link takes a millisecond per packet and carries width of them at once
+struct Client {
+    const char *name_;
+    unsigned depth_;
+    size_t size_;
+    std::chrono::milliseconds gap_;
+
+    std::atomic<uint64_t> bytes_ = 0;
+    Locked<std::vector<uint64_t>> waits_;
+
+    Client(const char *name, unsigned depth, size_t size, std::chrono::milliseconds gap) :
+        name_(name),
+        depth_(depth),
+        size_(size),
+        gap_(gap)
+    {
+    }
+};
+
+// flow is what the client sends on: its own, or one all of them share (so, first come first served)
+static void Simulate(const char *title, unsigned width, const std::vector<std::pair<Client *, Fair::Flow *>> &clients, uint64_t duration) {
+    const auto end(Now() + duration);
+
+    std::atomic<unsigned> pending(0);
+    for (const auto &[client, flow] : clients)
+        pending += client->depth_;
+
+    Event done;
+    for (const auto &[client, flow] : clients)
+        for (unsigned i(0); i != client->depth_; ++i)
+            Spawn([&, client = client, flow = flow]() noexcept -> task<void> {
+                while (Now() < end) {
+                    const auto start(Now());
+                    if (!co_await flow->Wait(client->size_)) {
+                        co_await Sleep(std::chrono::milliseconds(1));
+                        continue;
+                    }
+                    const auto wait(Now() - start);
+                    co_await Sleep(std::chrono::milliseconds(1));
+                    flow->Done();
+                    client->bytes_ += client->size_;
+                    client->waits_()->push_back(wait);
+                    if (client->gap_.count() != 0)
+                        co_await Sleep(client->gap_);
+                }
+                if (--pending == 0)
+                    done();
+            });
+    Wait(done.Wait());
+
+    uint64_t total(0);
+    for (const auto &[client, flow] : clients)
+        total += client->bytes_;
+
+    std::cout << title << " (" << width << " packets at once):" << std::endl;
+    for (const auto &[client, flow] : clients) {
+        const auto waits(*client->waits_());
+        std::cout << "  " << client->name_ << ": " << std::dec << client->bytes_ * 1000000 / duration / 1024 << "KB/s (" << client->bytes_ * 100 / total << "%), waited " << Percentile(waits, 50) << "us median, " << Percentile(waits, 99) << "us p99" << std::endl;
+    }
+}
+
+static uint64_t Median(Client &client) {
+    return Percentile(*client.waits_(), 50);
+}
+
+// per-client throughput share and latency, with the link shared first come first
+// served and then round robin; then two bulk clients capped by what they prepaid
+int TestFair(int argc, const char *const argv[]) {
+    const uint64_t duration(argc == 0 ? 3000000 : std::stoull(argv[0]));
+    const unsigned width(4);
+
+    const auto mix([]() {
+        std::vector<U<Client>> clients;
+        clients.emplace_back(std::make_unique<Client>("bulk 1", 64, 1400, std::chrono::milliseconds(0)));
+        clients.emplace_back(std::make_unique<Client>("bulk 2", 64, 1400, std::chrono::milliseconds(0)));
+        for (const auto name : {"interactive 1", "interactive 2", "interactive 3"})
+            clients.emplace_back(std::make_unique<Client>(name, 1, 100, std::chrono::milliseconds(10)));
+        return clients;
+    });
+
+    const auto fifo(mix());
+    {
+        const auto fair(Make<Fair>(width, 1500, 1024 * 1024));
+        Fair::Flow shared(fair);
+        std::vector<std::pair<Client *, Fair::Flow *>> clients;
+        for (const auto &client : fifo)
+            clients.emplace_back(client.get(), &shared);
+        Simulate("first come first served", width, clients, duration);
+    }
+
+    const auto drr(mix());
+    {
+        const auto fair(Make<Fair>(width, 1500, 1024 * 1024));
+        std::vector<U<Fair::Flow>> flows;
+        std::vector<std::pair<Client *, Fair::Flow *>> clients;
+        for (const auto &client : drr) {
+            flows.emplace_back(std::make_unique<Fair::Flow>(fair));
+            clients.emplace_back(client.get(), flows.back().get());
+        }
+        Simulate("deficit round robin", width, clients, duration);
+    }
+
+    for (size_t i(2); i != drr.size(); ++i)
+        orc_assert_(Median(*drr[i]) * 4 < Median(*fifo[i]), drr[i]->name_ << " waited " << Median(*drr[i]) << "us with round robin, " << Median(*fifo[i]) << "us without");
+    const auto bulk1(drr[0]->bytes_.load()), bulk2(drr[1]->bytes_.load());
+    orc_assert_(bulk1 * 3 > bulk2 * 2 && bulk2 * 3 > bulk1 * 2, "bulk clients got " << bulk1 << " and " << bulk2 << " bytes");
+
+    {
+        // a balance lasting ten seconds at 1MB/s, and one in arrears held to the floor
+        const uint64_t floor(64 * 1024);
+        const auto fair(Make<Fair>(width, 1500, 1024 * 1024, 10, floor));
+        Fair::Flow rich(fair), poor(fair);
+        rich.Fund(Balance::Cost(10 * 1024 * 1024));
+        poor.Fund(-Balance::Cost(1024));
+
+        Client paid("prepaid", 64, 1400, std::chrono::milliseconds(0));
+        Client owing("in arrears", 64, 1400, std::chrono::milliseconds(0));
+        Simulate("capped by balance", width, {{&paid, &rich}, {&owing, &poor}}, duration);
+
+        // the first second's burst comes on top of the rate
+        const auto rate(owing.bytes_ * 1000000 / duration);
+        orc_assert_(rate <= floor * 2, "a session in arrears sent " << rate << " bytes/s");
+        orc_assert(paid.bytes_ > owing.bytes_ * 4);
+    }
+
+    return 0;
+}
+
+}
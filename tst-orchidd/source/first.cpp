@@ -0,0 +1,132 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <chrono>
+#include <iostream>
+
+#include "channel.hpp"
+#include "datagram.hpp"
+#include "local.hpp"
+#include "locator.hpp"
+#include "node.hpp"
+#include "serve.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+class Watch :
+    public Valve,
+    public BufferDrain
+{
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+        landed_();
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    Event landed_;
+
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+
+    task<void> Send(const Buffer &data) {
+        co_return co_await Inner()->Send(data);
+    }
+};
+
+// time-to-first-packet through an orchidd on this box, once answering offers after
+// ICE gathering completes and once with --early; its egress echoes udp straight back
+int TestFirst(int argc, const char *const argv[]) {
+    orc_assert_(argc == 0, "usage: first");
+
+    const auto origin(Break<Local>());
+    const auto certificate(Certify());
+
+    unsigned failed(0);
+    for (const bool early : {false, true}) {
+        // Egress is never destroyed
+        const auto egress(Make<Sink<Egress>>(0x0a000002));
+        egress->Wire<Echo>();
+
+        const auto node(Make<Node>(origin, nullptr, std::vector<S<Egress>>{egress}, Make<Fair>(), Make<Governor>(Governor::Load(), nullptr), Configuration(), early));
+        const auto url(Serve(node, certificate));
+
+        failed += Wait([&]() -> task<int> {
+            co_await Schedule();
+            co_await Reach(origin, url);
+
+            const auto watch(Make<Sink<Watch>>());
+
+            const auto start(std::chrono::steady_clock::now());
+            const auto elapsed([&]() {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            });
+
+            co_await Channel::Wire(watch.get(), origin, Configuration(), [&](std::string offer) -> task<std::string> {
+                co_return (co_await origin->Request("POST", Locator::Parse(url), {}, offer)).ok();
+            }, [origin, url](std::string fragment) -> task<std::string> {
+                co_return (co_await origin->Request("GET", Locator::Parse(url + "?ice=" + fragment), {}, {})).ok();
+            });
+
+            const auto open(elapsed());
+
+            // whichever comes first: the echo, or giving up on it
+            const auto done(std::make_shared<Event>());
+            Spawn([watch, done]() noexcept -> task<void> {
+                co_await watch->landed_.Wait();
+                (*done)();
+            });
+            Spawn([done]() noexcept -> task<void> {
+                co_await Sleep(10);
+                (*done)();
+            });
+
+            static const Socket source(asio::ip::make_address("10.7.0.2"), 1024);
+            static const Socket target(asio::ip::make_address("10.0.0.1"), 7);
+            co_await watch->Send(Datagram(source, target, Zero<32>()));
+            co_await done->Wait();
+
+            const bool landed(watch->landed_);
+            std::cout << (early ? "early" : "late") << ": open " << std::dec << open << "ms, first ";
+            if (landed)
+                std::cout << elapsed() << "ms" << std::endl;
+            else
+                std::cout << "never (no echo within 10s)" << std::endl;
+
+            co_await watch->Shut();
+            co_return landed ? 0 : 1;
+        }());
+    }
+
+    return failed == 0 ? 0 : 1;
+}
+
+}
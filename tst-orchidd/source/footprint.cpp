@@ -0,0 +1,108 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "error.hpp"
+#include "footprint.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// sessions whose packets wait (as in Server's Nest) for a drain of a fixed rate:
+// one sends four times what it can be drained at, the others a little under; the
+// flood must be held to its budget, and nobody else must lose a packet to it
+int TestFootprint(int argc, const char *const argv[]) {
+    const uint64_t steps(argc == 0 ? 100000 : std::stoull(argv[0]));
+    const size_t budget(1024 * 1024);
+    const size_t packet(1400);
+
+    struct Session {
+        const unsigned rate_;
+        Footprint footprint_;
+        std::deque<Footprint::Hold> waiting_;
+        uint64_t carried_ = 0;
+
+        Session(unsigned rate, size_t budget) :
+            rate_(rate),
+            footprint_(budget)
+        {
+        }
+    };
+
+    // Footprint is atomic, so can't be moved
+    std::deque<Session> sessions;
+    for (const unsigned rate : {40, 8, 8, 8})
+        sessions.emplace_back(rate, budget);
+
+    for (uint64_t step(0); step != steps; ++step)
+        for (auto &session : sessions) {
+            // a tenth of a packet per step arrives per unit of rate, and a packet drains
+            for (session.carried_ += session.rate_; session.carried_ >= 10; session.carried_ -= 10)
+                if (auto hold = session.footprint_.Take(packet))
+                    session.waiting_.emplace_back(std::move(hold));
+            if (!session.waiting_.empty())
+                session.waiting_.pop_front();
+            orc_assert(session.footprint_.Held() == session.waiting_.size() * (packet + Footprint::Task_));
+        }
+
+    for (size_t i(0); i != sessions.size(); ++i) {
+        const auto &footprint(sessions[i].footprint_);
+        std::cout << "session " << i << ": " << footprint.Held() << " bytes held, " << footprint.Peak() << " at most, " << footprint.Refused() << " packets refused" << std::endl;
+        orc_assert(footprint.Peak() <= budget);
+        if (i == 0)
+            orc_assert(footprint.Refused() != 0);
+        else
+            orc_assert_(footprint.Refused() == 0, "session " << i << " lost " << footprint.Refused() << " packets");
+    }
+
+    for (auto &session : sessions)
+        session.waiting_.clear();
+    for (const auto &session : sessions)
+        orc_assert(session.footprint_.Held() == 0);
+
+    // many threads taking and releasing at once (as the Pool does) mustn't leak or overshoot
+    Footprint shared(budget);
+    std::vector<std::thread> threads;
+    for (unsigned i(0); i != 4; ++i)
+        threads.emplace_back([&]() {
+            std::deque<Footprint::Hold> held;
+            for (uint64_t step(0); step != steps; ++step) {
+                if (auto hold = shared.Take(packet))
+                    held.emplace_back(std::move(hold));
+                if (step % 3 == 0 && !held.empty())
+                    held.pop_front();
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    std::cout << "shared: " << shared.Peak() << " bytes at most, " << shared.Refused() << " refused" << std::endl;
+    orc_assert(shared.Held() == 0);
+    orc_assert(shared.Peak() <= budget);
+    return 0;
+}
+
+}
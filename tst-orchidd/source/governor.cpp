@@ -0,0 +1,95 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include "error.hpp"
+#include "governor.hpp"
+#include "locked.hpp"
+#include "loopback.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// sessions arrive every 50ms and each wants a millisecond of the Pool thread
+// every 10ms, so ten of them fill it; returns their wait for it once they're in
+static std::vector<uint64_t> Arrive(Governor *governor, uint64_t duration, unsigned &admitted) {
+    const auto start(Now());
+    const auto end(start + duration);
+
+    Locked<std::vector<uint64_t>> lags;
+    std::atomic<unsigned> pending(0);
+    Event done;
+
+    admitted = 0;
+    for (auto now(start); now < end; now = Now()) {
+        if (governor == nullptr || governor->Admit()) {
+            ++admitted;
+            ++pending;
+            Spawn([&]() noexcept -> task<void> {
+                while (Now() < end) {
+                    co_await Sleep(std::chrono::milliseconds(10));
+                    const auto asked(Now());
+                    co_await Schedule();
+                    const auto lag(Now() - asked);
+                    // only once the load has had time to settle
+                    if (asked - start > duration / 2)
+                        lags()->push_back(lag);
+                    for (const auto until(Now() + 1000); Now() < until; );
+                }
+                if (--pending == 0)
+                    done();
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    Wait(done.Wait());
+    return *lags();
+}
+
+// drives sessions past what the Pool thread can take, with and without the governor
+int TestGovernor(int argc, const char *const argv[]) {
+    const uint64_t duration(argc == 0 ? 6000000 : std::stoull(argv[0]));
+
+    unsigned admitted;
+    const auto flooded(Arrive(nullptr, duration, admitted));
+    std::cout << std::dec << "ungoverned: " << admitted << " sessions, waiting " << Percentile(flooded, 50) / 1000 << "ms median, " << Percentile(flooded, 99) / 1000 << "ms p99" << std::endl;
+
+    Governor::Load budget;
+    budget.lag_ = std::chrono::milliseconds(5);
+    Governor governor(budget, nullptr);
+    governor.Open(std::chrono::milliseconds(100));
+    const auto governed(Arrive(&governor, duration, admitted));
+    Wait(governor.Shut());
+    std::cout << "governed: " << admitted << " sessions (" << governor.Refused() << " refused), waiting " << Percentile(governed, 50) / 1000 << "ms median, " << Percentile(governed, 99) / 1000 << "ms p99" << std::endl;
+
+    orc_assert(governor.Refused() != 0);
+    orc_assert_(Percentile(governed, 99) < 25000, "admitted sessions waited " << Percentile(governed, 99) << "us for the Pool");
+    orc_assert(Percentile(governed, 99) * 3 < Percentile(flooded, 99));
+    return 0;
+}
+
+}
@@ -0,0 +1,173 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <iostream>
+
+#include "egress.hpp"
+#include "forge.hpp"
+#include "syscall.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+namespace {
+
+// where a client's packets come out of a Translator
+class Tunnel :
+    public BufferDrain
+{
+  public:
+    uint64_t landed_ = 0;
+
+  protected:
+    void Land(const Buffer &data) override {
+        ++landed_;
+    }
+
+    void Stop(const std::string &error) noexcept override {
+    }
+};
+
+// a packet from somewhere on the internet, landing on the egress as if it came back through it
+template <typename Header_>
+void Reply(Egress &egress, uint8_t protocol, const Socket &source, const Socket &destination, uint8_t flags = 0) {
+    struct {
+        openvpn::IPv4Header ip4;
+        Header_ header;
+    } orc_packed packet = {};
+
+    packet.ip4.version_len = openvpn::IPv4Header::ver_len(4, sizeof(packet.ip4));
+    packet.ip4.tot_len = boost::endian::native_to_big<uint16_t>(sizeof(packet));
+    packet.ip4.ttl = 64;
+    packet.ip4.protocol = protocol;
+    packet.ip4.saddr = boost::endian::native_to_big(source.Host().operator uint32_t());
+    packet.ip4.daddr = boost::endian::native_to_big(destination.Host().operator uint32_t());
+    packet.header.source = boost::endian::native_to_big(source.Port());
+    packet.header.dest = boost::endian::native_to_big(destination.Port());
+    if constexpr (std::is_same_v<Header_, openvpn::TCPHeader>) {
+        packet.header.doff_res = sizeof(packet.header) << 2;
+        packet.header.flags = flags;
+    }
+
+    static_cast<BufferDrain &>(egress).Land(Beam(&packet, sizeof(packet)));
+}
+
+}
+
+// translations on a clock of their own, each second of which Expire is called
+// (as by Node::Watch): how many there are must follow the flows still active,
+// and tcp ones must go at the pace of how far along their connection was
+int TestIdle(int argc, const char *const argv[]) {
+    const uint32_t local(0x0a000002);
+    const Socket remote(0x01020304, 443);
+    const Egress::Timeouts timeouts;
+
+    // Egress is never destroyed
+    const auto &egress(*new S<Egress>(Make<Sink<Egress>>(local)));
+    Tunnel tunnel;
+    Translator translator(&tunnel, egress);
+
+    auto now(std::chrono::steady_clock::now());
+    const auto Pass([&](unsigned seconds) {
+        for (unsigned second(0); second != seconds; ++second)
+            egress->Expire(now += std::chrono::seconds(1));
+    });
+
+    // udp: each second 100 flows open and are busy for 10 seconds (every other one
+    // only being answered), then go quiet; the table should hold those busy and those
+    // not yet quiet for the timeout, and nothing once they all are
+    {
+        const unsigned rate(100), busy(10);
+        std::vector<Socket> outside;
+        for (unsigned second(0); second != 400; ++second) {
+            for (unsigned flow(0); flow != rate; ++flow)
+                outside.emplace_back(egress->Translate(translator, Three(openvpn::IPCommon::UDP, 0x0a070000 + second, 1024 + flow)));
+            for (unsigned age(1); age != busy && age <= second; ++age)
+                for (unsigned flow(0); flow != rate; ++flow) {
+                    const auto index((second - age) * rate + flow);
+                    if (flow % 2 == 0)
+                        egress->Translate(translator, Three(openvpn::IPCommon::UDP, 0x0a070000 + second - age, 1024 + flow));
+                    else
+                        Reply<openvpn::UDPHeader>(*egress, openvpn::IPCommon::UDP, remote, outside[index]);
+                }
+            Pass(1);
+
+            if (second >= timeouts.udp_ + busy) {
+                const auto expected(rate * (busy + timeouts.udp_ - 1));
+                const auto size(egress->Size());
+                orc_assert_(size >= expected - rate && size <= expected + rate, size << " translations for " << expected << " flows at " << second << "s");
+            }
+        }
+
+        std::cout << "udp: " << egress->Size() << " translations, " << egress->Expiries().udp_ << " expired, " << tunnel.landed_ << " packets answered" << std::endl;
+        Pass(timeouts.udp_ + 1);
+        orc_assert(egress->Size() == 0);
+        orc_assert(egress->Expiries().udp_ == outside.size());
+        orc_assert(translator.Memory() == 0);
+        orc_assert(egress->Used() == 0);
+    }
+
+    // tcp: 300 connections are opened; 100 are answered (one of each two then sending
+    // a fin), and 50 of the others are reset; those closed go first, then those never
+    // answered, and those established last
+    {
+        std::vector<Socket> outside;
+        for (unsigned flow(0); flow != 300; ++flow)
+            outside.emplace_back(egress->Translate(translator, Three(openvpn::IPCommon::TCP, 0x0a080001, 1024 + flow), openvpn::TCPHeader::FLAG_SYN));
+        for (unsigned flow(0); flow != 100; ++flow) {
+            Reply<openvpn::TCPHeader>(*egress, openvpn::IPCommon::TCP, remote, outside[flow], openvpn::TCPHeader::FLAG_SYN | openvpn::TCPHeader::FLAG_ACK);
+            if (flow % 2 == 0)
+                egress->Translate(translator, Three(openvpn::IPCommon::TCP, 0x0a080001, 1024 + flow), openvpn::TCPHeader::FLAG_FIN | openvpn::TCPHeader::FLAG_ACK);
+        }
+        for (unsigned flow(100); flow != 150; ++flow)
+            Reply<openvpn::TCPHeader>(*egress, openvpn::IPCommon::TCP, remote, outside[flow], openvpn::TCPHeader::FLAG_RST);
+        orc_assert(egress->Size() == 300);
+
+        Pass(timeouts.closing_ + 1);
+        orc_assert(egress->Size() == 200);
+        orc_assert(egress->Expiries().closed_ == 100);
+
+        Pass(timeouts.opening_ - timeouts.closing_);
+        orc_assert(egress->Size() == 50);
+
+        Pass(timeouts.established_ - timeouts.opening_);
+        orc_assert(egress->Size() == 0);
+        orc_assert(egress->Expiries().tcp_ == 300);
+        std::cout << "tcp: " << egress->Expiries().tcp_ << " expired, " << egress->Expiries().closed_ << " of them closed" << std::endl;
+    }
+
+    {
+        for (unsigned flow(0); flow != 10; ++flow)
+            egress->Translate(translator, Three(openvpn::IPCommon::ICMPv4, 0x0a090001, flow));
+        Pass(timeouts.icmp_ - 1);
+        orc_assert(egress->Size() == 10);
+        Pass(2);
+        orc_assert(egress->Size() == 0);
+        orc_assert(egress->Expiries().icmp_ == 10);
+    }
+
+    translator.Stop();
+    return 0;
+}
+
+}
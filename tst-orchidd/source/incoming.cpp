@@ -0,0 +1,119 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rtc_base/ssl_fingerprint.h>
+
+#include "cashier.hpp"
+#include "client.hpp"
+#include "ledger.hpp"
+#include "local.hpp"
+#include "node.hpp"
+#include "serve.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// a tunnel nothing is sent through
+class Silent :
+    public Valve,
+    public BufferDrain
+{
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+};
+
+// a client opening both its data channel and its control channel to an orchidd (on this box, with
+// a Ledger) through Incoming: the session survives the second channel, and the server sends its
+// first invoice once, so every invoice after it acknowledges a ticket
+int TestIncoming(int argc, const char *const argv[]) {
+    orc_assert_(argc == 0, "usage: incoming");
+
+    const auto ledger(Make<Ledger>());
+    ledger->Open();
+
+    const auto origin(Break<Local>());
+
+    const Address lottery("0xb02396f06CC894834b7934ecF8c8E5Ab5C1d12F1");
+    const uint256_t chain(1);
+    const Address recipient("0x2b1ce95573ec1b927a90cb488db113b40eeb064a");
+    const Address funder("0x405bc10e04e3f487e9925ad5815e4406d78b769e");
+
+    const auto journal((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string());
+    const auto cashier(Make<Cashier>(origin, Endpoint(origin, ledger->Locate("http")), ledger->Locate("ws"),
+        Float("0.03") / (1024 * 1024 * 1024), "USD", ledger->Locate("http"),
+        recipient, "", lottery, chain, recipient, journal));
+
+    // Egress is never destroyed
+    const auto egress(Make<Sink<Egress>>(0x0a000002));
+    egress->Wire<Echo>();
+
+    const auto node(Make<Node>(origin, cashier, std::vector<S<Egress>>{egress}, Make<Fair>(), Make<Governor>(Governor::Load(), nullptr), Configuration()));
+    const auto certificate(Certify());
+    const auto url(Serve(node, certificate, ledger));
+
+    const auto code(Wait([&]() -> task<int> {
+        co_await Schedule();
+        co_await Reach(origin, url);
+
+        const auto silent(Make<Sink<Silent>>());
+        const auto client(silent->Wire<Client>(url, U<rtc::SSLFingerprint>(rtc::SSLFingerprint::CreateFromCertificate(*certificate)), lottery, chain, Random<32>(), funder));
+        co_await client->Open(origin);
+
+        // no traffic: just the first invoice, and the tickets it calls for
+        co_await Sleep(3);
+
+        const auto [issued, pending, serial] = client->Tickets();
+        uint64_t servers(0), invoices(0);
+        node->Each([&](const S<Server> &server) {
+            ++servers;
+            invoices += server->Invoices();
+        });
+
+        std::cout << servers << " sessions, " << invoices << " invoices; " << issued << " tickets issued, " << pending << " unacknowledged; last invoice #" << serial << std::endl;
+
+        co_await silent->Shut();
+        co_return servers == 1 && serial >= 0 && pending == 0 && invoices == issued + 1 ? 0 : 1;
+    }()));
+
+    boost::filesystem::remove(journal);
+    return code;
+}
+
+}
@@ -0,0 +1,182 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <functional>
+#include <iostream>
+#include <map>
+
+#include "balance.hpp"
+#include "error.hpp"
+#include "invoicer.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+typedef Invoicer::Clock_ Clock_;
+using std::chrono::microseconds;
+
+// the size of an invoice as Server::Invoice builds it: ip/udp, header, stamp and invoice commands
+static const size_t Invoice_ = 28 + 36 + 36 + 4 + 8 + 32 + 72 + 32;
+
+struct Outcome {
+    uint64_t billed_ = 0;
+    Fixed paid_ = 0;
+    Fixed lowest_ = 0;
+    uint64_t pings_ = 0;
+    uint64_t invoices_ = 0;
+    bool current_ = false;
+};
+
+// a session carrying rate bytes/s to a client latency away, which (like
+// Client) asks for an invoice every 256KB and tops up to twice its prepay once
+// the balance it was last told of (plus its tickets in flight) is under it
+static Outcome Simulate(bool coalesce, uint64_t rate, uint64_t seconds) {
+    const uint64_t latency(10000);
+    const Fixed prepay(Balance::Cost(4 * 1024 * 1024));
+    const size_t packet(1400);
+    const uint64_t step(100);
+
+    Outcome outcome;
+    Balance balance;
+    Invoicer invoicer({});
+
+    std::multimap<uint64_t, std::function<void ()>> events;
+    const auto at([&](uint64_t time, std::function<void ()> code) {
+        events.emplace(time, std::move(code));
+    });
+
+    // the client's side
+    int64_t serial(-1);
+    Fixed told(0);
+    std::map<uint64_t, Fixed> pending;
+    uint64_t tickets(0);
+    uint64_t benefit(0);
+
+    uint64_t now(0);
+    const auto clock([&]() { return Clock_::time_point() + microseconds(now); });
+
+    std::function<void (uint64_t)> send;
+    send = [&](uint64_t ticket) {
+        const auto [current, value] = balance.Read();
+        invoicer.Sent(clock(), current, value, Invoice_);
+        ++outcome.invoices_;
+        at(now + latency, [&, current = current, value = value, ticket]() {
+            if (serial < int64_t(current)) {
+                serial = current;
+                told = value;
+            }
+            if (ticket != 0)
+                pending.erase(ticket);
+            auto predicted(told);
+            for (const auto &[id, amount] : pending)
+                predicted += amount;
+            if (predicted >= prepay)
+                return;
+            const auto amount(prepay * 2 - predicted);
+            const auto id(++tickets);
+            pending.emplace(id, amount);
+            at(now + latency, [&, id, amount]() {
+                balance.Credit(amount);
+                outcome.paid_ += amount;
+                invoicer.Credited(amount);
+                send(id);
+            });
+        });
+    };
+
+    const std::function<void ()> request([&]() {
+        ++outcome.pings_;
+        if (!coalesce)
+            return send(0);
+        const auto [current, value] = balance.Read();
+        Clock_::duration delay;
+        switch (invoicer(clock(), current, value, false, delay)) {
+            case Invoicer::Send:
+                return send(0);
+            case Invoicer::Defer:
+                at(now + std::chrono::duration_cast<microseconds>(delay).count(), [&]() {
+                    if (invoicer.Flush(std::get<0>(balance.Read())))
+                        send(0);
+                });
+                break;
+            case Invoicer::Skip:
+                break;
+        }
+    });
+
+    send(0);
+
+    const auto end(seconds * 1000000);
+    uint64_t carried(0);
+    for (; now < end + 2000000; now += step) {
+        for (auto event(events.begin()); event != events.end() && event->first <= now; event = events.erase(event))
+            event->second();
+
+        if (now >= end)
+            continue;
+
+        for (carried += rate * step / 1000000; carried >= packet; carried -= packet) {
+            Fixed after;
+            balance.Debit(Balance::Cost(packet), true, after);
+            outcome.billed_ += packet;
+            outcome.lowest_ = std::min(outcome.lowest_, after);
+
+            at(now + latency, [&]() {
+                benefit += packet;
+                if (benefit < 256 * 1024)
+                    return;
+                benefit -= 256 * 1024;
+                at(now + latency, request);
+            });
+        }
+    }
+
+    outcome.current_ = serial == int64_t(std::get<0>(balance.Read()));
+    return outcome;
+}
+
+// invoices for every request (as Server did) and coalesced: with fewer invoices the
+// client must never fall further behind (so be cut off, or underbilled), must pay for
+// everything, and must end up told its true balance
+int TestInvoicing(int argc, const char *const argv[]) {
+    const uint64_t seconds(argc == 0 ? 20 : std::stoull(argv[0]));
+    // Server::Bill's floor
+    const auto floor(Balance::Cost(128 * 1024));
+
+    for (const uint64_t rate : {1 * 1024 * 1024, 10 * 1024 * 1024, 100 * 1024 * 1024}) {
+        const auto every(Simulate(false, rate, seconds));
+        const auto coalesced(Simulate(true, rate, seconds));
+
+        for (const auto &[name, outcome] : {std::make_pair("every", &every), std::make_pair("coalesced", &coalesced)})
+            std::cout << std::dec << rate / 1024 << "KB/s, " << name << ": " << outcome->pings_ << " requests, " << outcome->invoices_ << " invoices, " << double(outcome->invoices_ * Invoice_) / outcome->billed_ << " control bytes per data byte; lowest balance " << (outcome->lowest_ >> Fraction_) << " bytes" << std::endl;
+
+        // before its first ticket lands, any client is behind by a round trip's worth
+        orc_assert_(coalesced.lowest_ >= std::min(every.lowest_, -floor), "coalescing let the balance fall to " << (coalesced.lowest_ >> Fraction_) << " at " << rate);
+        orc_assert_(coalesced.paid_ >= Balance::Cost(coalesced.billed_), "paid for " << (coalesced.paid_ >> Fraction_) << " of " << coalesced.billed_ << " bytes");
+        orc_assert_(coalesced.current_, "the client wasn't told its final balance at " << rate);
+        orc_assert(coalesced.invoices_ <= every.invoices_);
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,202 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "error.hpp"
+#include "journal.hpp"
+#include "loopback.hpp"
+#include "syscall.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+static void Write(int file, const void *data, size_t size) {
+    for (size_t offset(0); offset != size; )
+        offset += orc_syscall(write(file, static_cast<const uint8_t *>(data) + offset, size - offset));
+}
+
+// what the child acknowledges; a line is only written once its record is synced
+static void Report(int pipe, const std::string &line) {
+    Write(pipe, line.data(), line.size());
+}
+
+// settles half of what the last one left, then appends (and settles some) until killed
+[[noreturn]]
+static void Child(const std::string &path, int pipe, unsigned round) {
+    Journal journal(path);
+    auto pending(journal.Pending());
+
+    Wait([&]() -> task<void> {
+        for (const auto &[id, data] : pending)
+            if (id % 2 == 0) {
+                co_await journal.Settle(id);
+                Report(pipe, "S " + std::to_string(id) + "\n");
+            }
+    }());
+
+    std::atomic<uint64_t> sequence(0);
+    // enough at once that most syncs carry several records
+    for (unsigned i(0); i != 32; ++i)
+        Spawn([&, i]() noexcept -> task<void> {
+            std::mt19937 random(round * 32 + i);
+            for (;;) {
+                const auto data("r" + std::to_string(round) + "-" + std::to_string(sequence++));
+                const auto id(co_await journal.Append(Subset(data)));
+                Report(pipe, "A " + std::to_string(id) + " " + data + "\n");
+                if (random() % 2 == 0) {
+                    co_await journal.Settle(id);
+                    Report(pipe, "S " + std::to_string(id) + "\n");
+                }
+            }
+        });
+
+    for (;;)
+        pause();
+}
+
+int TestJournal(int argc, const char *const argv[]) {
+    const unsigned rounds(argc == 0 ? 40 : std::stoul(argv[0]));
+
+    char directory[] = "/tmp/orchid-journal.XXXXXX";
+    orc_assert(mkdtemp(directory) != nullptr);
+    const std::string path(std::string(directory) + "/tickets");
+
+    std::mt19937 random(0);
+
+    // acknowledged and not (acknowledged as) settled: these must all be replayed
+    std::map<Journal::Id, std::string> expected;
+    std::set<Journal::Id> settled;
+    uint64_t appends(0);
+    uint64_t torn(0);
+
+    for (unsigned round(0); round != rounds; ++round) {
+        int pipes[2];
+        orc_syscall(pipe(pipes));
+
+        const auto child(orc_syscall(fork()));
+        if (child == 0) {
+            close(pipes[0]);
+            Child(path, pipes[1], round);
+        }
+
+        close(pipes[1]);
+
+        std::string output;
+        const auto deadline(Now() + 20000 + random() % 200000);
+        for (uint64_t now; (now = Now()) < deadline; ) {
+            pollfd poll{pipes[0], POLLIN, 0};
+            if (orc_syscall(::poll(&poll, 1, (deadline - now) / 1000 + 1)) == 0)
+                continue;
+            char data[4096];
+            const auto writ(orc_syscall(read(pipes[0], data, sizeof(data))));
+            orc_assert(writ != 0);
+            output.append(data, writ);
+        }
+
+        orc_syscall(kill(child, SIGKILL));
+        orc_syscall(waitpid(child, nullptr, 0));
+
+        for (;;) {
+            char data[4096];
+            const auto writ(orc_syscall(read(pipes[0], data, sizeof(data))));
+            if (writ == 0)
+                break;
+            output.append(data, writ);
+        }
+
+        close(pipes[0]);
+
+        // a partial line was being written when the child was killed
+        output.erase(output.rfind('\n') + 1);
+
+        std::istringstream lines(output);
+        for (std::string kind; lines >> kind; ) {
+            Journal::Id id;
+            lines >> id;
+            if (kind == "A") {
+                std::string data;
+                lines >> data;
+                orc_assert_(expected.try_emplace(id, data).second, "id " << id << " acknowledged twice");
+                ++appends;
+            } else if (kind == "S") {
+                expected.erase(id);
+                settled.insert(id);
+            } else orc_assert_(false, "unknown report " << kind);
+        }
+
+        // SIGKILL can't tear a write(2), but power loss can: leave the start of a record behind
+        if (random() % 2 == 0) {
+            const auto file(orc_syscall(open(path.c_str(), O_WRONLY | O_APPEND)));
+            uint8_t garbage[32];
+            for (auto &value : garbage)
+                value = random();
+            // a plausible size, so only the check (or the end of the file) catches it
+            garbage[0] = 0;
+            garbage[1] = 0;
+            garbage[2] = 0;
+            garbage[3] = 20;
+            Write(file, garbage, 1 + random() % sizeof(garbage));
+            close(file);
+            ++torn;
+        }
+
+        Journal journal(path);
+        std::set<std::string> seen;
+        std::map<Journal::Id, std::string> replayed;
+        for (const auto &[id, data] : journal.Pending()) {
+            const std::string value(reinterpret_cast<const char *>(data.data()), data.size());
+            orc_assert_(settled.find(id) == settled.end(), "settled id " << id << " replayed");
+            orc_assert_(seen.insert(value).second, value << " replayed twice");
+            replayed.emplace(id, value);
+        }
+
+        for (const auto &[id, data] : expected) {
+            const auto value(replayed.find(id));
+            orc_assert_(value != replayed.end(), "acknowledged " << data << " (id " << id << ") lost in round " << round);
+            orc_assert_(value->second == data, "id " << id << " replayed as " << value->second << " not " << data);
+        }
+
+        // appends that were synced but not yet acknowledged are fine to have kept
+        expected = std::move(replayed);
+        std::cout << "round " << round << ": " << expected.size() << " pending in " << journal.Records() << " records" << std::endl;
+    }
+
+    std::cout << std::dec << rounds << " kills, " << torn << " torn tails, " << appends << " acknowledged appends, " << settled.size() << " settled: nothing lost or duplicated" << std::endl;
+
+    unlink(path.c_str());
+    unlink((path + ".tmp").c_str());
+    rmdir(directory);
+    return 0;
+}
+
+}
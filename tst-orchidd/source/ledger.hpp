@@ -0,0 +1,155 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_LEDGER_HPP
+#define ORCHID_LEDGER_HPP
+
+#include <atomic>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include "baton.hpp"
+#include "json.hpp"
+#include "jsonrpc.hpp"
+#include "locator.hpp"
+#include "task.hpp"
+
+namespace orc {
+
+// a local stand-in for everything orchidd talks to besides its clients: an
+// ethereum node's json-rpc (over http, and over a websocket for Cashier's
+// Station), on which every pot is funded far beyond any ticket, and coinbase's
+// prices. it only answers what Cashier asks
+class Ledger {
+  private:
+    asio::ip::tcp::acceptor acceptor_;
+
+    std::atomic<uint64_t> subscriptions_ = 0;
+    std::atomic<uint64_t> looks_ = 0;
+    std::atomic<uint64_t> transactions_ = 0;
+
+    Json::Value Answer(const Json::Value &request) {
+        Json::Value response;
+        response["jsonrpc"] = "2.0";
+        response["id"] = request["id"];
+
+        const auto method(request["method"].asString());
+        if (method == "eth_call") {
+            // look(funder, signer): amount, escrow, unlock, verify, codehash, shared
+            ++looks_;
+            const auto plenty(uint128_t(1) << 120);
+            response["result"] = Coder<uint128_t, uint128_t, uint256_t, Address, Bytes32, Bytes>::Encode(plenty, plenty, 0, Address(uint160_t(0)), Zero<32>(), Bytes()).hex();
+        } else if (method == "eth_subscribe")
+            response["result"] = Number<uint128_t>(++subscriptions_).hex();
+        else if (method == "eth_blockNumber")
+            response["result"] = "0x1";
+        else if (method == "personal_sendTransaction") {
+            ++transactions_;
+            response["result"] = Number<uint256_t>(transactions_.load()).hex();
+        } else
+            response["result"] = Json::Value();
+
+        return response;
+    }
+
+    static std::string Price(const std::string &target) {
+        Json::Value response;
+        response["data"]["amount"] = target.find("/ETH-") != std::string::npos ? "300" : "0.3";
+        return Json::FastWriter().write(response);
+    }
+
+    task<void> Serve(asio::ip::tcp::socket socket) {
+        namespace http = boost::beast::http;
+        namespace websocket = boost::beast::websocket;
+
+        boost::beast::tcp_stream stream(std::move(socket));
+        boost::beast::flat_buffer buffer;
+
+        for (;;) {
+            http::request<http::string_body> request;
+            co_await http::async_read(stream, buffer, request, Token());
+
+            if (websocket::is_upgrade(request)) {
+                websocket::stream<boost::beast::tcp_stream> duplex(std::move(stream));
+                co_await duplex.async_accept(request, Token());
+                duplex.text(true);
+                for (;;) {
+                    boost::beast::flat_buffer message;
+                    co_await duplex.async_read(message, Token());
+                    const auto response(Json::FastWriter().write(Answer(Parse(boost::beast::buffers_to_string(message.data())))));
+                    co_await duplex.async_write(asio::buffer(response), Token());
+                }
+            }
+
+            http::response<http::string_body> response(http::status::ok, request.version());
+            response.set(http::field::content_type, "application/json");
+            if (request.method() == http::verb::get)
+                response.body() = Price(std::string(request.target()));
+            else
+                response.body() = Json::FastWriter().write(Answer(Parse(request.body())));
+            response.keep_alive(request.keep_alive());
+            response.prepare_payload();
+            co_await http::async_write(stream, response, Token());
+
+            if (!request.keep_alive())
+                co_return;
+        }
+    }
+
+  public:
+    Ledger() :
+        acceptor_(Context(), {asio::ip::make_address("127.0.0.1"), 0})
+    {
+    }
+
+    void Open() {
+        Spawn([this]() noexcept -> task<void> {
+            for (;;) {
+                asio::ip::tcp::socket socket(Context());
+                if (orc_ignore({ co_await acceptor_.async_accept(socket, Token()); }))
+                    co_return;
+                Spawn([this, socket = std::move(socket)]() mutable noexcept -> task<void> {
+                    orc_ignore({ co_await Serve(std::move(socket)); });
+                });
+            }
+        });
+    }
+
+    Locator Locate(const std::string &scheme) const {
+        return {scheme, "127.0.0.1", std::to_string(acceptor_.local_endpoint().port()), "/"};
+    }
+
+    // pots looked up (each a signer that sent its first ticket), and winners redeemed
+    uint64_t Looks() const {
+        return looks_;
+    }
+
+    uint64_t Transactions() const {
+        return transactions_;
+    }
+};
+
+}
+
+#endif//ORCHID_LEDGER_HPP
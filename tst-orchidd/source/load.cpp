@@ -0,0 +1,237 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rtc_base/ssl_fingerprint.h>
+
+#include "cashier.hpp"
+#include "client.hpp"
+#include "datagram.hpp"
+#include "ledger.hpp"
+#include "local.hpp"
+#include "loopback.hpp"
+#include "node.hpp"
+#include "serve.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// a synthetic client's tunnel: it stamps what it sends and times what comes back
+class Probe :
+    public Valve,
+    public BufferDrain
+{
+  private:
+    const Socket source_;
+
+    struct Locked_ {
+        std::vector<uint64_t> delays_;
+        uint64_t bytes_ = 0;
+    }; Locked<Locked_> locked_;
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+        Datagram(data, [&](const Socket &source, const Socket &destination, Window window) {
+            const auto [stamp, rest] = Take<uint64_t, Window>(window);
+            const auto locked(locked_());
+            locked->delays_.push_back(Now() - stamp);
+            locked->bytes_ += data.size();
+            return true;
+        });
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    Probe(Socket source) :
+        source_(std::move(source))
+    {
+    }
+
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+
+    task<void> Send(const Beam &padding) {
+        static const Socket target(asio::ip::make_address("10.0.0.1"), 7);
+        co_return co_await Inner()->Send(Datagram(source_, target, Tie(Number<uint64_t>(Now()), padding)));
+    }
+
+    std::tuple<std::vector<uint64_t>, uint64_t> Collect() {
+        const auto locked(locked_());
+        return {std::move(locked->delays_), locked->bytes_};
+    }
+};
+
+// stream one of the traffic patterns until end (in Now() time): bulk is as fast
+// as the session allows, paced is rate bytes/s, and bursty is four times rate
+// for a quarter of every second
+static task<uint64_t> Stream(Probe &probe, const std::string &pattern, uint64_t rate, uint64_t end) {
+    const Beam padding(1200);
+    const auto start(Now());
+    uint64_t sent(0);
+
+    for (;;) {
+        const auto now(Now());
+        if (now >= end)
+            break;
+
+        if (pattern != "bulk") {
+            const auto elapsed(now - start);
+            uint64_t due;
+            if (pattern == "paced")
+                due = start + sent * padding.size() * 1000000 / rate;
+            else if (elapsed % 1000000 >= 250000)
+                due = start + (elapsed / 1000000 + 1) * 1000000;
+            else
+                due = now + padding.size() * 1000000 / (rate * 4);
+            if (due > now + 1000) {
+                co_await Sleep(std::chrono::milliseconds((due - now) / 1000));
+                continue;
+            }
+        }
+
+        if (orc_ignore({ co_await probe.Send(padding); }))
+            break;
+        ++sent;
+    }
+
+    co_return sent;
+}
+
+// a whole orchidd (its Node, Cashier and Egress) on this box, with a Ledger as its
+// ethereum node and price api and an Echo as its internet; clients negotiate over
+// its https signaling, pays with tickets that it checks as it would real ones, and
+// streams udp through it that comes back to be timed
+int TestLoad(int argc, const char *const argv[]) {
+    orc_assert_(argc <= 4, "usage: load [clients] [seconds] [bulk|paced|bursty] [bytes/s per client]");
+    const unsigned clients(argc > 0 ? std::stoul(argv[0]) : 16);
+    const unsigned seconds(argc > 1 ? std::stoul(argv[1]) : 10);
+    const std::string pattern(argc > 2 ? argv[2] : "paced");
+    const uint64_t rate(argc > 3 ? std::stoull(argv[3]) : 1024 * 1024);
+    orc_assert_(pattern == "bulk" || pattern == "paced" || pattern == "bursty", "unknown pattern " << pattern);
+
+    const auto ledger(Make<Ledger>());
+    ledger->Open();
+
+    const auto origin(Break<Local>());
+
+    const Address lottery("0xb02396f06CC894834b7934ecF8c8E5Ab5C1d12F1");
+    const uint256_t chain(1);
+    const Address recipient("0x2b1ce95573ec1b927a90cb488db113b40eeb064a");
+    const Address funder("0x405bc10e04e3f487e9925ad5815e4406d78b769e");
+
+    const auto journal((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string());
+    const auto cashier(Make<Cashier>(origin, Endpoint(origin, ledger->Locate("http")), ledger->Locate("ws"),
+        Float("0.03") / (1024 * 1024 * 1024), "USD", ledger->Locate("http"),
+        recipient, "", lottery, chain, recipient, journal));
+
+    const auto egress(Make<Sink<Egress>>(0x0a000002));
+    egress->Wire<Echo>();
+
+    const auto node(Make<Node>(origin, cashier, std::vector<S<Egress>>{egress}, Make<Fair>(), Make<Governor>(Governor::Load(), nullptr), Configuration(), false, clients));
+
+    const auto certificate(Certify());
+    const auto url(Serve(node, certificate, ledger));
+
+    const auto code(Wait([&]() -> task<int> {
+        co_await Schedule();
+        co_await Reach(origin, url);
+
+        std::vector<S<Sink<Probe>>> probes;
+        std::vector<uint64_t> setups;
+        unsigned failed(0);
+        unsigned pending(clients);
+        Event opened;
+
+        const auto start(Now());
+        for (unsigned i(0); i != clients; ++i)
+            Spawn([&, i]() noexcept -> task<void> {
+                const auto probe(Make<Sink<Probe>>(Socket(asio::ip::make_address("10.7.0.2"), 1024 + i)));
+                const auto client(probe->Wire<Client>(url, U<rtc::SSLFingerprint>(rtc::SSLFingerprint::CreateFromCertificate(*certificate)), lottery, chain, Random<32>(), funder));
+                const auto before(Now());
+                if (orc_ignore({ co_await client->Open(origin); }))
+                    ++failed;
+                else {
+                    setups.push_back(Now() - before);
+                    probes.push_back(probe);
+                }
+                if (--pending == 0)
+                    opened();
+            });
+
+        co_await opened.Wait();
+        const auto negotiated(Now() - start);
+
+        std::cout << std::dec << probes.size() << "/" << clients << " sessions in " << negotiated / 1000 << "ms (" << probes.size() * 1000000 / std::max<uint64_t>(negotiated, 1) << "/s), " << failed << " failed" << std::endl;
+        std::cout << "setup: p50 " << Percentile(setups, 50) / 1000 << "ms, p99 " << Percentile(setups, 99) / 1000 << "ms" << std::endl;
+
+        uint64_t sent(0);
+        pending = probes.size();
+        Event streamed;
+
+        const auto end(Now() + seconds * 1000000);
+        for (const auto &probe : probes)
+            Spawn([&, probe]() noexcept -> task<void> {
+                sent += co_await Stream(*probe, pattern, rate, end);
+                if (--pending == 0)
+                    streamed();
+            });
+
+        if (!probes.empty())
+            co_await streamed.Wait();
+
+        // let the last echoes come back
+        co_await Sleep(1);
+
+        std::vector<uint64_t> delays;
+        uint64_t bytes(0);
+        for (const auto &probe : probes) {
+            const auto [some, more] = probe->Collect();
+            delays.insert(delays.end(), some.begin(), some.end());
+            bytes += more;
+        }
+
+        std::cout << pattern << ": " << sent / seconds << " packets/s sent, " << delays.size() / seconds << " packets/s forwarded, " << bytes / seconds << " B/s" << std::endl;
+        std::cout << "forwarding (round trip): p50 " << Percentile(delays, 50) << "us, p99 " << Percentile(delays, 99) << "us" << std::endl;
+        std::cout << ledger->Looks() << " pots checked for tickets, " << ledger->Transactions() << " winners redeemed" << std::endl;
+
+        for (const auto &probe : probes)
+            co_await probe->Shut();
+
+        co_return failed == 0 && ledger->Looks() != 0 ? 0 : 1;
+    }()));
+
+    boost::filesystem::remove(journal);
+    return code;
+}
+
+}
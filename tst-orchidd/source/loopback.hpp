@@ -0,0 +1,142 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_LOOPBACK_HPP
+#define ORCHID_LOOPBACK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "channel.hpp"
+#include "locked.hpp"
+
+namespace orc {
+
+inline uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t Percentile(std::vector<uint64_t> values, unsigned percent) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() * percent / 100];
+}
+
+// echoes every message back over the channel it arrived on
+class Reflect :
+    public Valve,
+    public BufferDrain
+{
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+        Spawn([this, data = Beam(data)]() noexcept -> task<void> {
+            orc_ignore({ co_await Inner()->Send(data); });
+        });
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+};
+
+// the answering side of a loopback session; every data channel is reflected
+class Mirror final :
+    public Peer
+{
+  private:
+    std::vector<S<Sink<Reflect>>> reflects_;
+
+  protected:
+    void Land(rtc::scoped_refptr<webrtc::DataChannelInterface> interface) override {
+        const auto reflect(Break<Sink<Reflect>>());
+        const auto channel(reflect->Wire<Channel>(shared_from_this(), interface));
+        reflects_.emplace_back(reflect);
+        Spawn([channel]() noexcept -> task<void> {
+            co_await channel->Open();
+        });
+    }
+
+    void Stop(const std::string &error) noexcept override {
+    }
+
+  public:
+    Mirror(const S<Origin> &origin, Configuration configuration) :
+        Peer(origin, std::move(configuration))
+    {
+    }
+
+    ~Mirror() override {
+        Close();
+    }
+};
+
+// records the round trip of messages stamped by Stamp(), grouped by tag
+class Meter :
+    public Valve,
+    public BufferDrain
+{
+  private:
+    struct Locked_ {
+        std::map<uint8_t, std::vector<uint64_t>> delays_;
+    }; Locked<Locked_> locked_;
+
+  protected:
+    virtual Pump<Buffer> *Inner() noexcept = 0;
+
+    void Land(const Buffer &data) override {
+        const auto [tag, stamp, rest] = Take<uint8_t, uint64_t, Window>(data);
+        locked_()->delays_[tag].push_back(Now() - stamp);
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        Valve::Stop();
+    }
+
+  public:
+    task<void> Shut() noexcept override {
+        co_await Inner()->Shut();
+        co_await Valve::Shut();
+    }
+
+    template <size_t Size_>
+    task<void> Stamp(uint8_t tag) {
+        co_return co_await Inner()->Send(Tie(Number<uint8_t>(tag), Number<uint64_t>(Now()), Zero<Size_>()));
+    }
+
+    std::vector<uint64_t> Delays(uint8_t tag) {
+        return locked_()->delays_[tag];
+    }
+};
+
+}
+
+#endif//ORCHID_LOOPBACK_HPP
@@ -0,0 +1,96 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+
+#include "error.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// NOLINTNEXTLINE (modernize-avoid-c-arrays)
+int Main(int argc, const char *const argv[]) {
+    orc_assert_(argc >= 2, "usage: " << argv[0] << " <test> [args...]");
+    const std::string test(argv[1]);
+    argc -= 2;
+    argv += 2;
+
+    if (false) {
+    } else if (test == "first")
+        return TestFirst(argc, argv);
+    else if (test == "direct")
+        return TestDirect(argc, argv);
+    else if (test == "control")
+        return TestControl(argc, argv);
+    else if (test == "incoming")
+        return TestIncoming(argc, argv);
+    else if (test == "dtls")
+        return TestDtls(argc, argv);
+    else if (test == "utp")
+        return TestUtp(argc, argv);
+    else if (test == "billing")
+        return TestBilling(argc, argv);
+    else if (test == "verify")
+        return TestVerify(argc, argv);
+    else if (test == "journal")
+        return TestJournal(argc, argv);
+    else if (test == "signal")
+        return TestSignal(argc, argv);
+    else if (test == "sessions")
+        return TestSessions(argc, argv);
+    else if (test == "replay")
+        return TestReplay(argc, argv);
+    else if (test == "reveals")
+        return TestReveals(argc, argv);
+    else if (test == "fair")
+        return TestFair(argc, argv);
+    else if (test == "codel")
+        return TestCodel(argc, argv);
+    else if (test == "governor")
+        return TestGovernor(argc, argv);
+    else if (test == "invoicing")
+        return TestInvoicing(argc, argv);
+    else if (test == "sizing")
+        return TestSizing(argc, argv);
+    else if (test == "footprint")
+        return TestFootprint(argc, argv);
+    else if (test == "load")
+        return TestLoad(argc, argv);
+    else if (test == "nat")
+        return TestNAT(argc, argv);
+    else if (test == "ports")
+        return TestPorts(argc, argv);
+    else if (test == "idle")
+        return TestIdle(argc, argv);
+    else if (test == "shards")
+        return TestShards(argc, argv);
+    else orc_throw("unknown test " << test);
+}
+
+}
+
+int main(int argc, const char *const argv[]) { try {
+    return orc::Main(argc, argv);
+} catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+} }
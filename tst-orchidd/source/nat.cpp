@@ -0,0 +1,167 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "error.hpp"
+#include "tests.hpp"
+#include "translations.hpp"
+
+namespace orc {
+
+namespace {
+
+struct Identity {
+    size_t operator ()(uint64_t value) const {
+        return value;
+    }
+};
+
+typedef Translations<uint64_t, uint64_t, Identity> Table;
+
+// an inside protocol, address and port, as Egress packs them
+uint64_t Flow(uint64_t index) {
+    return uint64_t(17) << 48 | (0x0a000000 + (index >> 10)) << 16 | (index & 1023);
+}
+
+template <typename Code_>
+double Rate(unsigned threads, uint64_t lookups, Code_ &&code) {
+    const auto before(std::chrono::steady_clock::now());
+    std::vector<std::thread> workers;
+    for (unsigned thread(0); thread != threads; ++thread)
+        workers.emplace_back([&, thread]() {
+            // each thread walks the flows in its own scattered order
+            for (uint64_t i(0); i != lookups; ++i)
+                code(Mix(i * threads + thread));
+        });
+    for (auto &worker : workers)
+        worker.join();
+    const std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - before);
+    return lookups * threads / elapsed.count();
+}
+
+}
+
+// the sharded table behind Egress, against what it replaced (a std::map behind
+// a single lock, of about the same number of entries) as more threads look up
+int TestNAT(int argc, const char *const argv[]) {
+    const uint64_t entries(argc < 1 ? 1000000 : std::stoull(argv[0]));
+    const uint64_t lookups(argc < 2 ? 2000000 : std::stoull(argv[1]));
+
+    {
+        Table table(256);
+        std::optional<Table::Entry> evicted;
+        for (uint64_t i(0); i != 100; ++i) {
+            auto value(i * 2);
+            orc_assert(table.Insert(Flow(i), value, evicted));
+            orc_assert(!evicted);
+        }
+
+        auto value(uint64_t(0));
+        orc_assert(!table.Insert(Flow(7), value, evicted));
+        orc_assert(value == 14);
+        orc_assert(table.Find(Flow(9), [&](uint64_t &value) { orc_assert(value == 18); ++value; }));
+        orc_assert(table.Find(Flow(9), [&](uint64_t value) { orc_assert(value == 19); }));
+        orc_assert(!table.Find(Flow(100), [&](uint64_t) { orc_assert(false); }));
+
+        orc_assert(table.Erase(Flow(3)) == 6);
+        orc_assert(!table.Erase(Flow(3)));
+        orc_assert(table.Size() == 99);
+
+        // every other entry is dropped, and what was probed past them must still be found
+        table.Sweep([](uint64_t key, uint64_t) { return (key & 1) != 0; });
+        orc_assert(table.Size() == 50);
+        for (uint64_t i(0); i != 100; ++i)
+            orc_assert(table.Find(Flow(i), [](uint64_t) {}) == (i % 2 == 0));
+    }
+
+    {
+        // one shard, so the order entries are evicted in is the exact lru
+        Translations<uint64_t, uint64_t, Identity, 1> table(32);
+        std::optional<Table::Entry> evicted;
+        uint64_t size(0);
+        for (;; ++size) {
+            auto value(size);
+            orc_assert(table.Insert(Flow(size), value, evicted));
+            if (evicted)
+                break;
+        }
+
+        orc_assert(evicted->first == Flow(0));
+        orc_assert(table.Find(Flow(1), [](uint64_t) {}));
+        auto value(uint64_t(0));
+        evicted.reset();
+        orc_assert(table.Insert(Flow(size + 1), value, evicted));
+        orc_assert(evicted->first == Flow(2));
+        orc_assert(table.Evict(0)->first == Flow(3));
+        orc_assert(table.Evict(0)->first == Flow(4));
+        orc_assert(table.Size() == size - 2);
+        std::cout << "lru: " << size << " entries in a shard of 64 slots" << std::endl;
+    }
+
+    Table table(entries);
+    std::map<uint64_t, uint64_t> map;
+    std::mutex mutex;
+
+    for (uint64_t i(0); i != entries; ++i) {
+        auto value(i);
+        std::optional<Table::Entry> evicted;
+        orc_assert(table.Insert(Flow(i), value, evicted));
+        orc_assert(!evicted);
+        map.emplace(Flow(i), i);
+    }
+
+    std::cout << "nat: " << entries << " entries, " << Table::Bytes_ << " bytes each" << std::endl;
+
+    for (const unsigned threads : {1, 2, 4, 8}) {
+        std::atomic<uint64_t> missed(0);
+
+        const auto sharded(Rate(threads, lookups, [&](uint64_t random) {
+            const auto index(random % entries);
+            if (!table.Find(Flow(index), [&](uint64_t value) { orc_assert(value == index); }))
+                ++missed;
+        }));
+
+        const auto locked(Rate(threads, lookups, [&](uint64_t random) {
+            const auto index(random % entries);
+            std::unique_lock<std::mutex> lock(mutex);
+            const auto found(map.find(Flow(index)));
+            if (found == map.end())
+                ++missed;
+            else
+                orc_assert(found->second == index);
+        }));
+
+        orc_assert(missed == 0);
+        std::cout << threads << " threads: " << uint64_t(sharded) << " lookups/s sharded, " << uint64_t(locked) << " with std::map and a lock" << std::endl;
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,109 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#include "ephemeral.hpp"
+#include "error.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// short flows (as of dns or of a busy web client) opened at a steady rate and
+// closed a while later, on a clock of their own: no port may go to two flows at
+// once, nor (unless counted as exhausted) to one before it cooled down. at the
+// rates given, the first run has ports to spare; the second needs more than can
+// have cooled, so must count being exhausted; the third has more flows open at
+// once than there are ports, so must be refused
+int TestPorts(int argc, const char *const argv[]) {
+    const uint64_t flows(argc == 0 ? 1000000 : std::stoull(argv[0]));
+
+    typedef Ephemeral::Clock_ Clock_;
+    const uint16_t base(4096);
+    const auto cooldown(std::chrono::seconds(30));
+    const size_t ports(65536 - base);
+
+    for (const unsigned rate : {1000, 3000, 10000}) {
+        const auto lasting(std::chrono::seconds(10));
+        Ephemeral ephemeral(base, cooldown);
+
+        // when each port was last given back, and if it is open now
+        std::vector<Clock_::time_point> freed(65536);
+        std::vector<bool> open(65536, false);
+        std::deque<std::pair<Clock_::time_point, uint16_t>> live;
+
+        auto now(Clock_::now());
+        uint64_t opened(0), refused(0), adjacent(0);
+        uint16_t last(0);
+
+        for (uint64_t flow(0); flow != flows; ++flow) {
+            now += std::chrono::microseconds(1000000 / rate);
+
+            for (; !live.empty() && live.front().first <= now; live.pop_front()) {
+                const auto port(live.front().second);
+                open[port] = false;
+                freed[port] = now;
+                ephemeral.Free(port, now);
+            }
+
+            const auto exhausted(ephemeral.Exhausted());
+            const auto port(ephemeral.Allocate(now));
+            if (!port) {
+                orc_assert(ephemeral.Used() == ports);
+                ++refused;
+                continue;
+            }
+
+            orc_assert(*port >= base);
+            orc_assert_(!open[*port], "port " << *port << " given to two flows");
+            if (ephemeral.Exhausted() == exhausted)
+                orc_assert_(freed[*port] == Clock_::time_point() || now - freed[*port] >= cooldown, "port " << *port << " reused before it cooled down");
+
+            if (*port == last + 1)
+                ++adjacent;
+            last = *port;
+
+            open[*port] = true;
+            live.emplace_back(now + lasting, *port);
+            ++opened;
+            orc_assert(ephemeral.Used() == live.size());
+        }
+
+        std::cout << rate << " flows/s: " << opened << " opened, " << refused << " refused, " << ephemeral.Exhausted() << " times exhausted, " << ephemeral.Cooling() << " cooling down, " << adjacent << " one after another" << std::endl;
+
+        // the ports handed out one after another should look no more related than by chance
+        orc_assert(adjacent < opened / 1000 + 10);
+
+        if (rate == 1000)
+            orc_assert(ephemeral.Exhausted() == 0);
+        else
+            orc_assert(ephemeral.Exhausted() != 0);
+        orc_assert((refused != 0) == (rate == 10000));
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,122 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+
+#include "error.hpp"
+#include "replay.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// what Server::Submit used to do: the last 10 tickets in a set, and a floor under the rest
+class Horizon {
+  private:
+    uint64_t issued_ = 0;
+    std::set<std::tuple<uint64_t, uint64_t>> nonces_;
+
+  public:
+    bool operator ()(uint64_t issued, uint64_t nonce) {
+        if (issued < issued_ || !nonces_.emplace(issued, nonce).second)
+            return false;
+        while (nonces_.size() > 10) {
+            issued_ = std::get<0>(*nonces_.begin()) + 1;
+            nonces_.erase(nonces_.begin());
+        }
+        return true;
+    }
+};
+
+struct Delivery {
+    uint64_t arrival_;
+    uint32_t issued_;
+    uint64_t nonce_;
+};
+
+// tickets issued at rate per second arrive late (so out of order), and some arrive again
+// (some after the window): the filter must never accept one twice, or one outside its window
+int TestReplay(int argc, const char *const argv[]) {
+    const uint64_t count(argc == 0 ? 100000 : std::stoull(argv[0]));
+    const uint32_t window(60);
+
+    for (const unsigned rate : {1, 20, 40}) {
+        std::mt19937_64 random(rate);
+        const uint32_t epoch(1600000000);
+
+        std::vector<Delivery> deliveries;
+        for (uint64_t i(0); i != count; ++i) {
+            // milliseconds, to order deliveries within a second
+            const uint64_t sent(uint64_t(epoch) * 1000 + i * 1000 / rate);
+            const uint32_t issued(sent / 1000);
+            const auto nonce(random());
+            deliveries.push_back({sent + random() % 5000, issued, nonce});
+            for (auto copies(random() % 4 == 0 ? 1 + random() % 3 : 0); copies != 0; --copies)
+                deliveries.push_back({sent + random() % (window * 3000), issued, nonce});
+        }
+
+        std::stable_sort(deliveries.begin(), deliveries.end(), [](const Delivery &lhs, const Delivery &rhs) {
+            return lhs.arrival_ < rhs.arrival_;
+        });
+
+        Replay<> replay(window);
+        Horizon horizon;
+        std::set<std::tuple<uint32_t, uint64_t>> accepted;
+
+        uint64_t fresh(0);
+        uint64_t replays(0);
+        uint64_t refused(0);
+        uint64_t late(0);
+        uint64_t missed(0);
+
+        for (const auto &delivery : deliveries) {
+            const uint32_t now(delivery.arrival_ / 1000);
+            const auto seen(accepted.find({delivery.issued_, delivery.nonce_}) != accepted.end());
+            const auto inside(delivery.issued_ + window >= now);
+
+            if (replay(now, delivery.issued_, delivery.nonce_)) {
+                orc_assert_(!seen, "replay of " << delivery.issued_ << "/" << delivery.nonce_ << " accepted at " << now);
+                orc_assert_(inside, "ticket issued " << delivery.issued_ << " accepted at " << now);
+                accepted.emplace(delivery.issued_, delivery.nonce_);
+                ++fresh;
+            } else if (seen)
+                ++replays;
+            else if (inside)
+                // a legitimate ticket that couldn't be remembered
+                ++refused;
+            else
+                ++late;
+
+            if (!horizon(delivery.issued_, delivery.nonce_) && !seen && inside)
+                ++missed;
+        }
+
+        std::cout << std::dec << rate << " tickets/s, " << deliveries.size() << " deliveries: " << fresh << " accepted, " << replays << " replays and " << late << " stale refused, " << refused << " fresh refused (" << replay.Saturated() << " saturated); the old horizon of 10 refused " << missed << " fresh" << std::endl;
+        orc_assert_(refused * 1000 <= fresh, "too many fresh tickets refused at " << rate << "/s");
+    }
+
+    return 0;
+}
+
+}
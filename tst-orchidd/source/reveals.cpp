@@ -0,0 +1,112 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "error.hpp"
+#include "reveals.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// a synthetic client on a simulated clock: it wins a ticket every few seconds (so the
+// commitment rotates), and some of its tickets arrive late against a retired commitment;
+// the memory the session holds for this must be flat however long it runs
+int TestReveals(int argc, const char *const argv[]) {
+    const uint64_t hours(argc == 0 ? 6 : std::stoull(argv[0]));
+    const uint64_t retention(60);
+
+    std::mt19937_64 random(hours);
+    const auto reveal([&]() {
+        Brick<32> reveal;
+        for (size_t i(0); i != reveal.size(); i += 8) {
+            const auto value(random());
+            std::copy_n(reinterpret_cast<const uint8_t *>(&value), 8, reveal.data() + i);
+        }
+        return reveal;
+    });
+
+    const uint64_t epoch(1600000000);
+    Reveals reveals(retention);
+    reveals.Commit(epoch, reveal());
+
+    // what Server used to keep: every reveal it ever committed to
+    std::map<Bytes32, Bytes32> unbounded;
+
+    // the commitments a late ticket might still be sent against, with when they were replaced
+    std::deque<std::pair<Bytes32, uint64_t>> history;
+
+    uint64_t accepted(0);
+    uint64_t expired(0);
+    // the most held over the first and over the second half of the run
+    size_t early(0);
+    size_t late(0);
+
+    for (uint64_t now(epoch); now != epoch + hours * 3600; ++now) {
+        // a late ticket, sent up to twice the retention ago against whatever was current then
+        if (!history.empty() && random() % 2 == 0) {
+            const auto &[commit, retired] = history[random() % history.size()];
+            const auto found(reveals.Find(commit, now));
+            if (retired + retention > now) {
+                orc_assert_(found != nullptr, "reveal retired at " << retired << " missing at " << now);
+                orc_assert(Hash(*found) == commit);
+                ++accepted;
+            } else {
+                orc_assert_(found == nullptr, "reveal retired at " << retired << " still found at " << now);
+                ++expired;
+            }
+        }
+
+        orc_assert(reveals.Find(reveals.Current(), now) != nullptr);
+
+        if (random() % 4 == 0) {
+            const auto commit(reveals.Current());
+            const auto next(reveal());
+            reveals.Commit(now, next);
+            unbounded.emplace(Hash(next), next);
+            history.emplace_back(commit, now);
+            while (history.front().second + retention * 2 < now)
+                history.pop_front();
+        }
+
+        const auto elapsed(now - epoch);
+        if (elapsed % 600 == 0) {
+            const auto memory(reveals.Memory());
+            auto &highest(elapsed * 2 < hours * 3600 ? early : late);
+            highest = std::max(highest, memory);
+            if (elapsed % 3600 == 0)
+                std::cout << std::dec << elapsed / 3600 << "h: " << reveals.Size() << " reveals in " << memory << " bytes (unbounded: " << unbounded.size() << ")" << std::endl;
+        }
+    }
+
+    std::cout << accepted << " late tickets accepted, " << expired << " expired; at most " << early << " bytes held early and " << late << " late" << std::endl;
+    // a commitment every four seconds, kept for the retention, with some slack for the table
+    orc_assert_(reveals.Size() <= retention / 2, reveals.Size() << " reveals retained");
+    orc_assert_(late * 2 <= early * 3, "memory grew from " << early << " to " << late << " bytes");
+    return 0;
+}
+
+}
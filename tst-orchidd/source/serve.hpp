@@ -0,0 +1,110 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SERVE_HPP
+#define ORCHID_SERVE_HPP
+
+#include <thread>
+
+#include <rtc_base/rtc_certificate.h>
+
+#include "baton.hpp"
+#include "forge.hpp"
+#include "local.hpp"
+#include "locator.hpp"
+#include "node.hpp"
+#include "sleep.hpp"
+
+namespace orc {
+
+// what orchidd uses when not given --dh
+static const char *const Params_ =
+    "-----BEGIN DH PARAMETERS-----\n"
+    "MIIBCAKCAQEA///////////JD9qiIWjCNMTGYouA3BzRKQJOCIpnzHQCC76mOxOb\n"
+    "IlFKCHmONATd75UZs806QxswKwpt8l8UN0/hNW1tUcJF5IW1dmJefsb0TELppjft\n"
+    "awv/XLb0Brft7jhr+1qJn6WunyQRfEsf5kkoZlHs5Fs9wgB8uKFjvwWY2kg2HFXT\n"
+    "mmkWP6j9JM9fg2VdI9yjrZYcYvNWIIVSu57VKQdwlpZtZww1Tkq8mATxdGwIyhgh\n"
+    "fDKQXkYuNs474553LBgOhgObJ4Oi7Aeij7XFXfBvTFLJ3ivL9pVYFxg5lUl86pVq\n"
+    "5RXSJhiY+gUQFXKOWoqsqmj//////////wIBAg==\n"
+    "-----END DH PARAMETERS-----\n"
+;
+
+// the internet behind the egress: every udp packet comes straight back to its sender
+class Echo :
+    public Pump<Buffer>
+{
+  public:
+    Echo(BufferDrain *drain) :
+        Pump(drain)
+    {
+    }
+
+    task<void> Shut() noexcept override {
+        Pump::Stop();
+        co_await Pump::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        Beam beam(data);
+        auto span(beam.span());
+        auto &ip4(span.cast<openvpn::IPv4Header>());
+        if (ip4.protocol != openvpn::IPCommon::UDP)
+            co_return;
+        auto &udp(span.cast<openvpn::UDPHeader>(openvpn::IPv4Header::length(ip4.version_len)));
+        // swapping fields leaves the checksums as they were
+        std::swap(ip4.saddr, ip4.daddr);
+        std::swap(udp.source, udp.dest);
+        Land(beam);
+    }
+};
+
+// runs the https signaling of node on a free local port, and returns its url; what
+// node depends on but doesn't own (such as a Ledger) can be kept alive along with it
+inline std::string Serve(const S<Node> &node, const rtc::scoped_refptr<rtc::RTCCertificate> &certificate, S<void> keep = nullptr) {
+    const auto pem(certificate->ToPEM());
+
+    const auto port([]() {
+        asio::ip::tcp::acceptor acceptor(Context(), {asio::ip::make_address("127.0.0.1"), 0});
+        return acceptor.local_endpoint().port();
+    }());
+
+    // Run never returns, so the node (which must never be destroyed) lives until exit
+    std::thread([node, keep, port, key = pem.private_key(), certificates = pem.certificate()]() {
+        node->Run(asio::ip::make_address("127.0.0.1"), port, "/", key, certificates, Params_);
+    }).detach();
+
+    return "https://127.0.0.1:" + std::to_string(port) + "/";
+}
+
+// waits for the signaling at url to answer
+inline task<void> Reach(const S<Origin> &origin, const std::string &url) {
+    for (unsigned i(0); ; ++i) {
+        orc_assert_(i != 100, "orchidd never listened on " << url);
+        if (!orc_ignore({ co_await origin->Request("GET", Locator::Parse(url), {}, {}); }))
+            break;
+        co_await Sleep(std::chrono::milliseconds(100));
+    }
+}
+
+}
+
+#endif//ORCHID_SERVE_HPP
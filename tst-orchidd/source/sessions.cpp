@@ -0,0 +1,169 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "crypto.hpp"
+#include "error.hpp"
+#include "loopback.hpp"
+#include "sessions.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+struct Session {
+    const uint64_t id_;
+};
+
+// what Node used to do: one map under one lock, never cleaned up
+class Registry {
+  private:
+    std::mutex mutex_;
+    std::map<std::string, W<Session>> sessions_;
+
+  public:
+    template <typename Code_>
+    S<Session> Find(const std::string &key, Code_ &&code) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto &cache(sessions_[key]);
+        if (auto session = cache.lock())
+            return session;
+        auto session(code());
+        cache = session;
+        return session;
+    }
+
+    S<Session> Find(const std::string &key) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto session(sessions_.find(key));
+        return session == sessions_.end() ? nullptr : session->second.lock();
+    }
+
+    size_t Size() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return sessions_.size();
+    }
+};
+
+// about a second's worth at 10k/s
+static const unsigned Keep_(10000);
+
+struct Churn {
+    uint64_t sessions_ = 0;
+    std::vector<uint64_t> latencies_;
+};
+
+// each thread opens sessions (paced to rate / threads per second, unless rate is 0),
+// looks each one up again, and keeps only the most recent Keep_ / threads open
+template <typename Open_, typename Look_>
+static Churn Run(unsigned threads, unsigned rate, uint64_t duration, Open_ &&open, Look_ &&look) {
+    std::atomic<uint64_t> next(0);
+    std::vector<Churn> churns(threads);
+    std::vector<std::thread> workers;
+
+    const auto start(Now());
+    for (unsigned i(0); i != threads; ++i)
+        workers.emplace_back([&, i]() {
+            auto &churn(churns[i]);
+            std::mt19937_64 random(i);
+            std::deque<S<Session>> open_;
+            const auto keep(Keep_ / threads);
+            for (uint64_t now; (now = Now()) < start + duration; ) {
+                if (rate != 0) {
+                    const auto due(start + churn.sessions_ * 1000000 * threads / rate);
+                    if (due > now)
+                        std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+                }
+
+                const auto id(next++);
+                const auto before(Now());
+                auto session(open(id, random));
+                look(id, random);
+                churn.latencies_.push_back(Now() - before);
+
+                open_.emplace_back(std::move(session));
+                if (open_.size() > keep)
+                    open_.pop_front();
+                ++churn.sessions_;
+            }
+        });
+    for (auto &worker : workers)
+        worker.join();
+
+    Churn total;
+    for (auto &churn : churns) {
+        total.sessions_ += churn.sessions_;
+        total.latencies_.insert(total.latencies_.end(), churn.latencies_.begin(), churn.latencies_.end());
+    }
+    return total;
+}
+
+// session churn: open, index by remote and payer, look up, and close (by dropping)
+int TestSessions(int argc, const char *const argv[]) {
+    const unsigned rate(argc == 0 ? 10000 : std::stoul(argv[0]));
+    const unsigned threads(4);
+    const uint64_t duration(3000000);
+
+    std::vector<Address> payers;
+    for (unsigned i(0); i != 1000; ++i)
+        payers.emplace_back(Address(Random<32>().Clip<20>().num<uint160_t>()));
+
+    for (const auto paced : {rate, 0u}) {
+        Registry registry;
+        const auto before(Run(threads, paced, duration, [&](uint64_t id, std::mt19937_64 &random) {
+            return registry.Find(std::to_string(id), [&]() { return Make<Session>(Session{id}); });
+        }, [&](uint64_t id, std::mt19937_64 &random) {
+            orc_assert(registry.Find(std::to_string(id)) != nullptr);
+        }));
+
+        Sessions<std::string, Session> sessions;
+        Sessions<Socket, Session> remotes;
+        Sessions<Address, Session> paying;
+        const auto after(Run(threads, paced, duration, [&](uint64_t id, std::mt19937_64 &random) {
+            const auto session(sessions.Find(std::to_string(id), [&]() { return Make<Session>(Session{id}); }));
+            remotes.Insert(Socket(Host(uint32_t(random())), random()), session);
+            paying.Insert(payers[random() % payers.size()], session);
+            return session;
+        }, [&](uint64_t id, std::mt19937_64 &random) {
+            orc_assert(sessions.Find(std::to_string(id)) != nullptr);
+            paying.All(payers[random() % payers.size()]);
+        }));
+
+        std::cout << std::dec << (paced == 0 ? "unpaced" : "paced at " + std::to_string(paced) + "/s") << ", " << threads << " threads:" << std::endl;
+        std::cout << "  one lock: " << before.sessions_ * 1000000 / duration << "/s, p50 " << Percentile(before.latencies_, 50) << "us, p99 " << Percentile(before.latencies_, 99) << "us, " << registry.Size() << " entries left" << std::endl;
+        std::cout << "  sharded (+ remote/payer indexes): " << after.sessions_ * 1000000 / duration << "/s, p50 " << Percentile(after.latencies_, 50) << "us, p99 " << Percentile(after.latencies_, 99) << "us, " << sessions.Size() << " entries left, " << sessions.Swept() << " swept" << std::endl;
+
+        if (paced != 0)
+            orc_assert_(after.sessions_ * 1000000 / duration >= paced * 9 / 10, "sharded table couldn't keep up with " << paced << "/s");
+        // closed sessions don't accumulate: a shard is swept whenever it doubles
+        orc_assert_(sessions.Size() <= Keep_ * 3 + 64 * 16, sessions.Size() << " entries left behind");
+    }
+
+    return 0;
+}
+
+}
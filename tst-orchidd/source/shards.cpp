@@ -0,0 +1,156 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "datagram.hpp"
+#include "egress.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+namespace {
+
+// the upstream link of one shard: it reads what it is sent (as encrypting it would), and counts it
+class Upstream :
+    public Pump<Buffer>
+{
+  public:
+    std::atomic<uint64_t> packets_ = 0;
+    std::atomic<uint64_t> folded_ = 0;
+
+    Upstream(BufferDrain *drain) :
+        Pump(drain)
+    {
+    }
+
+    task<void> Shut() noexcept override {
+        Pump::Stop();
+        co_await Pump::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        const Beam beam(data);
+        uint64_t folded(0);
+        for (size_t i(0); i + 8 <= beam.size(); i += 8) {
+            uint64_t word;
+            memcpy(&word, beam.data() + i, sizeof(word));
+            folded = Mix(folded ^ word);
+        }
+        folded_.fetch_xor(folded, std::memory_order_relaxed);
+        packets_.fetch_add(1, std::memory_order_relaxed);
+        co_return;
+    }
+};
+
+class Tunnel :
+    public BufferDrain
+{
+  protected:
+    void Land(const Buffer &data) override {
+    }
+
+    void Stop(const std::string &error) noexcept override {
+    }
+};
+
+
+}
+
+// many clients, each with many flows, sending through an egress split into more
+// and more shards: as in orchidd, every client's packets start out on the shared
+// pool, and (once there is more than one shard) are translated and sent upstream
+// on the worker of their flow's shard; throughput should grow with the shards
+// until they outnumber the cores
+int TestShards(int argc, const char *const argv[]) {
+    const unsigned clients(argc < 1 ? 16 : std::stoul(argv[0]));
+    const unsigned packets(argc < 2 ? 20000 : std::stoul(argv[1]));
+    const unsigned flows(64);
+    const size_t size(1200);
+
+    std::cout << "shards: " << clients << " clients, " << packets << " packets each, on " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    double single(0);
+    for (const unsigned shards : {1, 2, 4, 8}) {
+        // Egress is never destroyed
+        auto &egresses(*new std::vector<S<Egress>>());
+        std::vector<Upstream *> upstreams;
+        for (unsigned shard(0); shard != shards; ++shard) {
+            const auto egress(Make<Sink<Egress>>(0x0a000002, Egress::Timeouts(), shard, shards));
+            upstreams.emplace_back(egress->Wire<Upstream>());
+            egresses.emplace_back(egress);
+        }
+
+        Beam payload(size);
+        memset(payload.data(), 0x5a, payload.size());
+
+        Tunnel tunnel;
+        std::vector<U<Translator>> translators;
+        std::vector<std::vector<Beam>> datagrams(clients);
+        for (unsigned client(0); client != clients; ++client) {
+            translators.emplace_back(std::make_unique<Translator>(&tunnel, egresses));
+            for (unsigned flow(0); flow != flows; ++flow)
+                datagrams[client].emplace_back(Datagram(Socket(0x0a070000 + client, 1024 + flow), Socket(0x01020304, 443), payload));
+        }
+
+        const auto before(std::chrono::steady_clock::now());
+        std::vector<std::thread> threads;
+        for (unsigned client(0); client != clients; ++client)
+            threads.emplace_back([&, client]() {
+                Wait([&]() -> task<void> {
+                    co_await Schedule();
+                    for (unsigned packet(0); packet != packets; ++packet)
+                        co_await translators[client]->Send(datagrams[client][packet % flows]);
+                }());
+            });
+        for (auto &thread : threads)
+            thread.join();
+        const std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - before);
+
+        uint64_t sent(0);
+        std::ostringstream spread;
+        for (const auto upstream : upstreams) {
+            sent += upstream->packets_;
+            spread << " " << upstream->packets_;
+        }
+        orc_assert_(sent == uint64_t(clients) * packets, sent << " packets sent of " << uint64_t(clients) * packets);
+
+        const auto rate(sent / elapsed.count());
+        if (shards == 1)
+            single = rate;
+        std::cout << shards << " shards: " << uint64_t(rate) << " packets/s (x" << rate / single << "), spread" << spread.str() << std::endl;
+
+        for (auto &translator : translators)
+            translator->Stop();
+    }
+
+    return 0;
+}
+
+}
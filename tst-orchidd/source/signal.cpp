@@ -0,0 +1,86 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <iostream>
+
+#include "channel.hpp"
+#include "http.hpp"
+#include "local.hpp"
+#include "locator.hpp"
+#include "loopback.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+// fires count offers at a running orchidd at once; each is answered or refused (503)
+int TestSignal(int argc, const char *const argv[]) {
+    orc_assert_(argc == 1 || argc == 2, "usage: signal <url> [count]");
+    const auto locator(Locator::Parse(argv[0]));
+    const unsigned count(argc == 1 ? 1000 : std::stoul(argv[1]));
+
+    return Wait([&]() -> task<int> {
+        co_await Schedule();
+
+        const auto origin(Break<Local>());
+
+        // the server negotiates each one separately, so a few distinct offers are plenty
+        std::vector<std::string> offers;
+        for (unsigned i(0); i != 8; ++i)
+            offers.emplace_back(co_await Description(origin, {}));
+
+        std::vector<uint64_t> answered;
+        std::vector<uint64_t> refused;
+        unsigned failed(0);
+        unsigned pending(count);
+        Event done;
+
+        const auto start(Now());
+        for (unsigned i(0); i != count; ++i)
+            Spawn([&, i]() noexcept -> task<void> {
+                const auto before(Now());
+                if (orc_ignore({
+                    const auto response(co_await origin->Request("POST", locator, {}, offers[i % offers.size()]));
+                    const auto elapsed(Now() - before);
+                    if (response.code_ == boost::beast::http::status::ok)
+                        answered.push_back(elapsed);
+                    else if (response.code_ == boost::beast::http::status::service_unavailable)
+                        refused.push_back(elapsed);
+                    else
+                        ++failed;
+                }))
+                    ++failed;
+                if (--pending == 0)
+                    done();
+            });
+
+        co_await done.Wait();
+        const auto elapsed(Now() - start);
+
+        std::cout << std::dec << count << " offers in " << elapsed / 1000 << "ms: " << answered.size() << " answered, " << refused.size() << " refused, " << failed << " failed" << std::endl;
+        std::cout << "answered: p50 " << Percentile(answered, 50) / 1000 << "ms, p99 " << Percentile(answered, 99) / 1000 << "ms" << std::endl;
+        std::cout << "refused: p50 " << Percentile(refused, 50) / 1000 << "ms, p99 " << Percentile(refused, 99) / 1000 << "ms" << std::endl;
+
+        co_return failed == 0 ? 0 : 1;
+    }());
+}
+
+}
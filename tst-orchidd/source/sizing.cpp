@@ -0,0 +1,178 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <functional>
+#include <iostream>
+#include <map>
+
+#include "error.hpp"
+#include "sizer.hpp"
+#include "tests.hpp"
+
+namespace orc {
+
+typedef Sizer::Clock_ Clock_;
+using std::chrono::microseconds;
+
+struct Exposure {
+    uint64_t bytes_ = 0;
+    uint64_t tickets_ = 0;
+    uint64_t requests_ = 0;
+    // the most the server was owed, and the most the client had prepaid
+    double unpaid_ = 0;
+    double prepaid_ = 0;
+};
+
+// a session carrying rate bytes/s to a client latency away, which (like
+// Client) asks for an invoice every cadence bytes and tops up to twice its
+// prepay; fixed is how Client did this before it had a Sizer. amounts are in
+// units of the floor, which buys 4MB
+static Exposure Simulate(bool fixed, double risk, uint64_t rate, uint64_t seconds) {
+    const uint64_t latency(10000);
+    const double price(1.0 / (4 * 1024 * 1024));
+    const size_t packet(1400);
+    const uint64_t step(100);
+
+    Exposure exposure;
+    Sizer sizer(1, risk, 2);
+
+    std::multimap<uint64_t, std::function<void ()>> events;
+    const auto at([&](uint64_t time, std::function<void ()> code) {
+        events.emplace(time, std::move(code));
+    });
+
+    // the server's side
+    double balance(0);
+    int64_t version(0);
+
+    // the client's side
+    int64_t serial(-1);
+    double told(0);
+    std::map<uint64_t, double> pending;
+    uint64_t tickets(0);
+    uint64_t benefit(0);
+
+    uint64_t now(0);
+
+    std::function<void (uint64_t)> invoice;
+    invoice = [&](uint64_t ticket) {
+        at(now + latency, [&, current = version, value = balance, ticket]() {
+            const auto credited(pending.find(ticket));
+            if (credited != pending.end()) {
+                sizer.Credited(credited->second);
+                pending.erase(credited);
+            }
+
+            if (serial < current) {
+                serial = current;
+                told = value;
+                sizer.Invoice(value);
+            }
+
+            auto predicted(told);
+            for (const auto &[id, amount] : pending)
+                predicted += amount;
+            const auto prepay(fixed ? 1 : sizer.Prepay());
+            if (predicted >= prepay)
+                return;
+
+            const auto amount(prepay * 2 - predicted);
+            const auto id(++tickets);
+            ++exposure.tickets_;
+            ++exposure.requests_;
+            pending.emplace(id, amount);
+            at(now + latency, [&, id, amount]() {
+                balance += amount;
+                ++version;
+                exposure.prepaid_ = std::max(exposure.prepaid_, balance);
+                invoice(id);
+            });
+        });
+    };
+
+    const std::function<void ()> request([&]() {
+        ++exposure.requests_;
+        at(now + latency, [&]() { invoice(0); });
+    });
+
+    request();
+
+    const auto end(seconds * 1000000);
+    uint64_t carried(0);
+    for (; now < end + 1000000; now += step) {
+        for (auto event(events.begin()); event != events.end() && event->first <= now; event = events.erase(event))
+            event->second();
+
+        if (now >= end)
+            continue;
+
+        for (carried += rate * step / 1000000; carried >= packet; carried -= packet) {
+            balance -= packet * price;
+            ++version;
+            exposure.bytes_ += packet;
+            exposure.unpaid_ = std::max(exposure.unpaid_, -balance);
+
+            at(now + latency, [&]() {
+                sizer.Transfer(Clock_::time_point() + microseconds(now), packet);
+                benefit += packet;
+                if (benefit < (fixed ? 256 * 1024 : sizer.Cadence()))
+                    return;
+                benefit = 0;
+                request();
+            });
+        }
+    }
+
+    return exposure;
+}
+
+// a client sizing its tickets from its throughput must sign (and its server
+// verify) far fewer per GB on a fast link, without either side having more at
+// stake than a fixed prepay (on slow links) or the risk budget allows
+int TestSizing(int argc, const char *const argv[]) {
+    const uint64_t seconds(argc == 0 ? 20 : std::stoull(argv[0]));
+    // 64 floors, or 256MB of traffic
+    const double risk(64);
+
+    for (const uint64_t rate : {1 * 1024 * 1024, 10 * 1024 * 1024, 100 * 1024 * 1024}) {
+        const auto fixed(Simulate(true, risk, rate, seconds));
+        const auto sized(Simulate(false, risk, rate, seconds));
+
+        const auto gb([](const Exposure &exposure, uint64_t count) {
+            return double(count) * (1024 * 1024 * 1024) / exposure.bytes_;
+        });
+
+        for (const auto &[name, exposure] : {std::make_pair("fixed", &fixed), std::make_pair("sized", &sized)})
+            std::cout << std::dec << rate / 1024 << "KB/s, " << name << ": " << gb(*exposure, exposure->tickets_) << " tickets/GB, " << gb(*exposure, exposure->requests_) << " requests/GB; server exposure " << exposure->unpaid_ << ", client exposure " << exposure->prepaid_ << std::endl;
+
+        orc_assert_(sized.prepaid_ <= std::max(risk, fixed.prepaid_), "the client prepaid " << sized.prepaid_ << " at " << rate);
+        // until its first invoices tell it a price, a client is as exposed as a fixed one
+        orc_assert_(sized.unpaid_ <= std::max(fixed.unpaid_, 1.0), "the server was owed " << sized.unpaid_ << " at " << rate);
+        orc_assert(sized.tickets_ <= fixed.tickets_);
+        if (rate >= 100 * 1024 * 1024)
+            orc_assert_(sized.tickets_ * 10 <= fixed.tickets_, sized.tickets_ << " tickets vs " << fixed.tickets_ << " at " << rate);
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,55 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_TESTS_HPP
+#define ORCHID_TESTS_HPP
+
+namespace orc {
+
+int TestFirst(int argc, const char *const argv[]);
+int TestDirect(int argc, const char *const argv[]);
+int TestControl(int argc, const char *const argv[]);
+int TestIncoming(int argc, const char *const argv[]);
+int TestDtls(int argc, const char *const argv[]);
+int TestUtp(int argc, const char *const argv[]);
+int TestBilling(int argc, const char *const argv[]);
+int TestVerify(int argc, const char *const argv[]);
+int TestJournal(int argc, const char *const argv[]);
+int TestSignal(int argc, const char *const argv[]);
+int TestSessions(int argc, const char *const argv[]);
+int TestReplay(int argc, const char *const argv[]);
+int TestReveals(int argc, const char *const argv[]);
+int TestFair(int argc, const char *const argv[]);
+int TestCodel(int argc, const char *const argv[]);
+int TestGovernor(int argc, const char *const argv[]);
+int TestInvoicing(int argc, const char *const argv[]);
+int TestSizing(int argc, const char *const argv[]);
+int TestFootprint(int argc, const char *const argv[]);
+int TestLoad(int argc, const char *const argv[]);
+int TestNAT(int argc, const char *const argv[]);
+int TestPorts(int argc, const char *const argv[]);
+int TestIdle(int argc, const char *const argv[]);
+int TestShards(int argc, const char *const argv[]);
+
+}
+
+#endif//ORCHID_TESTS_HPP
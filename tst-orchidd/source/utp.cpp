@@ -0,0 +1,168 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <iostream>
+#include <random>
+
+#include <cppcoro/when_all.hpp>
+
+#include "loopback.hpp"
+#include "sleep.hpp"
+#include "tests.hpp"
+#include "utp.hpp"
+
+namespace orc {
+
+// half of a simulated path: packets wait behind a bottleneck of rate_ (dropped
+// once that queue passes limit_), then take delay_ to arrive, unless lost
+class Shim :
+    public Pump<Buffer>
+{
+  private:
+    const uint64_t rate_;
+    const uint64_t delay_;
+    const uint64_t limit_;
+    const double loss_;
+
+    Shim *peer_ = nullptr;
+
+    struct Locked_ {
+        std::mt19937 random_;
+        uint64_t free_ = 0;
+        uint64_t lost_ = 0;
+        std::vector<uint64_t> queueing_;
+    }; Locked<Locked_> locked_;
+
+  public:
+    Shim(BufferDrain *drain, uint64_t rate, uint64_t delay, uint64_t limit, double loss) :
+        Pump(drain),
+        rate_(rate),
+        delay_(delay),
+        limit_(limit),
+        loss_(loss)
+    {
+    }
+
+    void Connect(Shim *peer) {
+        peer_ = peer;
+    }
+
+    void Deliver(const Buffer &data) {
+        Pump::Land(data);
+    }
+
+    uint64_t Lost() {
+        return locked_()->lost_;
+    }
+
+    std::vector<uint64_t> Queueing() {
+        return locked_()->queueing_;
+    }
+
+    task<void> Shut() noexcept override {
+        Pump::Stop();
+        co_await Pump::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        uint64_t arrive;
+
+        {
+            const auto locked(locked_());
+            const auto now(Now());
+            const auto start(std::max(now, locked->free_));
+            if (start - now > limit_ || std::uniform_real_distribution<double>(0, 1)(locked->random_) < loss_) {
+                ++locked->lost_;
+                co_return;
+            }
+
+            locked->free_ = start + data.size() * 1000000 / rate_;
+            locked->queueing_.push_back(start - now);
+            arrive = locked->free_ + delay_;
+        }
+
+        Spawn([peer = peer_, data = Beam(data), arrive]() noexcept -> task<void> {
+            const auto now(Now());
+            if (arrive > now)
+                co_await Sleep(std::chrono::milliseconds((arrive - now) / 1000));
+            peer->Deliver(data);
+        });
+    }
+};
+
+// bulk transfer over utp through a Shim, reporting goodput and the delay it causes
+int TestUtp(int argc, const char *const argv[]) {
+    const unsigned seconds(argc > 0 ? std::stoul(argv[0]) : 10);
+    const uint64_t rate((argc > 1 ? std::stoul(argv[1]) : 10000) * 1000 / 8);
+    const uint64_t delay((argc > 2 ? std::stoul(argv[2]) : 20) * 1000);
+    const double loss((argc > 3 ? std::stod(argv[3]) : 1) / 100);
+
+    return Wait([&]() -> task<int> {
+        co_await Schedule();
+
+        const auto sender(Make<Sink<Meter>>());
+        const auto receiver(Make<Sink<Meter>>());
+
+        const auto client(sender->Wire<Sink<Utp>>(false));
+        const auto server(receiver->Wire<Sink<Utp>>(true));
+
+        // a badly bloated bottleneck: a second of buffering
+        const auto upstream(client->Wire<Shim>(rate, delay, 1000000, loss));
+        const auto downstream(server->Wire<Shim>(rate, delay, 1000000, loss));
+        upstream->Connect(downstream);
+        downstream->Connect(upstream);
+
+        co_await cppcoro::when_all(client->Open(), server->Open());
+
+        const auto start(Now());
+        uint64_t sent(0);
+        while (Now() - start < seconds * 1000000) {
+            if (client->Queued() > Utp::Queue_ / 2) {
+                co_await Sleep(std::chrono::milliseconds(5));
+                continue;
+            }
+            co_await sender->Stamp<1024>(0);
+            ++sent;
+        }
+
+        // let the queues drain
+        co_await Sleep(2);
+
+        const auto delays(receiver->Delays(0));
+        const auto queueing(upstream->Queueing());
+
+        std::cout << std::dec
+            << delays.size() << "/" << sent << " frames, "
+            << delays.size() * 1024 * 8 / seconds / 1000 << "kbps of " << rate * 8 / 1000 << "kbps, "
+            << upstream->Lost() << " datagrams lost" << std::endl;
+        std::cout
+            << "one way: p50 = " << Percentile(delays, 50) << "us, p99 = " << Percentile(delays, 99) << "us; "
+            << "queueing: p50 = " << Percentile(queueing, 50) << "us, p99 = " << Percentile(queueing, 99) << "us" << std::endl;
+
+        co_await sender->Shut();
+        co_await receiver->Shut();
+        co_return 0;
+    }());
+}
+
+}
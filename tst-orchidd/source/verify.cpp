@@ -0,0 +1,111 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <atomic>
+#include <iostream>
+
+#include "crypto.hpp"
+#include "error.hpp"
+#include "jsonrpc.hpp"
+#include "loopback.hpp"
+#include "tests.hpp"
+#include "verifier.hpp"
+
+namespace orc {
+
+struct Signed {
+    Brick<32> hash_;
+    Signature signature_;
+    Address signer_;
+};
+
+// recovers every ticket through verifier, in waves no deeper than its queue
+static uint64_t Verify(Verifier &verifier, const std::vector<Signed> &tickets, std::atomic<uint64_t> &wrong) {
+    const size_t queue(Verifier::Queue_);
+    const auto start(Now());
+    for (size_t base(0); base < tickets.size(); base += queue) {
+        const auto end(std::min(base + queue, tickets.size()));
+        std::atomic<size_t> pending(end - base);
+        Event done;
+        for (auto i(base); i != end; ++i)
+            Spawn([&, i]() noexcept -> task<void> {
+                const auto &ticket(tickets[i]);
+                if (orc_ignore({
+                    if (!(co_await verifier.Recover(ticket.hash_, ticket.signature_) == ticket.signer_))
+                        ++wrong;
+                }))
+                    ++wrong;
+                if (--pending == 0)
+                    done();
+            });
+        Wait(done.Wait());
+    }
+    return Now() - start;
+}
+
+// tickets verified per second per core, inline (as Submit used to) and on the Verifier
+int TestVerify(int argc, const char *const argv[]) {
+    const size_t count(argc == 0 ? 20000 : std::stoul(argv[0]));
+
+    std::vector<Signed> tickets;
+    tickets.reserve(count);
+    std::vector<std::tuple<Secret, Address>> keys;
+    for (unsigned i(0); i != 64; ++i) {
+        const auto secret(Random<32>());
+        keys.emplace_back(secret, Address(Commonize(secret)));
+    }
+    for (size_t i(0); i != count; ++i) {
+        const auto &[secret, signer] = keys[i % keys.size()];
+        const auto hash(Random<32>());
+        tickets.push_back({hash, Sign(secret, hash), signer});
+    }
+
+    {
+        const auto start(Now());
+        for (const auto &ticket : tickets)
+            orc_assert(Address(Recover(ticket.hash_, ticket.signature_)) == ticket.signer_);
+        const auto elapsed(Now() - start);
+        std::cout << std::dec << count << " tickets inline: " << count * 1000000 / elapsed << "/s on 1 core" << std::endl;
+    }
+
+    for (const unsigned threads : {1u, std::max(std::thread::hardware_concurrency(), 2u) - 1}) {
+        Verifier verifier(threads);
+        std::atomic<uint64_t> wrong(0);
+        const auto elapsed(Verify(verifier, tickets, wrong));
+        orc_assert_(wrong == 0, wrong << " tickets recovered the wrong signer on " << threads << " thread(s)");
+        orc_assert(verifier.Recovered() == count);
+        const auto rate(count * 1000000 / elapsed);
+        std::cout << threads << " verifier thread(s): " << rate << "/s, " << rate / threads << "/s per core" << std::endl;
+
+        // a retransmitted burst (here, the last wave) never reaches a worker
+        const size_t queue(Verifier::Queue_);
+        const std::vector<Signed> repeat(tickets.begin() + (count - 1) / queue * queue, tickets.end());
+        const auto again(Verify(verifier, repeat, wrong));
+        orc_assert(wrong == 0);
+        orc_assert(verifier.Cached() == repeat.size());
+        std::cout << "  " << repeat.size() << " retransmitted: " << repeat.size() * 1000000 / again << "/s from the cache" << std::endl;
+    }
+
+    return 0;
+}
+
+}
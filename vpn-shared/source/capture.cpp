@@ -689,6 +689,8 @@ void Capture::Start(const std::string &path) {
         eth_directory = "0x918101FB64f467414e9a785aF9566ae69C3e22C5";
         eth_location = "0xEF7bc12e0F6B02fE2cb86Aa659FdC3EBB727E0eD";
         eth_winshift = 10;
+        eth_risk = 0.01;
+        eth_prepay_seconds = 2;
         rpc = "https://cloudflare-eth.com:443/";
         hops = [];
         //stun = "stun:stun.l.google.com:19302";
@@ -705,6 +707,8 @@ void Capture::Start(const std::string &path) {
         return Start(Break<Local>());
 
     WinShift_ = unsigned(heap.eval<double>("eth_winshift"));
+    RiskBudget_ = heap.eval<double>("eth_risk");
+    PrepaySeconds_ = heap.eval<double>("eth_prepay_seconds");
 
     auto code([heap = std::move(heap), hops](Sunk<> *sunk) mutable -> task<void> {
         S<Origin> origin(Break<Local>());
@@ -20,28 +20,39 @@
 /* }}} */
 
 
+#include <cmath>
+
 #include <rtc_base/openssl_identity.h>
 
 #include "channel.hpp"
 #include "client.hpp"
 #include "datagram.hpp"
+#include "dtls.hpp"
 #include "locator.hpp"
 #include "protocol.hpp"
+#include "utp.hpp"
 
 namespace orc {
 
 unsigned WinShift_(10);
+double RiskBudget_(0.01);
+double PrepaySeconds_(2);
+
+double Client::Risk() {
+    // invoices are in wei, as a fraction of 2^128 (like a ticket's ratio)
+    return RiskBudget_ * 1e18 * std::ldexp(1, 128);
+}
 
 task<void> Client::Submit() {
     const Header header{Magic_, Zero<32>()};
-    co_await Bonded::Send(Datagram(Port_, Port_, Tie(header)));
+    co_await Bonded::Send(Datagram(Port_, Port_, Tie(header)), true);
 }
 
 task<void> Client::Submit(const Bytes32 &hash, const Ticket &ticket, const Signature &signature) {
     const Header header{Magic_, hash};
     co_await Bonded::Send(Datagram(Port_, Port_, Tie(header,
         Command(Submit_, signature.v_, signature.r_, signature.s_, ticket.Knot(lottery_, chain_, receipt_))
-    )));
+    )), true);
 }
 
 void Client::Issue(uint256_t amount) {
@@ -65,6 +76,7 @@ void Client::Issue(uint256_t amount) {
         const auto hash(Hash(ticket.Encode(lottery_, chain_, receipt_)));
         const auto signature(Sign(secret_, Hash(Tie(Strung<std::string>("\x19""Ethereum Signed Message:\n32"), hash))));
         { const auto locked(locked_());
+            ++locked->issued_;
             locked->pending_.try_emplace(hash, ticket, signature); }
         co_return co_await Submit(hash, ticket, signature);
     }; });
@@ -72,11 +84,11 @@ void Client::Issue(uint256_t amount) {
 
 void Client::Transfer(size_t size) {
     { const auto locked(locked_());
+    locked->sizer_.Transfer(Sizer::Clock_::now(), size);
     locked->benefit_ += size;
-    if (locked->benefit_ > 1024*256)
-        locked->benefit_ -= 1024*256;
-    else
-        return; }
+    if (locked->benefit_ < locked->sizer_.Cadence())
+        return;
+    locked->benefit_ = 0; }
     Issue(0);
 }
 
@@ -98,20 +110,28 @@ void Client::Land(Pipe *pipe, const Buffer &data) {
             orc_assert(lottery == lottery_);
             orc_assert(chain == chain_);
 
-            const auto predicted([&, &serial = serial, &balance = balance, &recipient = recipient, &commit = commit]() {
+            const auto [predicted, prepay] = [&, &serial = serial, &balance = balance, &recipient = recipient, &commit = commit]() {
                 const auto locked(locked_());
 
+                // an acknowledged ticket is part of this invoice's balance
+                if (!id.zero()) {
+                    const auto pending(locked->pending_.find(id));
+                    if (pending != locked->pending_.end()) {
+                        const auto &ticket(pending->second.first);
+                        locked->sizer_.Credited((ticket.amount_ * (ticket.ratio_ + 1)).convert_to<double>());
+                        locked->pending_.erase(pending);
+                    }
+                }
+
                 // XXX: implement rollover strategy
                 if (locked->serial_ < serial) {
                     locked->serial_ = serial;
                     locked->balance_ = balance;
                     locked->recipient_ = recipient;
                     locked->commit_ = commit;
+                    locked->sizer_.Invoice(balance.convert_to<double>());
                 }
 
-                if (!id.zero())
-                    locked->pending_.erase(id);
-
                 auto predicted(locked->balance_);
                 for (const auto &pending : locked->pending_) {
                     const auto &ticket(pending.second.first);
@@ -119,11 +139,11 @@ void Client::Land(Pipe *pipe, const Buffer &data) {
                     predicted += ticket.amount_ * (ticket.ratio_ + 1);
                 }
 
-                return predicted;
-            }());
+                return std::make_tuple(predicted, uint256_t(locked->sizer_.Prepay()));
+            }();
 
-            if (prepay_ > predicted)
-                Issue(uint256_t(prepay_ * 2 - predicted));
+            if (prepay > predicted)
+                Issue(uint256_t(prepay * 2 - predicted));
         } orc_catch({}) }));
     } orc_catch({}) return true; })) {
         Transfer(data.size());
@@ -144,7 +164,8 @@ Client::Client(BufferDrain *drain, std::string url, U<rtc::SSLFingerprint> remot
     chain_(chain),
     secret_(secret),
     funder_(funder),
-    prepay_(uint256_t(0xb1a2bc2ec500)<<128)
+    prepay_(uint256_t(0xb1a2bc2ec500)<<128),
+    locked_(std::in_place, prepay_)
 {
     // XXX: this class shouldn't derive from Valve twice...
     Bonded::type_ = typeid(*this).name();
@@ -156,7 +177,7 @@ _trace();
 }
 
 task<void> Client::Open(const S<Origin> &origin) {
-    const auto verify([&](const std::list<const rtc::OpenSSLCertificate> &certificates) -> bool {
+    const auto verify([this](const std::list<const rtc::OpenSSLCertificate> &certificates) -> bool {
         for (const auto &certificate : certificates)
             if (*remote_ == *rtc::SSLFingerprint::Create(remote_->algorithm, certificate))
                 return true;
@@ -165,18 +186,39 @@ task<void> Client::Open(const S<Origin> &origin) {
 
     const auto bonding(Bond());
 
+    const auto locator(Locator::Parse(url_));
+    if (locator.scheme_ == "dtls") {
+        // no signaling at all: the server's certificate is checked just like its https one
+        const auto dtls(bonding->Wire<Sink<Dtls>>(nullptr, verify));
+        socket_ = co_await origin->Associate(dtls, locator.host_, locator.port_);
+        co_await dtls->Open();
+        co_return;
+    } else if (locator.scheme_ == "utp") {
+        // the same, but with dtls carried over a utp (ledbat) connection
+        const auto dtls(bonding->Wire<Sink<Dtls>>(nullptr, verify));
+        const auto stream(dtls->Wire<Sink<Utp>>(false));
+        socket_ = co_await origin->Associate(stream, locator.host_, locator.port_);
+        co_await stream->Open();
+        co_await dtls->Open();
+        co_return;
+    }
+
+    const auto control(Bond(true));
+
     socket_ = co_await Channel::Wire(bonding, origin, [&]() {
         Configuration configuration;
         configuration.tls_ = local_;
         return configuration;
     }(), [&](std::string offer) -> task<std::string> {
-        const auto answer((co_await origin->Request("POST", Locator::Parse(url_), {}, offer, verify)).ok());
-        if (true || Verbose) {
+        const auto answer((co_await origin->Request("POST", locator, {}, offer, verify)).ok());
+        if (Verbose) {
             Log() << "Offer: " << offer << std::endl;
             Log() << "Answer: " << answer << std::endl;
         }
         co_return answer;
-    });
+    }, [this, origin, verify](std::string fragment) -> task<std::string> {
+        co_return (co_await origin->Request("GET", Locator::Parse(url_ + "?ice=" + fragment), {}, {}, verify)).ok();
+    }, control);
 }
 
 task<void> Client::Shut() noexcept {
@@ -24,6 +24,7 @@
 #define ORCHID_CLIENT_HPP
 
 #include <atomic>
+#include <tuple>
 
 #include <rtc_base/rtc_certificate.h>
 #include <rtc_base/ssl_fingerprint.h>
@@ -34,10 +35,16 @@
 #include "locked.hpp"
 #include "nest.hpp"
 #include "origin.hpp"
+#include "sizer.hpp"
 #include "ticket.hpp"
 
 namespace orc {
 
+// the most a client will have prepaid one server, in ether, and how many
+// seconds of its traffic it tries to keep prepaid (within that)
+extern double RiskBudget_;
+extern double PrepaySeconds_;
+
 class Client :
     public Bonded,
     public Pump<Buffer>
@@ -59,12 +66,20 @@ class Client :
 
     struct Locked_ {
         uint64_t benefit_ = 0;
+        uint64_t issued_ = 0;
         std::map<Bytes32, std::pair<Ticket, Signature>> pending_;
 
         int64_t serial_ = -1;
         checked_int256_t balance_ = 0;
         Address recipient_ = 0;
         Bytes32 commit_ = Zero<32>();
+
+        Sizer sizer_;
+
+        Locked_(const uint256_t &prepay) :
+            sizer_(prepay.convert_to<double>(), Risk(), PrepaySeconds_)
+        {
+        }
     }; Locked<Locked_> locked_;
 
     Nest nest_;
@@ -73,6 +88,8 @@ class Client :
     task<void> Submit();
     task<void> Submit(const Bytes32 &hash, const Ticket &ticket, const Signature &signature);
 
+    static double Risk();
+
     void Issue(uint256_t amount);
     void Transfer(size_t size);
 
@@ -88,6 +105,12 @@ class Client :
     task<void> Shut() noexcept override;
 
     task<void> Send(const Buffer &data) override;
+
+    // tickets issued, how many of those no invoice has acknowledged yet, and the last invoice's serial
+    std::tuple<uint64_t, size_t, int64_t> Tickets() {
+        const auto locked(locked_());
+        return {locked->issued_, locked->pending_.size(), locked->serial_};
+    }
 };
 
 }